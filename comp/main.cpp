@@ -1,6 +1,7 @@
 #include <vector>
 #include <fstream>
 #include <filesystem>
+#include <cstdlib>
 
 #include "fmt/format.h"
 
@@ -9,13 +10,61 @@
 #include "purson/parser.hpp"
 #include "purson/module.hpp"
 
-extern "C"
-void f1i32u0println(std::int32_t i){ fmt::print(stdout, "{}\n", i); }
+// relative to the install prefix
+#ifndef PURSON_RUNTIME_ARCHIVE
+#define PURSON_RUNTIME_ARCHIVE "lib/libpurson-rt.a"
+#endif
+
+// provided by the runtime
+extern "C" void f1i32u0println(std::int32_t i);
+
+enum class output_kind{
+	executable, shared_library, object, jit, interp
+};
+
+static std::string shell_quote(std::string_view arg){
+	std::string ret = "'";
+	for(auto c : arg){
+		if(c == '\'') ret += "'\\''";
+		else ret += c;
+	}
+
+	return ret + "'";
+}
+
+//! @returns the runtime archive of the prefix this executable is installed to, or the one from its build tree if there's none
+static std::string default_runtime_archive(const char *argv0){
+	namespace fs = std::filesystem;
+
+	std::error_code ec;
+	auto exe = fs::read_symlink("/proc/self/exe", ec);
+	if(ec)
+		exe = fs::absolute(argv0, ec);
+
+	// installed as <prefix>/bin/purson-comp
+	auto installed = exe.parent_path().parent_path() / PURSON_RUNTIME_ARCHIVE;
+
+#ifdef PURSON_BUILD_RUNTIME_ARCHIVE
+	if(!fs::exists(installed, ec))
+		return PURSON_BUILD_RUNTIME_ARCHIVE;
+#endif
+
+	return installed.string();
+}
 
 int main(int argc, char *argv[]){
 	std::vector<std::string> input_files;
 	std::string_view output_file;
 	std::string_view revision = "dev";
+	auto opt = purson::opt_level::O2;
+	std::string_view cache_dir;
+	auto arch = purson::target::auto_;
+	purson::target_cpu cpu;
+	auto kind = output_kind::executable;
+	std::string_view linker = "c++";
+	std::string runtime_archive;
+	bool thin_lto = false;
+	std::vector<std::string> multiversioned;
 
 	for(int i = 1; i < argc; i++){
 		auto arg = std::string_view(argv[i]);
@@ -37,6 +86,99 @@ int main(int argc, char *argv[]){
 
 			revision = arg;
 		}
+		else if(arg == "-cache"){
+			++i;
+			if(i >= argc){
+				fmt::print(stderr, "no directory given after '-cache'\n");
+				return EXIT_FAILURE;
+			}
+
+			cache_dir = std::string_view(argv[i]);
+		}
+		else if(arg == "-c")
+			kind = output_kind::object;
+		else if(arg == "-shared")
+			kind = output_kind::shared_library;
+		else if(arg == "-jit")
+			kind = output_kind::jit;
+		else if(arg == "-interp")
+			kind = output_kind::interp;
+		else if(arg == "-lto")
+			thin_lto = true;
+		else if(arg == "-mversion"){
+			++i;
+			if(i >= argc){
+				fmt::print(stderr, "no function given after '-mversion'\n");
+				return EXIT_FAILURE;
+			}
+
+			// comma separated mangled names
+			auto names = std::string_view(argv[i]);
+			while(!names.empty()){
+				auto end = names.find(',');
+				auto name = names.substr(0, end);
+				if(!name.empty()) multiversioned.emplace_back(name);
+
+				names = (end == std::string_view::npos) ? std::string_view() : names.substr(end + 1);
+			}
+		}
+		else if(arg == "-linker"){
+			++i;
+			if(i >= argc){
+				fmt::print(stderr, "no linker given after '-linker'\n");
+				return EXIT_FAILURE;
+			}
+
+			linker = std::string_view(argv[i]);
+		}
+		else if(arg == "-runtime"){
+			++i;
+			if(i >= argc){
+				fmt::print(stderr, "no runtime archive given after '-runtime'\n");
+				return EXIT_FAILURE;
+			}
+
+			runtime_archive = argv[i];
+		}
+		else if(arg == "-march"){
+			++i;
+			if(i >= argc){
+				fmt::print(stderr, "no architecture given after '-march'\n");
+				return EXIT_FAILURE;
+			}
+
+			auto name = std::string_view(argv[i]);
+			if((name == "native") || (name == "auto")) arch = purson::target::auto_;
+			else if(name == "x86") arch = purson::target::x86;
+			else if((name == "x86_64") || (name == "x86-64")) arch = purson::target::x86_64;
+			else if(name == "arm") arch = purson::target::arm;
+			else if((name == "arm64") || (name == "aarch64")) arch = purson::target::arm64;
+			else{
+				fmt::print(stderr, "invalid architecture '{}'\n", name);
+				return EXIT_FAILURE;
+			}
+		}
+		else if(arg == "-mcpu"){
+			++i;
+			if(i >= argc){
+				fmt::print(stderr, "no cpu given after '-mcpu'\n");
+				return EXIT_FAILURE;
+			}
+
+			cpu.name = argv[i];
+		}
+		else if((arg.size() == 3) && (arg.substr(0, 2) == "-O")){
+			switch(arg[2]){
+				case '0': opt = purson::opt_level::O0; break;
+				case '1': opt = purson::opt_level::O1; break;
+				case '2': opt = purson::opt_level::O2; break;
+				case '3': opt = purson::opt_level::O3; break;
+				case 's': opt = purson::opt_level::Os; break;
+				default:
+					fmt::print(stderr, "invalid optimization level '{}'\n", arg);
+					return EXIT_FAILURE;
+			}
+		}
 		else if(arg[0] == '-'){
 			fmt::print(stderr, "invalid option specified\n");
 			return EXIT_FAILURE;
@@ -49,29 +191,26 @@ int main(int argc, char *argv[]){
 		fmt::print(stderr, "no input files given. exiting...\n");
 		return EXIT_FAILURE;
 	}
-	else if(!output_file.size()){
+	else if(!output_file.size() && (kind != output_kind::jit) && (kind != output_kind::interp)){
 		fmt::print(stderr, "no output file given. exiting...\n");
 		return EXIT_FAILURE;
 	}
 
 	auto types = purson::types(revision);
-	auto modules = purson::make_jit_moduleset(purson::target::auto_);
 
 	auto unit_ty = types->unit();
 	auto int32_ty = types->integer(32);
-	auto uint32_ty = types->natural(32);
 
 	auto fn_ty = types->function(unit_ty, {int32_ty});
 
 	auto main_fn_name = purson::mangle_fn_name("main", int32_ty, {});
 
-	modules->set_fn_ptr("f1i32u0println", reinterpret_cast<void*>(f1i32u0println));
-
-	std::vector<purson::jit_module*> jit_modules;
-	jit_modules.reserve(input_files.size());
-
 	namespace fs = std::filesystem;
 
+	// lexing and parsing share the typeset so stay serial, generating code is done in parallel
+	std::vector<purson::jit_moduleset::module_source> srcs;
+	srcs.reserve(input_files.size());
+
 	for(std::size_t i = 0; i < input_files.size(); i++){
 		fs::path p(input_files[i]);
 		if(!fs::exists(p)){
@@ -85,15 +224,119 @@ int main(int argc, char *argv[]){
 		while(std::getline(ifile, tmp)) src = fmt::format("{}\n{}", src, tmp);
 
 		auto toks = purson::lex(revision, input_files[i], src);
-		auto exps = purson::parse(revision, toks);
+		srcs.emplace_back(input_files[i], purson::parse(revision, toks));
+	}
+
+	if(kind == output_kind::jit){
+		std::unique_ptr<purson::jit_moduleset> modules;
+		void *main_fn = nullptr;
+
+		try{
+			modules = purson::make_jit_moduleset(arch, opt, false, cpu);
+			if(cache_dir.size())
+				modules->set_cache_dir(cache_dir);
+
+			modules->set_fn_ptr("f1i32u0println", reinterpret_cast<void*>(f1i32u0println));
+
+			auto jit_modules = modules->create_modules(srcs);
+			for(auto &&module : jit_modules)
+				module->register_func("f1i32u0println", reinterpret_cast<void*>(f1i32u0println), fn_ty);
 
-		auto &&module = jit_modules.emplace_back(modules->create_module(input_files[i], exps));
-		module->register_func("f1i32u0println", reinterpret_cast<void*>(f1i32u0println), fn_ty);
-		//module->write(output_file);
+			main_fn = modules->get_fn_ptr(main_fn_name);
+		}
+		catch(const purson::module_error &err){
+			fmt::print(stderr, "{}\n", err.what());
+			return EXIT_FAILURE;
+		}
+
+		if(!main_fn){
+			fmt::print(stderr, "could not find main function '{}'\n", main_fn_name);
+			return EXIT_FAILURE;
+		}
+
+		return reinterpret_cast<std::int32_t(*)()>(main_fn)();
 	}
 
-	auto mainFn = modules->get_fn_ptr(main_fn_name);
-	if(!mainFn){
-		fmt::print(stderr, "could not find main function '{}'\n", main_fn_name);
+	if(kind == output_kind::interp){
+		try{
+			// the jit is only made if a function gets hot or can't be interpreted
+			auto modules = purson::make_interp_moduleset([=]{
+				auto jit = purson::make_jit_moduleset(arch, opt, false, cpu);
+				if(cache_dir.size())
+					jit->set_cache_dir(cache_dir);
+
+				return jit;
+			});
+
+			for(auto &&src : srcs)
+				modules->create_module(src.first, src.second);
+
+			return static_cast<std::int32_t>(modules->call(main_fn_name));
+		}
+		catch(const purson::module_error &err){
+			fmt::print(stderr, "{}\n", err.what());
+			return EXIT_FAILURE;
+		}
+	}
+
+	// the fallback and everything that isn't versioned runs on any cpu only if the target is a baseline one
+	if(!multiversioned.empty() && (cpu.name == "native")){
+		fmt::print(stderr, "'-mversion' needs a baseline cpu, so it can't be used with '-mcpu native'\n");
+		return EXIT_FAILURE;
+	}
+
+	if(thin_lto && (kind == output_kind::object)){
+		fmt::print(stderr, "'-lto' writes an object per module, so it can't be used with '-c'\n");
+		return EXIT_FAILURE;
+	}
+
+	// executables and libraries are linked from temporary objects
+	std::vector<std::string> obj_files;
+	auto entry = (kind == output_kind::executable) ? std::string_view(main_fn_name) : std::string_view();
+
+	try{
+		auto modules = purson::make_object_moduleset(arch, opt, cpu);
+		for(auto &&src : srcs)
+			modules->create_module(src.first, src.second);
+
+		modules->set_multiversioned(std::move(multiversioned));
+
+		if(thin_lto)
+			obj_files = modules->write_thin(output_file, entry, kind == output_kind::shared_library);
+		else{
+			auto &&obj_file = obj_files.emplace_back((kind == output_kind::object) ? std::string(output_file) : fmt::format("{}.o", output_file));
+			modules->write(obj_file, entry);
+		}
+	}
+	catch(const purson::module_error &err){
+		fmt::print(stderr, "{}\n", err.what());
+		return EXIT_FAILURE;
+	}
+
+	if(kind == output_kind::object)
+		return EXIT_SUCCESS;
+
+	if(runtime_archive.empty())
+		runtime_archive = default_runtime_archive(argv[0]);
+
+	std::string objs_arg;
+	for(auto &&obj_file : obj_files)
+		objs_arg += shell_quote(obj_file) + " ";
+
+	auto link_cmd = fmt::format(
+		"{} {}-o {} {}{} -lmpfr -lgmp",
+		linker, (kind == output_kind::shared_library) ? "-shared " : "",
+		shell_quote(output_file), objs_arg, shell_quote(runtime_archive)
+	);
+
+	auto status = std::system(link_cmd.c_str());
+
+	std::error_code ec;
+	for(auto &&obj_file : obj_files)
+		fs::remove(obj_file, ec);
+
+	if(status != 0){
+		fmt::print(stderr, "linking '{}' failed\n", output_file);
+		return EXIT_FAILURE;
 	}
 }
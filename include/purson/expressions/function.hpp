@@ -50,15 +50,17 @@ namespace purson{
 	
 	class return_expr: public rvalue_expr{
 		public:
-			explicit return_expr(std::shared_ptr<const rvalue_expr> value_)
-				: m_value{std::move(value_)}{}
+			//! numeric values are converted to ty_ when it is given
+			explicit return_expr(std::shared_ptr<const rvalue_expr> value_, const type *ty_ = nullptr)
+				: m_value{std::move(value_)}, m_ty{ty_}{}
 				
 			const rvalue_expr *value() const noexcept{ return m_value.get(); }
 
-			const type *value_type() const noexcept override{ return m_value->value_type(); }
+			const type *value_type() const noexcept override{ return m_ty ? m_ty : m_value->value_type(); }
 
 		private:
 			std::shared_ptr<const rvalue_expr> m_value;
+			const type *m_ty;
 	};
 	
 	class block_expr: public rvalue_expr{
@@ -98,7 +98,7 @@ namespace purson{
 				else if(mpz_fits_slong_p(m_val))
 					m_type = types->integer(64);
 				else
-					throw expr_error{"integer literal is too large to fit in any underlying type"};
+					m_type = types->integer(0);
 			}
 			
 			~integer_literal_expr(){
@@ -125,7 +125,7 @@ namespace purson{
 				else if(mpz_fits_ulong_p(m_val))
 					m_type = types->natural(64);
 				else
-					throw expr_error{"natural literal is too large to fit in any underlying type"};
+					m_type = types->natural(0);
 			}
 			
 			~natural_literal_expr(){
@@ -205,6 +205,32 @@ namespace purson{
 			mpfr_t m_val;
 			const real_type *m_type;
 	};
+	
+	//! literal of the form '2.5i', the real component is always zero
+	class imaginary_literal_expr: public numeric_literal_expr{
+		public:
+			imaginary_literal_expr(std::string_view lit, const typeset *types)
+				: numeric_literal_expr(lit){
+				if(lit.empty() || (lit.back() != 'i'))
+					throw expr_error{"invalid imaginary literal"};
+				
+				mpfr_init_set_str(m_val, std::string(lit.substr(0, lit.size() - 1)).c_str(), 10, MPFR_RNDN);
+				m_type = types->complex(types->real(32));
+			}
+			
+			~imaginary_literal_expr(){
+				mpfr_clear(m_val);
+			}
+			
+			//! @returns the imaginary component
+			const mpfr_t &value() const noexcept{ return m_val; }
+			
+			const complex_type *value_type() const noexcept override{ return m_type; }
+			
+		private:
+			mpfr_t m_val;
+			const complex_type *m_type;
+	};
 }
 
 #endif // !PURSON_EXPRESSIONS_LITERAL_HPP
@@ -29,8 +29,8 @@ namespace purson{
 	
 	class binary_op_expr: public op_expr{
 		public:
-			binary_op_expr(operator_type op_ty, std::shared_ptr<const rvalue_expr> lhs_, std::shared_ptr<const rvalue_expr> rhs_)
-				: m_operator(binary_op, op_ty, lhs_->value_type(), rhs_->value_type()), m_lhs(lhs_), m_rhs(rhs_){}
+			binary_op_expr(operator_type op_ty, std::shared_ptr<const rvalue_expr> lhs_, std::shared_ptr<const rvalue_expr> rhs_, const typeset *types = nullptr)
+				: m_operator(binary_op, op_ty, lhs_->value_type(), rhs_->value_type(), types), m_lhs(lhs_), m_rhs(rhs_){}
 			
 			const type *value_type() const noexcept override{ return m_operator.result_type(); }
 			
@@ -23,8 +23,9 @@ namespace purson{
 
 	class var_def_expr: public var_decl_expr{
 		public:
-			var_def_expr(std::string_view name_, bool is_mutable_, std::shared_ptr<const rvalue_expr> value_)
-				: var_decl_expr(name_, value_->value_type(), is_mutable_), m_value(std::move(value_)){}
+			//! ty_ is the declared type the value is converted to, null for the value's own type
+			var_def_expr(std::string_view name_, bool is_mutable_, std::shared_ptr<const rvalue_expr> value_, const type *ty_ = nullptr)
+				: var_decl_expr(name_, ty_ ? ty_ : value_->value_type(), is_mutable_), m_value(std::move(value_)){}
 
 			std::shared_ptr<const rvalue_expr> value() const noexcept{ return m_value; }
 
@@ -1,8 +1,12 @@
 #ifndef PURSON_MODULE_HPP
 #define PURSON_MODULE_HPP 1
 
+#include <cstdint>
+#include <functional>
+#include <string>
 #include <vector>
 #include <memory>
+#include <utility>
 
 #include "exception.hpp"
 #include "expressions/function.hpp"
@@ -17,6 +21,20 @@ namespace purson{
 		auto_, arm, arm64, x86, x86_64
 	};
 
+	//! optimization level used when compiling modules, Os optimizes for size
+	enum class opt_level{
+		O0, O1, O2, O3, Os
+	};
+
+	//! cpu to generate code for
+	struct target_cpu{
+		//! llvm cpu name like "skylake", "native" for the host cpu and all of its features, empty for the default of whatever compiles
+		std::string name;
+
+		//! comma separated features like "+avx2,-avx512f" applied on top of the cpu's own
+		std::string features;
+	};
+
 	class module{
 		public:
 			virtual ~module() = default;
@@ -40,20 +58,287 @@ namespace purson{
 			virtual void *get_fn_ptr(std::string_view mangled_name) = 0;
 	};
 	
+	/**
+	 * Modules compiled to machine code in this process as they're needed.
+	 *
+	 * Any number of threads may run jit compiled code, look up functions and
+	 * create, reload or destroy modules at the same time:
+	 * - get_fn_ptr and get_fn_ptrs never lock for functions looked up before,
+	 *   the table of them is replaced whole whenever it changes
+	 * - everything that adds, removes or compiles code, including the first
+	 *   call of a lazily compiled function from jit code, is serialized on a
+	 *   single lock; code that's already compiled never waits on it
+	 * - destroyed modules are gone for new lookups straight away, but their
+	 *   code is only freed once every thread that was inside a jit_run_guard
+	 *   when they were destroyed has left it
+	 * - the set_ functions are meant for setting things up, not for calling
+	 *   while other threads compile
+	 **/
 	class jit_moduleset: public moduleset{
 		public:
 			virtual std::size_t num_modules() const noexcept = 0;
 			virtual const jit_module *const *modules() const noexcept = 0;
 			
 			virtual jit_module *create_module(std::string_view name,  const std::vector<std::shared_ptr<const expr>> &exprs = {}) override = 0;
+
+			using module_source = std::pair<std::string_view, std::vector<std::shared_ptr<const expr>>>;
+
+			//! create several modules at once, generating and compiling them in parallel
+			virtual std::vector<jit_module*> create_modules(const std::vector<module_source> &srcs) = 0;
+
+			//! number of threads used by create_modules, 0 for one per hardware thread
+			virtual void set_compile_threads(std::size_t n) = 0;
+
+			/**
+			 * Drop each module's ir once all of its functions have been compiled
+			 *
+			 * Nothing of the ir is kept, only the compiled code and the declarations and globals
+			 * the jit still links against. A module whose ir was released is final: compile,
+			 * register_func, reload_fns, write, write_thin and save_snapshot throw a module_error
+			 * for it, or for a moduleset holding it.
+			 *
+			 * @param[in] release whether to release ir from now on
+			 **/
+			virtual void set_release_ir(bool release) noexcept = 0;
+
 			virtual bool destroy_module(const module*) noexcept override = 0;
 
+			/**
+			 * Recompile functions of a live module and switch everything over to the new code
+			 *
+			 * Each function defined in ast replaces the one with the same mangled
+			 * name in mod, and functions mod doesn't define yet are added. Pointers
+			 * from get_fn_ptr and calls from other modules go through stubs, so
+			 * they run the new code from their next call on without waiting for
+			 * anything. Each stub is switched atomically, but not all of them at
+			 * once. Globals stay the ones mod defines. Only functions of modules
+			 * from create_modules, which can't be reloaded, are inlined across
+			 * modules, so no other module keeps running an old body.
+			 *
+			 * Functions compiled in the same partition as a replaced one call it
+			 * directly rather than through its stub, so they're compiled again
+			 * along with the new code and their stubs are switched over as well.
+			 * They keep their old definitions and aren't in the returned names.
+			 *
+			 * @param[in] mod module created by create_module
+			 * @param[in] ast definitions of the new functions
+			 * @returns mangled names of the functions that were replaced
+			 * @throws module_error if mod can't be reloaded or ast doesn't compile, nothing is switched over then
+			 **/
+			virtual std::vector<std::string> reload_fns(const jit_module *mod, const std::vector<std::shared_ptr<const expr>> &ast) = 0;
+
+			//! cache compiled objects in dir, removing the least recently used past max_bytes
+			virtual void set_cache_dir(std::string_view dir, std::size_t max_bytes = 256 * 1024 * 1024) = 0;
+
 			virtual void set_fn_ptr(std::string_view identifier, void *fn_ptr) = 0;
 
+			//! look up several functions at once, null for any that weren't found
+			virtual std::vector<void*> get_fn_ptrs(const std::vector<std::string_view> &mangled_names) = 0;
+
 			virtual void write(std::string_view path) = 0;
+
+			/**
+			 * Save every module to a snapshot that load_snapshot can map back in
+			 *
+			 * Modules are compiled whole at full optimization, through the
+			 * object cache, along with their ir so they can still be recompiled
+			 * or written out after loading. Types are rebuilt from the language
+			 * version, anything else the embedder needs to resume goes in
+			 * user_data.
+			 *
+			 * @throws module_error if a module had functions reloaded or the snapshot can't be written
+			 **/
+			virtual void save_snapshot(std::string_view path, std::string_view user_data = {}) = 0;
+
+			/**
+			 * Add the modules of a snapshot without generating or compiling anything
+			 *
+			 * @param[in] path snapshot from save_snapshot by a moduleset with the same target and optimization level
+			 * @param[out] user_data set to what was saved with the snapshot, may be null
+			 * @returns the modules added, in the order they were saved, the mapped file is freed with the last of them
+			 * @throws module_error if the snapshot can't be read or is for another target, nothing is added then
+			 **/
+			virtual std::vector<jit_module*> load_snapshot(std::string_view path, std::string *user_data = nullptr) = 0;
+
+			/**
+			 * Mark the calling thread as running jit compiled code, see jit_run_guard
+			 *
+			 * @returns what to pass to leave
+			 **/
+			virtual std::size_t enter() noexcept = 0;
+
+			//! mark the calling thread as done running jit compiled code since the matching enter
+			virtual void leave(std::size_t token) noexcept = 0;
+	};
+
+	//! keeps the code of modules destroyed on other threads around while it's alive
+	class jit_run_guard{
+		public:
+			explicit jit_run_guard(jit_moduleset &modules) noexcept
+				: m_modules(modules), m_token(modules.enter()){}
+
+			~jit_run_guard(){ m_modules.leave(m_token); }
+
+			jit_run_guard(const jit_run_guard&) = delete;
+			jit_run_guard &operator=(const jit_run_guard&) = delete;
+
+		private:
+			jit_moduleset &m_modules;
+			std::size_t m_token;
 	};
 	
-	std::unique_ptr<jit_moduleset> make_jit_moduleset(target t = target::auto_);
+	/**
+	 * Compiled code shared by isolates.
+	 *
+	 * Modules added here are compiled and linked once, then called directly
+	 * by the modules of every isolate made from it. An isolate is a
+	 * jit_moduleset of its own, so its modules and the functions they
+	 * define are invisible to every other isolate. Shared code can only
+	 * call itself and the runtime, whose state is per thread, so nothing
+	 * in it is written to once it's linked.
+	 *
+	 * Safe to use from any number of threads.
+	 **/
+	class jit_code_cache{
+		public:
+			virtual ~jit_code_cache() = default;
+
+			/**
+			 * Compile modules in to the shared code, generating and compiling them in parallel
+			 *
+			 * @throws module_error if a module doesn't compile or link, modules linked before stay
+			 **/
+			virtual void add_modules(const std::vector<jit_moduleset::module_source> &srcs) = 0;
+
+			//! @returns a shared function, or null if there is none with that name
+			virtual void *get_fn_ptr(std::string_view mangled_name) const = 0;
+
+			//! cache compiled objects in dir, removing the least recently used past max_bytes
+			virtual void set_cache_dir(std::string_view dir, std::size_t max_bytes = 256 * 1024 * 1024) = 0;
+	};
+
+	/**
+	 * Modules run by a bytecode interpreter, tiering up to a jit_moduleset.
+	 *
+	 * Creating a module only generates bytecode, so code that runs once
+	 * never waits on llvm. Functions called often enough, and functions
+	 * using anything the bytecode can't express, are compiled by the jit,
+	 * which is only made once something needs it. Bytecode and jit code
+	 * call the same runtime functions with the same values, so bytecode can
+	 * call compiled functions directly. Native code can't call bytecode,
+	 * anything it gets from get_fn_ptr is compiled by the jit first.
+	 *
+	 * Not safe to use from more than one thread at a time.
+	 **/
+	class interp_moduleset: public moduleset{
+		public:
+			/**
+			 * Run a function
+			 *
+			 * Arguments and the result are passed as 64 bit registers: integers
+			 * sign or zero extended from their width, booleans as 0 or 1 and
+			 * reals as the bits of a double.
+			 *
+			 * @param[in] mangled_name function to call
+			 * @param[in] args one per parameter
+			 * @returns the result, 0 for functions returning unit
+			 * @throws module_error if the function isn't defined, can't be run or fails
+			 **/
+			virtual std::uint64_t call(std::string_view mangled_name, const std::vector<std::uint64_t> &args = {}) = 0;
+
+			//! calls of a function before it's compiled by the jit, 0 to only ever interpret what the bytecode can express
+			virtual void set_tier_up_threshold(std::uint64_t calls) noexcept = 0;
+
+			//! get_fn_ptr compiles the function with the jit, native code can't call bytecode
+			virtual void *get_fn_ptr(std::string_view mangled_name) override = 0;
+	};
+
+	class object_moduleset: public moduleset{
+		public:
+			/**
+			 * Link every module in to a single native object file
+			 *
+			 * @param[in] path object file to write
+			 * @param[in] entry mangled name of a function for a c main function to call, empty for none
+			 **/
+			virtual void write(std::string_view path, std::string_view entry = {}) = 0;
+
+			/**
+			 * Optimize across modules ThinLTO style, writing a native object file per module
+			 *
+			 * @param[in] path prefix of the object files to write
+			 * @param[in] entry mangled name of a function for a c main function to call, empty for none
+			 * @param[in] keep_exports keep every exported function, e.g. for a shared library, instead of only main
+			 * @returns the object files written
+			 **/
+			virtual std::vector<std::string> write_thin(std::string_view path, std::string_view entry = {}, bool keep_exports = false) = 0;
+
+			/**
+			 * Compile functions for several cpu feature levels, the best one is picked when the program is loaded
+			 *
+			 * Only x86-64 elf targets are supported. Variants add features
+			 * on top of the target cpu, so this is only useful with a baseline
+			 * cpu like x86-64 rather than the host's.
+			 *
+			 * @param[in] names mangled names of the functions to version, replacing any set before
+			 * @throws module_error when writing if the target doesn't support it or a function isn't defined by any module
+			 **/
+			virtual void set_multiversioned(std::vector<std::string> names) = 0;
+	};
+
+	/**
+	 * Create a set of jit compiled modules
+	 * 
+	 * @param[in] t target to compile for
+	 * @param[in] opt optimization level, the peak level if tiered
+	 * @param[in] tiered compile functions quickly first and recompile them at opt once they get hot
+	 * @param[in] cpu cpu to tune and select instructions for, the host cpu by default
+	 * @throws module_error if code for t can't be run on this machine
+	 **/
+	std::unique_ptr<jit_moduleset> make_jit_moduleset(
+		target t = target::auto_, opt_level opt = opt_level::O2, bool tiered = false, const target_cpu &cpu = {}
+	);
+
+	/**
+	 * Create code to share between isolates
+	 *
+	 * @param[in] t target to compile for
+	 * @param[in] opt optimization level
+	 * @param[in] cpu cpu to tune and select instructions for, the host cpu by default
+	 * @throws module_error if code for t can't be run on this machine
+	 **/
+	std::shared_ptr<jit_code_cache> make_jit_code_cache(target t = target::auto_, opt_level opt = opt_level::O2, const target_cpu &cpu = {});
+
+	/**
+	 * Create an isolate, a set of jit compiled modules that can call shared code
+	 *
+	 * Functions of the isolate's own modules take precedence over shared
+	 * ones with the same name. The isolate compiles for the same target
+	 * and at the same level as the shared code, and keeps it alive.
+	 *
+	 * @param[in] shared code the isolate's modules can call, from make_jit_code_cache
+	 * @param[in] tiered compile functions quickly first and recompile them once they get hot
+	 **/
+	std::unique_ptr<jit_moduleset> make_jit_isolate(std::shared_ptr<const jit_code_cache> shared, bool tiered = false);
+
+	/**
+	 * Create a set of interpreted modules
+	 *
+	 * @param[in] make_jit makes the jit functions tier up to, the first time one does; by default make_jit_moduleset()
+	 **/
+	std::unique_ptr<interp_moduleset> make_interp_moduleset(std::function<std::unique_ptr<jit_moduleset>()> make_jit = {});
+
+	/**
+	 * Create a set of modules compiled ahead of time to native objects
+	 *
+	 * @param[in] t target to compile for
+	 * @param[in] opt optimization level
+	 * @param[in] cpu cpu to tune and select instructions for, a baseline cpu for t by default and "native" for the host cpu
+	 * @param[in] pic generate position independent code, required for shared libraries
+	 **/
+	std::unique_ptr<object_moduleset> make_object_moduleset(
+		target t = target::auto_, opt_level opt = opt_level::O2, const target_cpu &cpu = {}, bool pic = true
+	);
 }
 
 #endif // !PURSON_MODULE_HPP
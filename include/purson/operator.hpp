@@ -101,8 +101,8 @@ namespace purson{
 	
 	class op{
 		public:
-			op(binary_op_tag_t, std::optional<operator_type> op_ty, const type *lhs, const type *rhs){
-				set_op(binary_op, op_ty, lhs, rhs);
+			op(binary_op_tag_t, std::optional<operator_type> op_ty, const type *lhs, const type *rhs, const typeset *types = nullptr){
+				set_op(binary_op, op_ty, lhs, rhs, types);
 			}
 			
 			op(unary_op_tag_t, std::optional<operator_type> op_ty, const type *operand){
@@ -125,7 +125,7 @@ namespace purson{
 			operator_type m_op_type;
 			const type *m_result_type;
 			
-			void set_op(binary_op_tag_t, std::optional<operator_type> op_ty_opt, const type *lhs, const type *rhs);
+			void set_op(binary_op_tag_t, std::optional<operator_type> op_ty_opt, const type *lhs, const type *rhs, const typeset *types);
 			void set_op(unary_op_tag_t, std::optional<operator_type> op_ty_opt, const type *operand);
 	};
 }
@@ -42,6 +42,13 @@ namespace purson{
 			 */
 		 	virtual const type_type *type_() const noexcept = 0;
 
+			/**
+			 * Get boolean type
+			 *
+			 * @returns the boolean type
+			 */
+			virtual const boolean_type *boolean() const noexcept = 0;
+
 		 	/**
 		 	 * Get string type
 		 	 *
@@ -53,7 +60,7 @@ namespace purson{
 			/**
 			 * Get natural type
 			 * 
-			 * @param[in] bits number of bits in underlying type
+			 * @param[in] bits number of bits in underlying type, 0 for an arbitrary precision natural
 			 * @returns nullptr if type not found, otherwise the natural type
 			 **/
 			virtual const natural_type *natural(std::uint32_t bits) const = 0;
@@ -61,7 +68,7 @@ namespace purson{
 			/**
 			 * Get integer type
 			 * 
-			 * @param[in] bits number of bits in underlying type
+			 * @param[in] bits number of bits in underlying type, 0 for an arbitrary precision integer
 			 * @returns nullptr if type not found, otherwise the integer type
 			 **/
 			virtual const integer_type *integer(std::uint32_t bits) const = 0;
@@ -76,12 +83,20 @@ namespace purson{
 			/**
 			 * Get real type
 			 * 
-			 * @param[in] bits number of bits in underlying type
-			 * @param[in] ieee754 whether the underlying type is a ieee754 float
+			 * @param[in] bits number of bits in underlying type, or the precision in bits if not ieee754
+			 * @param[in] ieee754 whether the underlying type is a ieee754 float, otherwise an arbitrary precision real
 			 * @returns nullptr if type not found, otherwise the real type
 			 **/
 			virtual const real_type *real(std::uint32_t bits, bool ieee754 = true) const = 0;
 			
+			/**
+			 * Get complex type
+			 * 
+			 * @param[in] real_type_ type of the real and imaginary components
+			 * @returns nullptr if type not found, otherwise the complex type
+			 **/
+			virtual const complex_type *complex(const real_type *real_type_) const = 0;
+			
 			/**
 			 * Get function type
 			 * 
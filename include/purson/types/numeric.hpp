@@ -10,7 +10,31 @@ namespace purson{
 	struct integer_type: natural_type{};
 	struct rational_type: integer_type{};
 	struct real_type: rational_type{};
-	struct complex_type: real_type{};
+	//! pair of reals, bits is the width of each component
+	struct complex_type: real_type{
+		virtual const real_type *component_type() const noexcept = 0;
+	};
+
+	//! marker for numeric types whose values aren't bounded by a fixed width
+	struct arbitrary_precision_type: virtual type{};
+
+	inline bool is_arbitrary_precision(const type *ty) noexcept{
+		return dynamic_cast<const arbitrary_precision_type*>(ty) != nullptr;
+	}
+
+	//! most derived numeric category of a type, ordered by promotion rank
+	enum class numeric_category{
+		none, natural, integer, rational, real, complex
+	};
+
+	inline numeric_category numeric_category_of(const type *ty) noexcept{
+		if(dynamic_cast<const complex_type*>(ty)) return numeric_category::complex;
+		else if(dynamic_cast<const real_type*>(ty)) return numeric_category::real;
+		else if(dynamic_cast<const rational_type*>(ty)) return numeric_category::rational;
+		else if(dynamic_cast<const integer_type*>(ty)) return numeric_category::integer;
+		else if(dynamic_cast<const natural_type*>(ty)) return numeric_category::natural;
+		else return numeric_category::none;
+	}
 }
 
 #endif // !PURSON_TYPES_NUMERIC_HPP
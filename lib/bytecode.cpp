@@ -0,0 +1,605 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <set>
+
+#include <mpfr.h>
+
+#include "fmt/format.h"
+
+#include "purson/expressions.hpp"
+#include "purson/types/numeric.hpp"
+
+#include "bytecode.hpp"
+
+namespace purson{
+	namespace{
+		//! thrown for anything the bytecode can't express, the function is left to the jit
+		struct unsupported{};
+
+		enum class value_class{
+			fixed_signed, fixed_unsigned, tagged, real, boolean, unit
+		};
+
+		struct value_kind{
+			value_class cls;
+			std::size_t bits;
+
+			bool is_fixed() const noexcept{ return (cls == value_class::fixed_signed) || (cls == value_class::fixed_unsigned); }
+		};
+
+		value_kind kind_of(const type *ty){
+			if(!ty)
+				throw unsupported{};
+			else if(dynamic_cast<const unit_type*>(ty))
+				return {value_class::unit, 0};
+			else if(dynamic_cast<const boolean_type*>(ty))
+				return {value_class::boolean, 1};
+
+			switch(numeric_category_of(ty)){
+				case numeric_category::natural:
+				case numeric_category::integer:{
+					if(is_arbitrary_precision(ty))
+						return {value_class::tagged, 64};
+					else if(!ty->bits() || (ty->bits() > 64))
+						throw unsupported{};
+
+					auto cls = (numeric_category_of(ty) == numeric_category::integer) ? value_class::fixed_signed : value_class::fixed_unsigned;
+					return {cls, ty->bits()};
+				}
+
+				case numeric_category::real:{
+					if(is_arbitrary_precision(ty) || ((ty->bits() != 32) && (ty->bits() != 64)))
+						throw unsupported{};
+
+					return {value_class::real, ty->bits()};
+				}
+
+				default:
+					throw unsupported{};
+			}
+		}
+
+		std::uint64_t extend(std::uint64_t val, std::size_t bits, bool is_signed) noexcept{
+			if(bits >= 64) return val;
+
+			auto shift = 64 - bits;
+			if(is_signed)
+				return static_cast<std::uint64_t>(static_cast<std::int64_t>(val << shift) >> shift);
+			else
+				return val & ((std::uint64_t(1) << bits) - 1);
+		}
+
+		std::uint64_t double_bits(double val) noexcept{
+			std::uint64_t ret;
+			std::memcpy(&ret, &val, sizeof(ret));
+			return ret;
+		}
+
+		std::optional<bc_cond> cond_of(operator_type op_ty){
+			switch(op_ty){
+				case operator_type::equ: return bc_cond::eq;
+				case operator_type::neq: return bc_cond::ne;
+				case operator_type::lt: return bc_cond::lt;
+				case operator_type::gt: return bc_cond::gt;
+				case operator_type::lte: return bc_cond::le;
+				case operator_type::gte: return bc_cond::ge;
+				default: return std::nullopt;
+			}
+		}
+
+		class fn_generator{
+			public:
+				explicit fn_generator(bc_function &fn): m_fn(fn){}
+
+				void generate(const fn_def_expr *def){
+					for(auto &&param : def->params()){
+						kind_of(param.second);
+						m_vars[param.first] = new_reg();
+					}
+
+					if(auto block = dynamic_cast<const block_expr*>(def->body())){
+						for(auto &&expr : block->exprs())
+							gen(expr.get());
+					}
+					else if(auto rvalue = dynamic_cast<const rvalue_expr*>(def->body()))
+						gen(rvalue);
+					else
+						throw module_error{fmt::format("unexpected return expression '{}'", def->body()->str())};
+
+					// the jit leaves falling off the end of a function with a result undefined, this returns zero
+					release_vars();
+					if(kind_of(def->return_type()).cls == value_class::unit)
+						emit(bc_op::ret_void);
+					else
+						emit(bc_op::ret, load_const(0));
+				}
+
+			private:
+				bc_function &m_fn;
+				std::map<std::string_view, std::uint16_t> m_vars;
+
+				//! registers holding words made by operations, literals, casts or calls, released once an operation consumes them
+				std::set<std::uint16_t> m_owned;
+
+				//! registers of variables owning their word until the function returns
+				std::vector<std::uint16_t> m_owned_vars;
+
+				std::uint16_t new_reg(){
+					if(m_fn.num_regs == std::numeric_limits<std::uint16_t>::max())
+						throw unsupported{};
+
+					return m_fn.num_regs++;
+				}
+
+				void emit(bc_op op, std::uint16_t a = 0, std::uint16_t b = 0, std::uint16_t c = 0, std::uint8_t width = 0){
+					m_fn.code.push_back({op, width, a, b, c});
+				}
+
+				std::uint16_t load_const(std::uint64_t val){
+					auto res = std::find(begin(m_fn.consts), end(m_fn.consts), val);
+					auto idx = std::distance(begin(m_fn.consts), res);
+					if(res == end(m_fn.consts)){
+						if(m_fn.consts.size() == std::numeric_limits<std::uint16_t>::max())
+							throw unsupported{};
+
+						m_fn.consts.push_back(val);
+					}
+
+					auto reg = new_reg();
+					emit(bc_op::load_k, reg, static_cast<std::uint16_t>(idx));
+					return reg;
+				}
+
+				//! release reg if it holds a word nothing else refers to
+				void release(std::uint16_t reg){
+					if(m_owned.erase(reg))
+						emit(bc_op::int_release, reg);
+				}
+
+				//! reg as a word the function owns, copied if something else still refers to it
+				std::uint16_t take(std::uint16_t reg){
+					if(m_owned.erase(reg))
+						return reg;
+
+					auto dst = new_reg();
+					emit(bc_op::int_copy, dst, reg);
+					return dst;
+				}
+
+				void release_vars(){
+					for(auto reg : m_owned_vars)
+						emit(bc_op::int_release, reg);
+				}
+
+				void normalize(std::uint16_t reg, const value_kind &kind){
+					if(kind.bits < 64)
+						emit((kind.cls == value_class::fixed_signed) ? bc_op::sext : bc_op::zext, reg, reg, 0, kind.bits);
+				}
+
+				std::uint16_t gen(const rvalue_expr *rvalue){
+					if(auto lit = dynamic_cast<const literal_expr*>(rvalue))
+						return gen_literal(lit);
+					else if(auto binop = dynamic_cast<const binary_op_expr*>(rvalue))
+						return gen_binop(binop);
+					else if(auto var_ref = dynamic_cast<const var_ref_expr*>(rvalue)){
+						auto res = m_vars.find(var_ref->name());
+						if(res == end(m_vars))
+							throw module_error{fmt::format("identifier '{}' does not refer to anything", var_ref->name())};
+
+						return res->second;
+					}
+					else if(auto var_def = dynamic_cast<const var_def_expr*>(rvalue)){
+						if(m_vars.count(var_def->name()))
+							throw module_error{"variable with same name already exists"};
+
+						auto value = var_def->value().get();
+						auto val = gen_cast(gen(value), value->value_type(), var_def->value_type());
+
+						auto reg = new_reg();
+						if(kind_of(var_def->value_type()).cls == value_class::tagged){
+							emit(bc_op::move, reg, take(val));
+							m_owned_vars.push_back(reg);
+						}
+						else
+							emit(bc_op::move, reg, val);
+
+						m_vars[var_def->name()] = reg;
+						return reg;
+					}
+					else if(auto var_decl = dynamic_cast<const var_decl_expr*>(rvalue)){
+						if(m_vars.count(var_decl->name()))
+							throw module_error{"variable with same name already exists"};
+
+						kind_of(var_decl->value_type());
+						return m_vars[var_decl->name()] = load_const(0);
+					}
+					else if(auto call = dynamic_cast<const fn_call_expr*>(rvalue))
+						return gen_call(call);
+					else if(auto ret = dynamic_cast<const return_expr*>(rvalue)){
+						if(kind_of(ret->value()->value_type()).cls == value_class::unit){
+							release_vars();
+							emit(bc_op::ret_void);
+							return 0;
+						}
+
+						// the caller owns a returned word
+						auto val = gen_cast(gen(ret->value()), ret->value()->value_type(), ret->value_type());
+						if(kind_of(ret->value_type()).cls == value_class::tagged)
+							val = take(val);
+
+						release_vars();
+						emit(bc_op::ret, val);
+						return 0;
+					}
+
+					// nested functions and everything else the jit handles on its own
+					throw unsupported{};
+				}
+
+				std::uint16_t gen_literal(const literal_expr *lit){
+					if(dynamic_cast<const natural_literal_expr*>(lit) || dynamic_cast<const integer_literal_expr*>(lit)){
+						auto nat_lit = dynamic_cast<const natural_literal_expr*>(lit);
+						auto &&val = nat_lit ? nat_lit->value() : dynamic_cast<const integer_literal_expr*>(lit)->value();
+						auto kind = kind_of(lit->value_type());
+
+						if(kind.cls == value_class::tagged){
+							if(mpz_fits_slong_p(val)){
+								std::int64_t small = mpz_get_si(val);
+								if((small >= -(std::int64_t(1) << 62)) && (small < (std::int64_t(1) << 62)))
+									return load_const(static_cast<std::uint64_t>(small * 2 + 1));
+							}
+
+							if(m_fn.strings.size() == std::numeric_limits<std::uint16_t>::max())
+								throw unsupported{};
+
+							std::string val_str(mpz_sizeinbase(val, 10) + 2, '\0');
+							mpz_get_str(&val_str[0], 10, val);
+							val_str.resize(std::strlen(val_str.c_str()));
+
+							auto reg = new_reg();
+							emit(bc_op::int_from_str, reg, static_cast<std::uint16_t>(m_fn.strings.size()));
+							m_fn.strings.push_back(std::move(val_str));
+							m_owned.insert(reg);
+							return reg;
+						}
+
+						// the low 64 bits in two's complement, same as the jit truncating the literal
+						static_assert(sizeof(unsigned long) == sizeof(std::uint64_t));
+						mpz_t low;
+						mpz_init(low);
+						mpz_fdiv_r_2exp(low, val, 64);
+						std::uint64_t bits = mpz_get_ui(low);
+						mpz_clear(low);
+
+						return load_const(extend(bits, kind.bits, kind.cls == value_class::fixed_signed));
+					}
+					else if(auto real_lit = dynamic_cast<const real_literal_expr*>(lit)){
+						auto kind = kind_of(real_lit->value_type());
+						if(kind.bits == 32)
+							return load_const(double_bits(mpfr_get_flt(real_lit->value(), MPFR_RNDN)));
+						else
+							return load_const(double_bits(mpfr_get_d(real_lit->value(), MPFR_RNDN)));
+					}
+
+					throw unsupported{};
+				}
+
+				std::uint16_t gen_cast(std::uint16_t reg, const type *from, const type *to){
+					if(from == to) return reg;
+
+					auto from_kind = kind_of(from);
+					auto to_kind = kind_of(to);
+
+					if((from_kind.cls == value_class::boolean) || (to_kind.cls == value_class::boolean) ||
+					   (from_kind.cls == value_class::unit) || (to_kind.cls == value_class::unit))
+						throw unsupported{};
+
+					bool from_signed = from_kind.cls == value_class::fixed_signed;
+					auto dst = new_reg();
+
+					if(to_kind.cls == value_class::tagged){
+						if(from_kind.cls == value_class::tagged)
+							return reg;
+						else if(from_kind.cls == value_class::real)
+							emit(bc_op::int_from_f64, dst, reg);
+						else
+							emit(from_signed ? bc_op::int_from_i64 : bc_op::int_from_u64, dst, reg);
+
+						m_owned.insert(dst);
+					}
+					else if(from_kind.cls == value_class::tagged){
+						if(to_kind.cls == value_class::real){
+							emit(bc_op::int_to_f64, dst, reg);
+							if(to_kind.bits == 32)
+								emit(bc_op::fround32, dst, dst);
+						}
+						else{
+							emit(bc_op::int_to_i64, dst, reg);
+							normalize(dst, to_kind);
+						}
+
+						release(reg);
+					}
+					else if(to_kind.cls == value_class::real){
+						if(from_kind.cls == value_class::real){
+							if(to_kind.bits >= from_kind.bits)
+								return reg;
+
+							emit(bc_op::fround32, dst, reg);
+						}
+						else{
+							emit(from_signed ? bc_op::sitof : bc_op::uitof, dst, reg);
+							if(to_kind.bits == 32)
+								emit(bc_op::fround32, dst, dst);
+						}
+					}
+					else{
+						if(from_kind.cls == value_class::real)
+							emit((to_kind.cls == value_class::fixed_signed) ? bc_op::ftosi : bc_op::ftoui, dst, reg);
+						else
+							emit(bc_op::move, dst, reg);
+
+						normalize(dst, to_kind);
+					}
+
+					return dst;
+				}
+
+				std::uint16_t gen_binop(const binary_op_expr *binop){
+					auto lhs_ty = binop->lhs()->value_type();
+					auto rhs_ty = binop->rhs()->value_type();
+					auto higher_ty = promote_type(lhs_ty, rhs_ty);
+					auto kind = kind_of(higher_ty);
+
+					auto lhs = gen_cast(gen(binop->lhs().get()), lhs_ty, higher_ty);
+					auto rhs = gen_cast(gen(binop->rhs().get()), rhs_ty, higher_ty);
+
+					auto op_ty = binop->operator_().op_type();
+					auto cond = cond_of(op_ty);
+					auto dst = new_reg();
+
+					auto emit_op = [&](bc_op op){ emit(op, dst, lhs, rhs); };
+					auto emit_cmp = [&](bc_op op){ emit(op, dst, lhs, rhs, static_cast<std::uint8_t>(*cond)); };
+
+					switch(kind.cls){
+						case value_class::tagged:{
+							if(cond)
+								emit_cmp(bc_op::int_cmp);
+							else{
+								switch(op_ty){
+									case operator_type::add: emit_op(bc_op::int_add); break;
+									case operator_type::sub:
+										emit_op((numeric_category_of(higher_ty) == numeric_category::natural) ? bc_op::nat_sub : bc_op::int_sub);
+										break;
+									case operator_type::mul: emit_op(bc_op::int_mul); break;
+									case operator_type::div: emit_op(bc_op::int_div); break;
+									default: throw unsupported{};
+								}
+
+								m_owned.insert(dst);
+							}
+
+							// results are always new words, never one of the operands
+							release(lhs);
+							release(rhs);
+							return dst;
+						}
+
+						case value_class::real:{
+							if(cond){
+								emit_cmp(bc_op::fcmp);
+								return dst;
+							}
+
+							switch(op_ty){
+								case operator_type::add: emit_op(bc_op::fadd); break;
+								case operator_type::sub: emit_op(bc_op::fsub); break;
+								case operator_type::mul: emit_op(bc_op::fmul); break;
+								case operator_type::div: emit_op(bc_op::fdiv); break;
+								default: throw unsupported{};
+							}
+
+							if(kind.bits == 32)
+								emit(bc_op::fround32, dst, dst);
+
+							return dst;
+						}
+
+						case value_class::fixed_signed:
+						case value_class::fixed_unsigned:{
+							bool is_signed = kind.cls == value_class::fixed_signed;
+							if(cond){
+								emit_cmp(is_signed ? bc_op::scmp : bc_op::ucmp);
+								return dst;
+							}
+
+							switch(op_ty){
+								case operator_type::add: emit_op(bc_op::add); break;
+								case operator_type::sub: emit_op(bc_op::sub); break;
+								case operator_type::mul: emit_op(bc_op::mul); break;
+								case operator_type::div: emit_op(is_signed ? bc_op::sdiv : bc_op::udiv); break;
+								default: throw unsupported{};
+							}
+
+							normalize(dst, kind);
+							return dst;
+						}
+
+						case value_class::boolean:{
+							if(!cond || ((*cond != bc_cond::eq) && (*cond != bc_cond::ne)))
+								throw unsupported{};
+
+							emit_cmp(bc_op::ucmp);
+							return dst;
+						}
+
+						default:
+							throw unsupported{};
+					}
+				}
+
+				std::uint16_t gen_call(const fn_call_expr *call){
+					std::vector<const type*> subs;
+					std::vector<std::uint16_t> arg_regs;
+					subs.reserve(call->args().size());
+					arg_regs.reserve(call->args().size());
+
+					for(auto &&arg : call->args()){
+						subs.push_back(arg->value_type());
+						arg_regs.push_back(gen(arg.get()));
+					}
+
+					if(arg_regs.size() > std::numeric_limits<std::uint8_t>::max())
+						throw unsupported{};
+
+					auto mangled = mangle_fn_name(call->fn()->name(), call->fn()->return_type(), subs);
+
+					auto res = std::find_if(begin(m_fn.callees), end(m_fn.callees), [&](auto &&callee){ return callee.mangled_name == mangled; });
+					auto idx = std::distance(begin(m_fn.callees), res);
+					if(res == end(m_fn.callees)){
+						if(m_fn.callees.size() == std::numeric_limits<std::uint16_t>::max())
+							throw unsupported{};
+
+						auto &&callee = m_fn.callees.emplace_back();
+						callee.mangled_name = std::move(mangled);
+						callee.sig = bc_signature(call->fn()->return_type(), subs);
+					}
+
+					// arguments are passed in consecutive registers
+					std::uint16_t first_arg = 0;
+					for(std::size_t i = 0; i < arg_regs.size(); i++){
+						auto reg = new_reg();
+						if(i == 0) first_arg = reg;
+						emit(bc_op::move, reg, arg_regs[i]);
+					}
+
+					auto dst = new_reg();
+					emit(bc_op::call, dst, static_cast<std::uint16_t>(idx), first_arg, static_cast<std::uint8_t>(arg_regs.size()));
+
+					// arguments are only borrowed by the callee, the result is ours
+					for(auto reg : arg_regs)
+						release(reg);
+
+					if(kind_of(call->fn()->return_type()).cls == value_class::tagged)
+						m_owned.insert(dst);
+
+					return dst;
+				}
+		};
+
+		bool is_full_def(const fn_def_expr *def){
+			if(!def->return_type()) return false;
+
+			return std::all_of(begin(def->params()), end(def->params()), [](auto &&param){ return param.second != nullptr; });
+		}
+	}
+
+	bc_native_sig bc_signature(const type *ret, const std::vector<const type*> &params){
+		using kind = bc_native_sig::kind;
+
+		auto class_of = [](const value_kind &val){
+			switch(val.cls){
+				case value_class::real: return (val.bits == 64) ? kind::doubles : kind::none;
+				case value_class::unit: return kind::none;
+				default: return kind::ints;
+			}
+		};
+
+		bc_native_sig ret_sig;
+
+		try{
+			for(auto &&param : params){
+				auto param_class = class_of(kind_of(param));
+				if((param_class == kind::none) || ((ret_sig.params != kind::none) && (ret_sig.params != param_class)))
+					return {};
+
+				ret_sig.params = param_class;
+			}
+
+			// arguments beyond the registers of either kind would go on the stack
+			if(params.size() > 6)
+				return {};
+
+			auto ret_kind = kind_of(ret);
+			if(ret_kind.cls != value_class::unit){
+				ret_sig.ret = class_of(ret_kind);
+				if(ret_sig.ret == kind::none)
+					return {};
+
+				if((ret_kind.is_fixed() || (ret_kind.cls == value_class::boolean)) && (ret_kind.bits < 64)){
+					ret_sig.ret_width = static_cast<std::uint8_t>(ret_kind.bits);
+					ret_sig.ret_signed = ret_kind.cls == value_class::fixed_signed;
+				}
+			}
+		}
+		catch(const unsupported&){
+			return {};
+		}
+
+		ret_sig.num_params = static_cast<std::uint8_t>(params.size());
+		ret_sig.supported = true;
+		return ret_sig;
+	}
+
+	std::unique_ptr<bc_module> bc_compile_module(std::string_view name, const std::vector<std::shared_ptr<const expr>> &ast){
+		auto ret = std::make_unique<bc_module>();
+		ret->name = name;
+		ret->ast = ast;
+
+		for(auto &&ptr : ast){
+			if(!ptr) continue;
+
+			if(auto def = dynamic_cast<const fn_def_expr*>(ptr.get())){
+				// imported bodies are only there to inline, and generic ones are never instantiated on their own
+				if((def->visibility() == fn_visibility::imported) || !is_full_def(def))
+					continue;
+
+				std::vector<const type*> param_tys;
+				param_tys.reserve(def->params().size());
+				for(auto &&param : def->params())
+					param_tys.push_back(param.second);
+
+				auto fn = std::make_unique<bc_function>();
+				fn->mangled_name = mangle_fn_name(def->name(), def->return_type(), param_tys, def->linkage());
+				fn->sig = bc_signature(def->return_type(), param_tys);
+				fn->exported = def->visibility() == fn_visibility::exported;
+				fn->owner = ret.get();
+
+				if(param_tys.size() > std::numeric_limits<std::uint8_t>::max())
+					fn->native_only = true;
+				else{
+					fn->num_params = static_cast<std::uint16_t>(param_tys.size());
+
+					try{
+						fn_generator(*fn).generate(def);
+					}
+					catch(const unsupported&){
+						fn->native_only = true;
+					}
+				}
+
+				if(fn->native_only){
+					fn->code.clear();
+					fn->consts.clear();
+					fn->strings.clear();
+					fn->callees.clear();
+				}
+
+				ret->fn_by_name.emplace(fn->mangled_name, fn.get());
+				ret->fns.push_back(std::move(fn));
+			}
+			else if(dynamic_cast<const fn_decl_expr*>(ptr.get()))
+				continue;
+			else if(dynamic_cast<const var_decl_expr*>(ptr.get()))
+				throw module_error{"variable declaration outside of function body"};
+			else if(dynamic_cast<const fn_call_expr*>(ptr.get()))
+				throw module_error{"function call expression outside of a function body"};
+			else if(dynamic_cast<const return_expr*>(ptr.get()))
+				throw module_error{"return expression outside of a function body"};
+		}
+
+		return ret;
+	}
+}
@@ -0,0 +1,137 @@
+#ifndef PURSON_LIB_BYTECODE_HPP
+#define PURSON_LIB_BYTECODE_HPP 1
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "purson/module.hpp"
+
+namespace purson{
+	/**
+	 * Register based bytecode, run by the interpreter in lib/interp.cpp.
+	 *
+	 * Every register is a 64 bit slot. Fixed width integers are kept sign or
+	 * zero extended from their width, booleans are 0 or 1, arbitrary
+	 * precision integers are the same tagged words jit code uses and reals
+	 * are doubles, rounded to float precision for 32 bit reals. Anything
+	 * else can't be interpreted and is left to the jit.
+	 *
+	 * Each instruction is a single 8 byte word, operands are registers
+	 * unless noted otherwise.
+	 **/
+	enum class bc_op: std::uint8_t{
+		load_k,        // a = consts[b]
+		move,          // a = b
+		add, sub, mul, // a = b op c, wrapping at 64 bits
+		sdiv, udiv,
+		fadd, fsub, fmul, fdiv,
+		scmp, ucmp, fcmp, // a = b cond c, the condition in width
+		sext, zext,    // a = b extended from its low width bits
+		sitof, uitof, ftosi, ftoui,
+		fround32,      // a = b rounded to float precision
+		int_add, int_sub, nat_sub, int_mul, int_div, // tagged words, through the runtime
+		int_cmp,
+		int_from_i64, int_from_u64, int_from_f64, int_from_str, // int_from_str: b indexes strings
+		int_to_i64, int_to_f64,
+		int_copy,      // a = a word with b's value the function owns
+		int_release,   // hand a back to the runtime if it's a boxed word
+		call,          // a = callees[b](c...)
+		ret,           // return a
+		ret_void,
+		count_
+	};
+
+	//! conditions of the compare instructions
+	enum class bc_cond: std::uint8_t{
+		eq, ne, lt, gt, le, ge
+	};
+
+	struct bc_instr{
+		bc_op op;
+		std::uint8_t width;
+		std::uint16_t a, b, c;
+	};
+
+	static_assert(sizeof(bc_instr) == 8);
+
+	//! how a function is called from native code
+	struct bc_native_sig{
+		enum class kind: std::uint8_t{
+			none,    // no parameters, or no result
+			ints,    // in integer registers
+			doubles  // in floating point registers
+		};
+
+		//! whether the interpreter can make the call, parameters must all be of one kind
+		bool supported = false;
+
+		kind params = kind::none;
+		kind ret = kind::none;
+		std::uint8_t num_params = 0;
+
+		//! integer results narrower than a word are extended from this width, 0 for a word
+		std::uint8_t ret_width = 0;
+		bool ret_signed = false;
+	};
+
+	struct bc_function;
+	struct bc_module;
+
+	//! function called by a call instruction, resolved on its first call
+	struct bc_callee{
+		std::string mangled_name;
+		bc_native_sig sig;
+
+		bc_function *fn = nullptr;
+		void *native = nullptr;
+	};
+
+	struct bc_function{
+		std::string mangled_name;
+		bc_native_sig sig;
+		bool exported;
+		bc_module *owner = nullptr;
+
+		//! set if the function uses something the bytecode can't express, so only the jit can run it
+		bool native_only = false;
+
+		std::uint16_t num_params = 0;
+		std::uint16_t num_regs = 0;
+
+		std::vector<bc_instr> code;
+		std::vector<std::uint64_t> consts;
+		std::vector<std::string> strings;
+		std::vector<bc_callee> callees;
+
+		// tiering state, see interp.cpp
+		std::uint64_t calls = 0;
+		void *native = nullptr;
+
+		//! code translated to handler addresses by the interpreter, on the first run
+		std::vector<const void*> handlers;
+	};
+
+	struct bc_module{
+		std::string name;
+		std::vector<std::shared_ptr<const expr>> ast;
+
+		std::vector<std::unique_ptr<bc_function>> fns;
+		std::map<std::string, bc_function*, std::less<>> fn_by_name;
+	};
+
+	//! @returns the calling convention of a function with these types, kind none if it isn't supported
+	bc_native_sig bc_signature(const type *ret, const std::vector<const type*> &params);
+
+	/**
+	 * Generate bytecode for every function defined in ast
+	 *
+	 * Functions the bytecode can't express are still added, as native only.
+	 *
+	 * @throws module_error if ast has code outside of a function that would need to run
+	 **/
+	std::unique_ptr<bc_module> bc_compile_module(std::string_view name, const std::vector<std::shared_ptr<const expr>> &ast);
+}
+
+#endif // !PURSON_LIB_BYTECODE_HPP
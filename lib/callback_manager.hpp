@@ -0,0 +1,109 @@
+#ifndef PURSON_LIB_CALLBACK_MANAGER_HPP
+#define PURSON_LIB_CALLBACK_MANAGER_HPP 1
+
+#include <mutex>
+
+#include <llvm/ADT/Triple.h>
+#include <llvm/ExecutionEngine/Orc/IndirectionUtils.h>
+#include <llvm/ExecutionEngine/Orc/OrcABISupport.h>
+#include <llvm/Support/Memory.h>
+#include <llvm/Support/Process.h>
+
+namespace purson{
+	/**
+	 * Compile callbacks that hold a lock while they run.
+	 *
+	 * Same as llvm::orc::LocalJITCompileCallbackManager, except the
+	 * trampolines re-enter the jit with the lock held. Any thread may call
+	 * a function that hasn't been compiled yet, and the callback manager
+	 * and layers behind it must only ever be used by one of them at once.
+	 * Threads running code that's already compiled never wait on it.
+	 *
+	 * Nothing is mapped until the first callback is asked for, so a jit
+	 * that never compiles lazily never pays for it.
+	 **/
+	template<typename Abi>
+	class llvm_locked_callback_manager: public llvm::orc::JITCompileCallbackManager{
+		public:
+			explicit llvm_locked_callback_manager(std::recursive_mutex &mut)
+				: llvm::orc::JITCompileCallbackManager(0), m_mut(mut){}
+
+		private:
+			std::recursive_mutex &m_mut;
+			llvm::sys::OwningMemoryBlock m_resolver;
+			std::vector<llvm::sys::OwningMemoryBlock> m_trampolines;
+
+			static llvm::JITTargetAddress reenter(void *self, void *trampoline){
+				auto mgr = static_cast<llvm_locked_callback_manager*>(self);
+
+				std::lock_guard lock(mgr->m_mut);
+				return mgr->executeCompileCallback(static_cast<llvm::JITTargetAddress>(reinterpret_cast<std::uintptr_t>(trampoline)));
+			}
+
+			std::error_code write_resolver(){
+				std::error_code ec;
+				m_resolver = llvm::sys::OwningMemoryBlock(llvm::sys::Memory::allocateMappedMemory(
+					Abi::ResolverCodeSize, nullptr, llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_WRITE, ec
+				));
+
+				if(ec) return ec;
+
+				Abi::writeResolverCode(static_cast<std::uint8_t*>(m_resolver.base()), &reenter, this);
+
+				return llvm::sys::Memory::protectMappedMemory(m_resolver.getMemoryBlock(), llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_EXEC);
+			}
+
+			llvm::Error grow() override{
+				// the trampolines all jump to it, so it's written along with the first of them
+				if(!m_resolver.base()){
+					if(auto ec = write_resolver()){
+						m_resolver = llvm::sys::OwningMemoryBlock();
+						return llvm::errorCodeToError(ec);
+					}
+				}
+
+				std::error_code ec;
+				auto block = llvm::sys::OwningMemoryBlock(llvm::sys::Memory::allocateMappedMemory(
+					llvm::sys::Process::getPageSize(), nullptr, llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_WRITE, ec
+				));
+
+				if(ec) return llvm::errorCodeToError(ec);
+
+				auto num_trampolines = (llvm::sys::Process::getPageSize() - Abi::PointerSize) / Abi::TrampolineSize;
+
+				auto mem = static_cast<std::uint8_t*>(block.base());
+				Abi::writeTrampolines(mem, m_resolver.base(), num_trampolines);
+
+				for(unsigned i = 0; i < num_trampolines; i++)
+					AvailableTrampolines.push_back(static_cast<llvm::JITTargetAddress>(reinterpret_cast<std::uintptr_t>(mem + (i * Abi::TrampolineSize))));
+
+				if(auto ec = llvm::sys::Memory::protectMappedMemory(block.getMemoryBlock(), llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_EXEC))
+					return llvm::errorCodeToError(ec);
+
+				m_trampolines.push_back(std::move(block));
+				return llvm::Error::success();
+			}
+	};
+
+	//! @returns a compile callback manager for code running in this process, or null if the target isn't supported
+	inline std::unique_ptr<llvm::orc::JITCompileCallbackManager> llvm_make_locked_callback_manager(const llvm::Triple &triple, std::recursive_mutex &mut){
+		switch(triple.getArch()){
+			case llvm::Triple::aarch64:
+				return std::make_unique<llvm_locked_callback_manager<llvm::orc::OrcAArch64>>(mut);
+
+			case llvm::Triple::x86:
+				return std::make_unique<llvm_locked_callback_manager<llvm::orc::OrcI386>>(mut);
+
+			case llvm::Triple::x86_64:
+				if(triple.getOS() == llvm::Triple::Win32)
+					return std::make_unique<llvm_locked_callback_manager<llvm::orc::OrcX86_64_Win32>>(mut);
+
+				return std::make_unique<llvm_locked_callback_manager<llvm::orc::OrcX86_64_SysV>>(mut);
+
+			default:
+				return nullptr;
+		}
+	}
+}
+
+#endif // !PURSON_LIB_CALLBACK_MANAGER_HPP
@@ -0,0 +1,180 @@
+#include <exception>
+#include <future>
+
+#include "fmt/core.h"
+
+#include <llvm/ExecutionEngine/Orc/LambdaResolver.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/IR/Mangler.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "runtime/runtime.hpp"
+#include "code_cache.hpp"
+#include "parallel.hpp"
+#include "thread_pool.hpp"
+
+namespace purson{
+	llvm::JITSymbol llvm_process_symbol(const std::string &name, const llvm::DataLayout &dl){
+		std::string_view unprefixed = name;
+		if(dl.getGlobalPrefix() && !unprefixed.empty() && (unprefixed[0] == dl.getGlobalPrefix()))
+			unprefixed.remove_prefix(1);
+
+		if(auto runtimeAddr = runtime_symbol(unprefixed))
+			return llvm::JITSymbol(runtimeAddr, llvm::JITSymbolFlags::Exported);
+		else if(auto symAddr = llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name))
+			return llvm::JITSymbol(symAddr, llvm::JITSymbolFlags::Exported);
+
+		return nullptr;
+	}
+
+	llvm_code_cache::llvm_code_cache(target t, opt_level opt, llvm_target_desc desc)
+		: m_t(t), m_opt(opt), m_desc(std::move(desc)),
+		  m_tm(llvm_make_target_machine(m_desc, llvm_codegen_opt_level(opt))),
+		  m_dl(m_tm->createDataLayout()),
+		  m_obj_cache(llvm_object_cache::target_salt(*m_tm, opt)),
+		  m_pool(std::make_shared<llvm_code_pool>()),
+		  m_layer([pool = m_pool]() -> std::shared_ptr<llvm::RuntimeDyld::MemoryManager>{
+			  if(pool->usable())
+				  return std::make_shared<llvm_pooled_memory_manager>(pool);
+
+			  return std::make_shared<llvm::SectionMemoryManager>();
+		  }){
+		llvm_init_jit();
+	}
+
+	llvm_code_cache::~llvm_code_cache(){
+		for(auto &&obj : m_objs)
+			cantFail(m_layer.removeObject(obj));
+	}
+
+	void llvm_code_cache::add_modules(const std::vector<jit_moduleset::module_source> &srcs){
+		std::vector<llvm_compiled_module> compiled;
+		compiled.reserve(srcs.size());
+
+		{
+			// only needed while adding, isolates never compile anything here
+			thread_pool pool;
+			auto max_splits = std::max<std::size_t>(1, pool.num_threads() / std::max<std::size_t>(srcs.size(), 1));
+
+			std::vector<std::future<llvm_compiled_module>> jobs;
+			jobs.reserve(srcs.size());
+			for(auto &&src : srcs){
+				jobs.push_back(pool.submit([this, &src, max_splits]{
+					return llvm_compile_module_objects(src.first, src.second, m_desc, m_opt, &m_obj_cache, max_splits);
+				}));
+			}
+
+			std::exception_ptr err;
+			for(auto &&job : jobs){
+				try{
+					compiled.push_back(job.get());
+				}
+				catch(...){
+					if(!err) err = std::current_exception();
+				}
+			}
+
+			if(err) std::rethrow_exception(err);
+		}
+
+		std::lock_guard lock(m_link_mut);
+
+		std::vector<std::pair<object_handle_t, std::vector<std::string>>> added;
+
+		for(std::size_t i = 0; i < srcs.size(); i++){
+			for(auto &&obj : compiled[i].objs){
+				std::vector<std::string> names;
+				for(auto &&sym : obj->getBinary()->symbols()){
+					auto flags = sym.getFlags();
+					if(!(flags & llvm::object::SymbolRef::SF_Global) || (flags & llvm::object::SymbolRef::SF_Undefined))
+						continue;
+
+					auto name = sym.getName();
+					if(!name){
+						llvm::consumeError(name.takeError());
+						continue;
+					}
+
+					names.push_back(name->str());
+				}
+
+				auto handle = m_layer.addObject(std::move(obj), make_resolver());
+				if(!handle){
+					llvm::consumeError(handle.takeError());
+					throw module_error{fmt::format("failed to add shared objects for module '{}'", srcs[i].first)};
+				}
+
+				m_objs.push_back(*handle);
+				added.emplace_back(*handle, std::move(names));
+			}
+		}
+
+		// looking up the symbols links the objects, so everything's resolved before any isolate can see it
+		std::unordered_map<std::string, llvm::JITTargetAddress> found;
+
+		for(auto &&obj : added){
+			for(auto &&name : obj.second){
+				auto sym = m_layer.findSymbolIn(obj.first, name, false);
+				if(!sym){
+					if(auto err = sym.takeError()){
+						llvm::consumeError(std::move(err));
+						throw module_error{fmt::format("failed to link shared symbol '{}'", name)};
+					}
+
+					continue;
+				}
+
+				auto addr = sym.getAddress();
+				if(!addr){
+					llvm::consumeError(addr.takeError());
+					throw module_error{fmt::format("failed to link shared symbol '{}'", name)};
+				}
+
+				found.emplace(name, *addr);
+			}
+		}
+
+		// the first definition of a name wins, same as between the modules of a moduleset
+		std::unique_lock syms_lock(m_syms_mut);
+		for(auto &&sym : found)
+			m_syms.emplace(sym.first, sym.second);
+	}
+
+	void *llvm_code_cache::get_fn_ptr(std::string_view mangled_name) const{
+		return reinterpret_cast<void*>(find(mangle(mangled_name)));
+	}
+
+	void llvm_code_cache::set_cache_dir(std::string_view dir, std::size_t max_bytes){
+		m_obj_cache.set_dir(dir, max_bytes);
+	}
+
+	llvm::JITTargetAddress llvm_code_cache::find(const std::string &linker_name) const{
+		std::shared_lock lock(m_syms_mut);
+		auto res = m_syms.find(linker_name);
+		return (res != end(m_syms)) ? res->second : 0;
+	}
+
+	std::string llvm_code_cache::mangle(std::string_view name) const{
+		std::string ret;
+		llvm::raw_string_ostream str(ret);
+		llvm::Mangler::getNameWithPrefix(str, llvm::StringRef(name.data(), name.size()), m_dl);
+		return str.str();
+	}
+
+	std::shared_ptr<llvm::JITSymbolResolver> llvm_code_cache::make_resolver(){
+		// only called while linking, with m_link_mut held
+		return llvm::orc::createLambdaResolver(
+			[this](const std::string &name) -> llvm::JITSymbol{
+				for(auto &&obj : m_objs){
+					if(auto sym = m_layer.findSymbolIn(obj, name, false))
+						return sym;
+				}
+
+				return nullptr;
+			},
+			[this](const std::string &name) -> llvm::JITSymbol{
+				return llvm_process_symbol(name, m_dl);
+			}
+		);
+	}
+}
@@ -0,0 +1,76 @@
+#ifndef PURSON_LIB_CODE_CACHE_HPP
+#define PURSON_LIB_CODE_CACHE_HPP 1
+
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+
+#include "purson/module.hpp"
+
+#include "code_memory.hpp"
+#include "object_cache.hpp"
+
+namespace purson{
+	/**
+	 * Resolve a symbol outside of any jit, from the runtime or the process
+	 *
+	 * @param[in] name linker name of the symbol, with the global prefix of dl
+	 * @param[in] dl data layout of the code referencing the symbol
+	 * @returns the symbol or null if there is none
+	 **/
+	llvm::JITSymbol llvm_process_symbol(const std::string &name, const llvm::DataLayout &dl);
+
+	/**
+	 * Code compiled once and called by every isolate made from it.
+	 *
+	 * Modules are compiled on a temporary pool of threads and linked
+	 * straight away in to pooled code memory, so none of it is ever
+	 * compiled lazily or patched. The address of every global symbol is
+	 * recorded once linked and then only read, by any number of isolates.
+	 **/
+	class llvm_code_cache: public jit_code_cache{
+		public:
+			llvm_code_cache(target t, opt_level opt, llvm_target_desc desc);
+			~llvm_code_cache();
+
+			void add_modules(const std::vector<jit_moduleset::module_source> &srcs) override;
+
+			void *get_fn_ptr(std::string_view mangled_name) const override;
+
+			void set_cache_dir(std::string_view dir, std::size_t max_bytes) override;
+
+			//! @returns the address of a shared symbol by its linker name, or 0 if there is none
+			llvm::JITTargetAddress find(const std::string &linker_name) const;
+
+			target get_target() const noexcept{ return m_t; }
+			opt_level get_opt() const noexcept{ return m_opt; }
+			const llvm_target_desc &desc() const noexcept{ return m_desc; }
+
+		private:
+			target m_t;
+			opt_level m_opt;
+			llvm_target_desc m_desc;
+
+			std::unique_ptr<llvm::TargetMachine> m_tm;
+			const llvm::DataLayout m_dl;
+			llvm_object_cache m_obj_cache;
+			std::shared_ptr<llvm_code_pool> m_pool;
+
+			// held while linking, resolving may link other objects of the same batch
+			std::mutex m_link_mut;
+			llvm::orc::RTDyldObjectLinkingLayer m_layer;
+
+			using object_handle_t = llvm::orc::RTDyldObjectLinkingLayer::ObjHandleT;
+			std::vector<object_handle_t> m_objs;
+
+			mutable std::shared_mutex m_syms_mut;
+			std::unordered_map<std::string, llvm::JITTargetAddress> m_syms;
+
+			std::string mangle(std::string_view name) const;
+			std::shared_ptr<llvm::JITSymbolResolver> make_resolver();
+	};
+}
+
+#endif // !PURSON_LIB_CODE_CACHE_HPP
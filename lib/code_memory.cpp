@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <iterator>
+
+#include <llvm/ExecutionEngine/RuntimeDyld.h>
+#include <llvm/Support/Memory.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "code_memory.hpp"
+
+namespace purson{
+	namespace{
+		constexpr std::size_t min_align = 16;
+
+		std::size_t align_up(std::size_t val, std::size_t align){
+			return (val + align - 1) & ~(align - 1);
+		}
+	}
+
+	llvm_code_pool::llvm_code_pool(bool huge_pages)
+		: m_huge_pages(huge_pages), m_usable(false)
+	{
+		// reserved up front so the common case never has to map anything
+		m_usable = map_region(region_size, true) && map_region(region_size, false);
+	}
+
+	llvm_code_pool::~llvm_code_pool(){
+		for(auto &&reg : m_regions)
+			unmap_region(*reg);
+	}
+
+	llvm_code_pool::block llvm_code_pool::allocate(std::size_t size, std::size_t align, bool code){
+		align = std::max(align, min_align);
+		size = align_up(std::max<std::size_t>(size, 1), min_align);
+
+		std::lock_guard lock(m_mut);
+
+		auto try_region = [&](region &reg) -> block{
+			for(auto it = begin(reg.free); it != end(reg.free); ++it){
+				auto [offset, len] = *it;
+				auto start = align_up(offset, align);
+				if((start + size) > (offset + len))
+					continue;
+
+				reg.free.erase(it);
+				if(start > offset)
+					reg.free.emplace(offset, start - offset);
+
+				if((start + size) < (offset + len))
+					reg.free.emplace(start + size, (offset + len) - (start + size));
+
+				return {reg.local + start, reg.load + start, size};
+			}
+
+			return {nullptr, nullptr, 0};
+		};
+
+		// first fit keeps small sections of different objects packed together
+		for(auto &&reg : m_regions){
+			if(reg->code != code) continue;
+
+			auto blk = try_region(*reg);
+			if(blk.local) return blk;
+		}
+
+		auto reg = map_region(std::max(region_size, align_up(size + align, huge_page_size)), code);
+		if(!reg)
+			return {nullptr, nullptr, 0};
+
+		return try_region(*reg);
+	}
+
+	void llvm_code_pool::release(const block &blk){
+		if(!blk.local) return;
+
+		std::lock_guard lock(m_mut);
+
+		auto res = std::find_if(begin(m_regions), end(m_regions), [&](auto &&reg){
+			return (blk.local >= reg->local) && (blk.local < (reg->local + reg->size));
+		});
+
+		if(res == end(m_regions))
+			return;
+
+		auto &&reg = **res;
+		auto offset = static_cast<std::size_t>(blk.local - reg.local);
+		auto len = blk.size;
+
+		auto next = reg.free.lower_bound(offset);
+		if((next != end(reg.free)) && (next->first == (offset + len))){
+			len += next->second;
+			next = reg.free.erase(next);
+		}
+
+		if(next != begin(reg.free)){
+			auto prev = std::prev(next);
+			if((prev->first + prev->second) == offset){
+				prev->second += len;
+				offset = prev->first;
+				len = prev->second;
+			}
+			else
+				reg.free.emplace(offset, len);
+		}
+		else
+			reg.free.emplace(offset, len);
+
+		if(len != reg.size)
+			return;
+
+		// keep a region of each kind around for the next module
+		auto same_kind = std::count_if(begin(m_regions), end(m_regions), [&](auto &&other){ return other->code == reg.code; });
+		if(same_kind > 1){
+			unmap_region(reg);
+			m_regions.erase(res);
+		}
+	}
+
+#ifdef __linux__
+	llvm_code_pool::region *llvm_code_pool::map_region(std::size_t size, bool code){
+		std::uint8_t *local = nullptr, *load = nullptr;
+
+		if(code){
+			int fd = -1;
+			bool hugetlb = false;
+
+			// huge pages have to be reserved up front, fall back to normal pages when there are none
+			if(m_huge_pages){
+				fd = memfd_create("purson-jit", MFD_CLOEXEC | MFD_HUGETLB);
+				hugetlb = fd >= 0;
+			}
+
+			for(int attempt = 0; attempt < 2; attempt++){
+				if(fd < 0)
+					fd = memfd_create("purson-jit", MFD_CLOEXEC);
+
+				if(fd < 0) return nullptr;
+
+				if(ftruncate(fd, size) == 0){
+					auto rw = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+					auto rx = (rw != MAP_FAILED) ? mmap(nullptr, size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0) : MAP_FAILED;
+
+					if(rx != MAP_FAILED){
+						local = static_cast<std::uint8_t*>(rw);
+						load = static_cast<std::uint8_t*>(rx);
+					}
+					else if(rw != MAP_FAILED)
+						munmap(rw, size);
+				}
+
+				// the mappings keep the memory alive
+				close(fd);
+				fd = -1;
+
+				if(local || !hugetlb) break;
+				hugetlb = false;
+			}
+
+			if(!local) return nullptr;
+
+			if(m_huge_pages && !hugetlb)
+				madvise(load, size, MADV_HUGEPAGE);
+		}
+		else{
+			void *mem = MAP_FAILED;
+			if(m_huge_pages)
+				mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+			if(mem == MAP_FAILED){
+				mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if(mem == MAP_FAILED) return nullptr;
+
+				if(m_huge_pages)
+					madvise(mem, size, MADV_HUGEPAGE);
+			}
+
+			local = load = static_cast<std::uint8_t*>(mem);
+		}
+
+		auto &&reg = m_regions.emplace_back(std::make_unique<region>());
+		reg->local = local;
+		reg->load = load;
+		reg->size = size;
+		reg->code = code;
+		reg->free.emplace(0, size);
+		return reg.get();
+	}
+
+	void llvm_code_pool::unmap_region(const region &reg){
+		munmap(reg.local, reg.size);
+		if(reg.load != reg.local)
+			munmap(reg.load, reg.size);
+	}
+#else
+	llvm_code_pool::region *llvm_code_pool::map_region(std::size_t, bool){ return nullptr; }
+	void llvm_code_pool::unmap_region(const region&){}
+#endif
+
+	llvm_pooled_memory_manager::~llvm_pooled_memory_manager(){
+		for(auto &&blk : m_code) m_pool->release(blk);
+		for(auto &&blk : m_data) m_pool->release(blk);
+	}
+
+	std::uint8_t *llvm_pooled_memory_manager::allocateCodeSection(
+		std::uintptr_t size, unsigned align, unsigned, llvm::StringRef
+	){
+		auto blk = m_pool->allocate(size, align, true);
+		if(blk.local) m_code.push_back(blk);
+		return blk.local;
+	}
+
+	std::uint8_t *llvm_pooled_memory_manager::allocateDataSection(
+		std::uintptr_t size, unsigned align, unsigned, llvm::StringRef, bool
+	){
+		// read only data stays writable too, the linker writes its relocations after allocation
+		auto blk = m_pool->allocate(size, align, false);
+		if(blk.local) m_data.push_back(blk);
+		return blk.local;
+	}
+
+	void llvm_pooled_memory_manager::notifyObjectLoaded(llvm::RuntimeDyld &dyld, const llvm::object::ObjectFile&){
+		// relocations are resolved against where the code runs, not where it's written
+		for(auto &&blk : m_code)
+			dyld.mapSectionAddress(blk.local, reinterpret_cast<std::uintptr_t>(blk.load));
+	}
+
+	bool llvm_pooled_memory_manager::finalizeMemory(std::string*){
+		for(auto &&blk : m_code)
+			llvm::sys::Memory::InvalidateInstructionCache(blk.load, blk.size);
+
+		return false;
+	}
+}
@@ -0,0 +1,102 @@
+#ifndef PURSON_LIB_CODE_MEMORY_HPP
+#define PURSON_LIB_CODE_MEMORY_HPP 1
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <llvm/ExecutionEngine/RTDyldMemoryManager.h>
+
+namespace purson{
+	/**
+	 * Large pre-reserved regions that jit sections are carved out of.
+	 *
+	 * Code regions are mapped twice, once writable for the linker and once
+	 * executable for running it, so code from different objects can share
+	 * pages without ever changing their protection. Regions are backed by
+	 * 2MB huge pages when the system has them to spare, otherwise
+	 * transparent huge pages are asked for. Freed sections go back to a
+	 * free list and are coalesced with their neighbours; regions beyond the
+	 * first of each kind are unmapped once nothing in them is left.
+	 **/
+	class llvm_code_pool{
+		public:
+			static constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+
+			//! size of each reserved region, bigger sections get a region of their own
+			static constexpr std::size_t region_size = 4 * huge_page_size;
+
+			struct block{
+				//! where the linker writes the section
+				std::uint8_t *local;
+
+				//! where the section is run or read from
+				std::uint8_t *load;
+
+				std::size_t size;
+			};
+
+			explicit llvm_code_pool(bool huge_pages = true);
+			~llvm_code_pool();
+
+			//! @returns whether code can be dual mapped on this system
+			bool usable() const noexcept{ return m_usable; }
+
+			//! @returns a block of at least size bytes, or a block with null addresses if out of memory
+			block allocate(std::size_t size, std::size_t align, bool code);
+
+			void release(const block &blk);
+
+		private:
+			struct region{
+				std::uint8_t *local;
+				std::uint8_t *load;
+				std::size_t size;
+				bool code;
+
+				// offset to size of every free range
+				std::map<std::size_t, std::size_t> free;
+			};
+
+			bool m_huge_pages;
+			bool m_usable;
+
+			std::mutex m_mut;
+			std::vector<std::unique_ptr<region>> m_regions;
+
+			region *map_region(std::size_t size, bool code);
+			void unmap_region(const region &reg);
+	};
+
+	/**
+	 * Memory manager for a single object, allocating its sections from a shared pool.
+	 *
+	 * Everything allocated is released back to the pool with the manager,
+	 * which happens when the object is removed from the jit.
+	 **/
+	class llvm_pooled_memory_manager: public llvm::RTDyldMemoryManager{
+		public:
+			explicit llvm_pooled_memory_manager(std::shared_ptr<llvm_code_pool> pool): m_pool(std::move(pool)){}
+			~llvm_pooled_memory_manager();
+
+			std::uint8_t *allocateCodeSection(
+				std::uintptr_t size, unsigned align, unsigned section_id, llvm::StringRef section_name
+			) override;
+
+			std::uint8_t *allocateDataSection(
+				std::uintptr_t size, unsigned align, unsigned section_id, llvm::StringRef section_name, bool read_only
+			) override;
+
+			void notifyObjectLoaded(llvm::RuntimeDyld &dyld, const llvm::object::ObjectFile &obj) override;
+
+			bool finalizeMemory(std::string *err_msg = nullptr) override;
+
+		private:
+			std::shared_ptr<llvm_code_pool> m_pool;
+			std::vector<llvm_code_pool::block> m_code;
+			std::vector<llvm_code_pool::block> m_data;
+	};
+}
+
+#endif // !PURSON_LIB_CODE_MEMORY_HPP
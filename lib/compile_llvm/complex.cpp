@@ -0,0 +1,110 @@
+#include <llvm/IR/Intrinsics.h>
+
+#include "../llvm.hpp"
+
+/**
+ * Complex numbers are a <2 x float> or <2 x double> holding the real part in
+ * lane 0 and the imaginary part in lane 1. Multiplication and division are
+ * built from lane broadcasts and swaps feeding a single vector fma, which
+ * keeps both components in one register the whole way through.
+ **/
+
+namespace purson{
+	namespace{
+		llvm::Value *shuffle(llvm::IRBuilder<> &builder, llvm::Value *vec, std::uint32_t lane0, std::uint32_t lane1){
+			return builder.CreateShuffleVector(vec, llvm::UndefValue::get(vec->getType()), {lane0, lane1});
+		}
+
+		llvm::Constant *lanes(llvm::Type *vec_ty, double lane0, double lane1){
+			auto elem_ty = vec_ty->getVectorElementType();
+			return llvm::ConstantVector::get({llvm::ConstantFP::get(elem_ty, lane0), llvm::ConstantFP::get(elem_ty, lane1)});
+		}
+
+		llvm::Value *intrinsic(llvm::IRBuilder<> &builder, llvm::Intrinsic::ID id, const std::vector<llvm::Value*> &args){
+			auto fn = llvm::Intrinsic::getDeclaration(builder.GetInsertBlock()->getModule(), id, {args[0]->getType()});
+			return builder.CreateCall(fn, args);
+		}
+
+		llvm::Value *fma(llvm::IRBuilder<> &builder, llvm::Value *a, llvm::Value *b, llvm::Value *c){
+			return intrinsic(builder, llvm::Intrinsic::fma, {a, b, c});
+		}
+
+		// [a, b] * [c, d] = [a, a] * [c, d] + [-b, b] * [d, c]
+		llvm::Value *complex_mul(llvm::IRBuilder<> &builder, llvm::Value *lhs, llvm::Value *rhs){
+			auto vec_ty = lhs->getType();
+			auto re = shuffle(builder, lhs, 0, 0);
+			auto im = builder.CreateFMul(shuffle(builder, lhs, 1, 1), lanes(vec_ty, -1.0, 1.0));
+			auto cross = builder.CreateFMul(im, shuffle(builder, rhs, 1, 0));
+			return fma(builder, re, rhs, cross);
+		}
+
+		// ([a, b] * [c', -d']) / (c'^2 + d'^2) / m, where [c', d'] = [c, d] / m and m = max(|c|, |d|)
+		llvm::Value *complex_div(llvm::IRBuilder<> &builder, llvm::Value *lhs, llvm::Value *rhs){
+			auto vec_ty = rhs->getType();
+
+			// like smith's method, scaling keeps the squares between 1 and 2 instead of overflowing or underflowing
+			auto mag = intrinsic(builder, llvm::Intrinsic::fabs, {rhs});
+			auto scale = intrinsic(builder, llvm::Intrinsic::maxnum, {mag, shuffle(builder, mag, 1, 0)});
+			auto scaled = builder.CreateFDiv(rhs, scale);
+
+			auto conj = builder.CreateFMul(scaled, lanes(vec_ty, 1.0, -1.0));
+			auto num = complex_mul(builder, lhs, conj);
+
+			auto sq = builder.CreateFMul(scaled, scaled);
+			auto norm = builder.CreateFAdd(sq, shuffle(builder, sq, 1, 0));
+			return builder.CreateFDiv(builder.CreateFDiv(num, norm), scale);
+		}
+
+		llvm::Value *both_lanes(llvm::IRBuilder<> &builder, llvm::Value *mask, bool all){
+			auto lane0 = builder.CreateExtractElement(mask, std::uint64_t(0));
+			auto lane1 = builder.CreateExtractElement(mask, std::uint64_t(1));
+			return all ? builder.CreateAnd(lane0, lane1) : builder.CreateOr(lane0, lane1);
+		}
+	}
+
+	llvm::Value *llvm_compile_complex_op(operator_type op_ty, const complex_type *ty, llvm::Value *lhs, llvm::Value *rhs, llvm_state *state){
+		auto builder = state->builder();
+
+		switch(op_ty){
+			case operator_type::add: return builder->CreateFAdd(lhs, rhs);
+			case operator_type::sub: return builder->CreateFSub(lhs, rhs);
+			case operator_type::mul: return complex_mul(*builder, lhs, rhs);
+			case operator_type::div: return complex_div(*builder, lhs, rhs);
+			case operator_type::equ: return both_lanes(*builder, builder->CreateFCmpOEQ(lhs, rhs), true);
+			case operator_type::neq: return both_lanes(*builder, builder->CreateFCmpONE(lhs, rhs), false);
+
+			case operator_type::lt:
+			case operator_type::gt:
+			case operator_type::lte:
+			case operator_type::gte:
+				throw module_error{fmt::format("complex type '{}' is not ordered", ty->str())};
+
+			default:
+				throw module_error{"unsupported binary operator for complex"};
+		}
+	}
+
+	llvm::Value *llvm_compile_complex_cast(llvm::Value *val, const type *from, const type *to, llvm_state *state){
+		auto builder = state->builder();
+
+		auto to_complex = dynamic_cast<const complex_type*>(to);
+		if(!to_complex || (numeric_category_of(to) != numeric_category::complex))
+			throw module_error{fmt::format("can not cast from '{}' to '{}'", from->str(), to->str())};
+
+		auto vec_ty = llvm_type(to_complex);
+
+		if(numeric_category_of(from) == numeric_category::complex)
+			return builder->CreateFPCast(val, vec_ty);
+
+		// anything else becomes the real part
+		auto re = llvm_compile_cast(val, from, to_complex->component_type(), state);
+		return builder->CreateInsertElement(llvm::Constant::getNullValue(vec_ty), re, std::uint64_t(0));
+	}
+
+	llvm::Constant *llvm_compile_imaginary_literal(const imaginary_literal_expr *lit){
+		auto component_ty = lit->value_type()->component_type();
+		auto re = llvm::ConstantFP::get(llvm_type(component_ty), 0.0);
+		auto im = llvm_real_constant(lit->value(), component_ty);
+		return llvm::ConstantVector::get({re, im});
+	}
+}
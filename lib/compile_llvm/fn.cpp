@@ -221,8 +221,10 @@ namespace purson{
 					else
 						throw module_error{fmt::format("unexpected return expression '{}'", def->body()->str())};
 
-					if(dynamic_cast<const unit_type*>(def->return_type()))
+					if(dynamic_cast<const unit_type*>(def->return_type())){
+						llvm_compile_scope_release(&fn_state);
 						builder.CreateRetVoid();
+					}
 
 					state->set_mangled_fn(mangled_name, fn);
 
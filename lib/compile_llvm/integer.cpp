@@ -0,0 +1,336 @@
+#include <functional>
+
+#include <llvm/IR/Intrinsics.h>
+
+#include "../llvm.hpp"
+
+/**
+ * Arbitrary precision integers and naturals are a single tagged i64 word.
+ * Words with the low bit set hold a 63 bit value inline as (value << 1) | 1,
+ * any other word is a pointer to a GMP backed value owned by lib/runtime.
+ * Operations on two inline values are done natively with overflow checks and
+ * only call into the runtime when an operand is boxed or the result overflows.
+ * Words follow the same ownership rules as arbitrary precision reals:
+ * operations consume the words made by nested operations, literals, casts
+ * and calls, variables own their word until the scope is left, and
+ * returned words are owned by the caller.
+ **/
+
+namespace purson{
+	namespace{
+		using fast_emit_fn_t = std::function<std::pair<llvm::Value*, llvm::Value*>(llvm::IRBuilder<>&)>;
+		using slow_emit_fn_t = std::function<llvm::Value*(llvm::IRBuilder<>&)>;
+
+		constexpr std::int64_t small_min = -(std::int64_t(1) << 62);
+		constexpr std::int64_t small_max = (std::int64_t(1) << 62) - 1;
+
+		llvm::Value *is_small(llvm::IRBuilder<> &builder, llvm::Value *word){
+			return builder.CreateICmpNE(builder.CreateAnd(word, std::uint64_t(1)), builder.getInt64(0));
+		}
+
+		llvm::Value *untag(llvm::IRBuilder<> &builder, llvm::Value *word){ return builder.CreateAShr(word, 1); }
+		llvm::Value *strip_tag(llvm::IRBuilder<> &builder, llvm::Value *word){ return builder.CreateXor(word, std::uint64_t(1)); }
+		llvm::Value *set_tag(llvm::IRBuilder<> &builder, llvm::Value *val){ return builder.CreateOr(val, std::uint64_t(1)); }
+
+		std::pair<llvm::Value*, llvm::Value*> checked(llvm::IRBuilder<> &builder, llvm::Intrinsic::ID id, llvm::Value *lhs, llvm::Value *rhs){
+			auto fn = llvm::Intrinsic::getDeclaration(builder.GetInsertBlock()->getModule(), id, {lhs->getType()});
+			auto res = builder.CreateCall(fn, {lhs, rhs});
+			return {builder.CreateExtractValue(res, 0), builder.CreateExtractValue(res, 1)};
+		}
+
+		/**
+		 * Branch to fast when cond holds and to slow otherwise. fast returns
+		 * its result and an overflow flag, or nullptr if it can't overflow,
+		 * in which case slow is taken instead.
+		 **/
+		llvm::Value *emit_fast_path(llvm_state *state, llvm::Value *cond, llvm::Type *res_ty, const fast_emit_fn_t &fast, const slow_emit_fn_t &slow){
+			auto builder = state->builder();
+			auto fn = builder->GetInsertBlock()->getParent();
+			auto fast_bb = llvm::BasicBlock::Create(llvm_ctx, "int.fast", fn);
+			auto slow_bb = llvm::BasicBlock::Create(llvm_ctx, "int.slow", fn);
+			auto cont_bb = llvm::BasicBlock::Create(llvm_ctx, "int.cont", fn);
+
+			builder->CreateCondBr(cond, fast_bb, slow_bb);
+
+			builder->SetInsertPoint(fast_bb);
+			auto fast_res = fast(*builder);
+			auto fast_end = builder->GetInsertBlock();
+			if(fast_res.second)
+				builder->CreateCondBr(fast_res.second, slow_bb, cont_bb);
+			else
+				builder->CreateBr(cont_bb);
+
+			builder->SetInsertPoint(slow_bb);
+			auto slow_res = slow(*builder);
+			auto slow_end = builder->GetInsertBlock();
+			builder->CreateBr(cont_bb);
+
+			builder->SetInsertPoint(cont_bb);
+			auto res = builder->CreatePHI(res_ty, 2);
+			res->addIncoming(fast_res.first, fast_end);
+			res->addIncoming(slow_res, slow_end);
+			return res;
+		}
+
+		llvm::Value *box_word(llvm_state *state, llvm::Value *raw, bool is_signed, std::size_t src_bits){
+			auto builder = state->builder();
+
+			// anything narrower than the inline payload always fits
+			if(src_bits < 63)
+				return set_tag(*builder, builder->CreateShl(raw, 1));
+
+			if(is_signed){
+				auto doubled = checked(*builder, llvm::Intrinsic::sadd_with_overflow, raw, raw);
+				return emit_fast_path(
+					state, builder->CreateNot(doubled.second), raw->getType(),
+					[&](llvm::IRBuilder<> &b){ return std::make_pair(set_tag(b, doubled.first), (llvm::Value*)nullptr); },
+					[&](llvm::IRBuilder<> &b){ return llvm_call_runtime(b, "purson_int_from_i64", raw->getType(), {raw}); }
+				);
+			}
+			else{
+				auto fits = builder->CreateICmpULE(raw, builder->getInt64(small_max));
+				return emit_fast_path(
+					state, fits, raw->getType(),
+					[&](llvm::IRBuilder<> &b){ return std::make_pair(set_tag(b, b.CreateShl(raw, 1)), (llvm::Value*)nullptr); },
+					[&](llvm::IRBuilder<> &b){ return llvm_call_runtime(b, "purson_int_from_u64", raw->getType(), {raw}); }
+				);
+			}
+		}
+
+		llvm::Value *unbox_word(llvm_state *state, llvm::Value *word){
+			return emit_fast_path(
+				state, is_small(*state->builder(), word), word->getType(),
+				[&](llvm::IRBuilder<> &b){ return std::make_pair(untag(b, word), (llvm::Value*)nullptr); },
+				[&](llvm::IRBuilder<> &b){ return llvm_call_runtime(b, "purson_int_to_i64", word->getType(), {word}); }
+			);
+		}
+
+		// operand converted to a word, and whether it is a temporary owned by the caller
+		std::pair<llvm::Value*, bool> compile_operand(const rvalue_expr *expr, const type *ty, llvm_state *state){
+			auto expr_ty = expr->value_type();
+			auto val = llvm_compile_rvalue(expr, state);
+
+			// variables may still be referenced elsewhere
+			if(is_tagged_integer(expr_ty))
+				return {val, llvm_is_temporary(expr)};
+
+			// anything else is boxed in to a new word
+			auto converted = llvm_compile_cast(val, expr_ty, ty, state);
+			if(is_big_real(expr_ty) && llvm_is_temporary(expr))
+				llvm_compile_big_real_release(val, state);
+
+			return {converted, true};
+		}
+
+		std::optional<llvm::CmpInst::Predicate> compare_predicate(operator_type op_ty){
+			switch(op_ty){
+				case operator_type::equ: return llvm::CmpInst::ICMP_EQ;
+				case operator_type::neq: return llvm::CmpInst::ICMP_NE;
+				case operator_type::lt: return llvm::CmpInst::ICMP_SLT;
+				case operator_type::gt: return llvm::CmpInst::ICMP_SGT;
+				case operator_type::lte: return llvm::CmpInst::ICMP_SLE;
+				case operator_type::gte: return llvm::CmpInst::ICMP_SGE;
+				default: return std::nullopt;
+			}
+		}
+	}
+
+	llvm::Value *llvm_compile_tagged_integer_op(operator_type op_ty, const natural_type *ty, llvm::Value *lhs, llvm::Value *rhs, llvm_state *state){
+		auto builder = state->builder();
+		auto word_ty = builder->getInt64Ty();
+		auto both_small = is_small(*builder, builder->CreateAnd(lhs, rhs));
+		bool is_natural = numeric_category_of(ty) == numeric_category::natural;
+
+		auto slow_op = [&](const std::string &name) -> slow_emit_fn_t{
+			return [&, name](llvm::IRBuilder<> &b){ return llvm_call_runtime(b, name, word_ty, {lhs, rhs}); };
+		};
+
+		if(auto pred = compare_predicate(op_ty)){
+			// tagging is monotonic so inline words compare directly
+			return emit_fast_path(
+				state, both_small, builder->getInt1Ty(),
+				[&](llvm::IRBuilder<> &b){ return std::make_pair(b.CreateICmp(*pred, lhs, rhs), (llvm::Value*)nullptr); },
+				[&](llvm::IRBuilder<> &b){
+					auto cmp = llvm_call_runtime(b, "purson_int_cmp", b.getInt32Ty(), {lhs, rhs});
+					return b.CreateICmp(*pred, cmp, b.getInt32(0));
+				}
+			);
+		}
+
+		switch(op_ty){
+			case operator_type::add:{
+				// (2a + 1) + 2b
+				return emit_fast_path(
+					state, both_small, word_ty,
+					[&](llvm::IRBuilder<> &b){ return checked(b, llvm::Intrinsic::sadd_with_overflow, lhs, strip_tag(b, rhs)); },
+					slow_op("purson_int_add")
+				);
+			}
+
+			case operator_type::sub:{
+				// (2a + 1) - 2b
+				return emit_fast_path(
+					state, both_small, word_ty,
+					[&](llvm::IRBuilder<> &b){
+						auto res = checked(b, llvm::Intrinsic::ssub_with_overflow, lhs, strip_tag(b, rhs));
+						if(is_natural){
+							auto tagged_zero = b.getInt64(1);
+							res.first = b.CreateSelect(b.CreateICmpSLT(res.first, tagged_zero), tagged_zero, res.first);
+						}
+
+						return res;
+					},
+					slow_op(is_natural ? "purson_nat_sub" : "purson_int_sub")
+				);
+			}
+
+			case operator_type::mul:{
+				// a * 2b + 1
+				return emit_fast_path(
+					state, both_small, word_ty,
+					[&](llvm::IRBuilder<> &b){
+						auto res = checked(b, llvm::Intrinsic::smul_with_overflow, untag(b, lhs), strip_tag(b, rhs));
+						return std::make_pair(set_tag(b, res.first), res.second);
+					},
+					slow_op("purson_int_mul")
+				);
+			}
+
+			case operator_type::div:{
+				// only min / -1 can leave the inline range, the runtime throws for an inline zero divisor
+				auto nonzero = builder->CreateICmpNE(rhs, builder->getInt64(1));
+				return emit_fast_path(
+					state, builder->CreateAnd(both_small, nonzero), word_ty,
+					[&](llvm::IRBuilder<> &b){
+						auto quot = b.CreateSDiv(untag(b, lhs), untag(b, rhs));
+						auto res = checked(b, llvm::Intrinsic::sadd_with_overflow, quot, quot);
+						return std::make_pair(set_tag(b, res.first), res.second);
+					},
+					slow_op("purson_int_div")
+				);
+			}
+
+			default:
+				throw module_error{"unsupported binary operator for arbitrary precision integer"};
+		}
+	}
+
+	llvm::Value *llvm_compile_tagged_integer_binop(const binary_op_expr *binop, const natural_type *ty, llvm_state *state){
+		auto lhs = compile_operand(binop->lhs().get(), ty, state);
+		auto rhs = compile_operand(binop->rhs().get(), ty, state);
+
+		auto res = llvm_compile_tagged_integer_op(binop->operator_().op_type(), ty, lhs.first, rhs.first, state);
+
+		// results are always new words, never one of the operands
+		if(lhs.second) llvm_compile_tagged_integer_release(lhs.first, state);
+		if(rhs.second) llvm_compile_tagged_integer_release(rhs.first, state);
+
+		return res;
+	}
+
+	llvm::Value *llvm_compile_tagged_integer_owned(const rvalue_expr *expr, const natural_type *ty, llvm_state *state){
+		auto operand = compile_operand(expr, ty, state);
+		if(operand.second)
+			return operand.first;
+
+		auto word = operand.first;
+		return emit_fast_path(
+			state, is_small(*state->builder(), word), word->getType(),
+			[&](llvm::IRBuilder<> &b){ return std::make_pair(word, (llvm::Value*)nullptr); },
+			[&](llvm::IRBuilder<> &b){ return llvm_call_runtime(b, "purson_int_copy", word->getType(), {word}); }
+		);
+	}
+
+	void llvm_compile_tagged_integer_release(llvm::Value *word, llvm_state *state){
+		auto builder = state->builder();
+		auto fn = builder->GetInsertBlock()->getParent();
+		auto release_bb = llvm::BasicBlock::Create(llvm_ctx, "int.release", fn);
+		auto cont_bb = llvm::BasicBlock::Create(llvm_ctx, "int.released", fn);
+
+		// inline words own nothing
+		builder->CreateCondBr(is_small(*builder, word), cont_bb, release_bb);
+
+		builder->SetInsertPoint(release_bb);
+		llvm_call_runtime(*builder, "purson_int_release", builder->getVoidTy(), {word});
+		builder->CreateBr(cont_bb);
+
+		builder->SetInsertPoint(cont_bb);
+	}
+
+	llvm::Value *llvm_compile_tagged_integer_cast(llvm::Value *val, const type *from, const type *to, llvm_state *state){
+		auto builder = state->builder();
+		auto word_ty = builder->getInt64Ty();
+
+		auto from_cat = numeric_category_of(from);
+		auto to_cat = numeric_category_of(to);
+
+		if(is_tagged_integer(from)){
+			if(is_tagged_integer(to))
+				return val;
+
+			switch(to_cat){
+				case numeric_category::natural:
+				case numeric_category::integer:
+					return builder->CreateIntCast(unbox_word(state, val), llvm_type(to), true);
+
+				case numeric_category::rational:
+					return llvm_compile_rational_cast(unbox_word(state, val), from, to, state);
+
+				case numeric_category::real:{
+					auto double_ty = builder->getDoubleTy();
+					auto res = emit_fast_path(
+						state, is_small(*builder, val), double_ty,
+						[&](llvm::IRBuilder<> &b){ return std::make_pair(b.CreateSIToFP(untag(b, val), double_ty), (llvm::Value*)nullptr); },
+						[&](llvm::IRBuilder<> &b){ return llvm_call_runtime(b, "purson_int_to_f64", double_ty, {val}); }
+					);
+					return builder->CreateFPCast(res, llvm_type(to));
+				}
+
+				default:
+					throw module_error{fmt::format("can not cast from '{}' to '{}'", from->str(), to->str())};
+			}
+		}
+
+		switch(from_cat){
+			case numeric_category::natural:
+			case numeric_category::integer:{
+				bool is_signed = from_cat == numeric_category::integer;
+				auto raw = builder->CreateIntCast(val, word_ty, is_signed);
+				return box_word(state, raw, is_signed, from->bits());
+			}
+
+			case numeric_category::rational:{
+				// truncated quotient, already word sized because 'to' lowers to a word
+				auto raw = llvm_compile_rational_cast(val, from, to, state);
+				return box_word(state, raw, true, 64);
+			}
+
+			case numeric_category::real:{
+				auto as_double = builder->CreateFPCast(val, builder->getDoubleTy());
+				return llvm_call_runtime(*builder, "purson_int_from_f64", word_ty, {as_double});
+			}
+
+			default:
+				throw module_error{fmt::format("can not cast from '{}' to '{}'", from->str(), to->str())};
+		}
+	}
+
+	llvm::Value *llvm_compile_tagged_integer_literal(const mpz_t &val, llvm_state *state){
+		auto word_ty = llvm::Type::getInt64Ty(llvm_ctx);
+
+		if(mpz_fits_slong_p(val)){
+			std::int64_t small = mpz_get_si(val);
+			if((small >= small_min) && (small <= small_max))
+				return llvm::ConstantInt::get(word_ty, small * 2 + 1, true);
+		}
+
+		if(!state->builder())
+			throw module_error{"arbitrary precision literal outside of a function body"};
+
+		std::string val_str(mpz_sizeinbase(val, 10) + 2, '\0');
+		mpz_get_str(&val_str[0], 10, val);
+
+		auto str_ptr = state->builder()->CreateGlobalStringPtr(val_str.c_str());
+		return llvm_call_runtime(*state->builder(), "purson_int_from_str", word_ty, {str_ptr});
+	}
+}
@@ -0,0 +1,359 @@
+#include <cmath>
+
+#include <llvm/IR/Intrinsics.h>
+
+#include "../llvm.hpp"
+
+/**
+ * Rationals are stored as <2 x iN> numerator/denominator pairs with the
+ * denominator kept positive. Arithmetic is done exactly at double width and
+ * only reduced by the gcd when the result does not fit back into N bits, when
+ * it is returned from a function or when it is explicitly normalized.
+ * Comparisons cross multiply so they never need a reduced operand.
+ **/
+
+namespace purson{
+	namespace{
+		llvm::Value *count_trailing_zeros(llvm::IRBuilder<> &builder, llvm::Value *val){
+			auto cttz = llvm::Intrinsic::getDeclaration(
+				builder.GetInsertBlock()->getModule(), llvm::Intrinsic::cttz, {val->getType()}
+			);
+			return builder.CreateCall(cttz, {val, builder.getTrue()});
+		}
+
+		// binary gcd of the unsigned magnitudes a and b
+		llvm::Function *rational_gcd_fn(llvm::IntegerType *int_ty, llvm::Module *module){
+			auto name = fmt::format("__purson_gcd_i{}", int_ty->getBitWidth());
+			if(auto fn = module->getFunction(name)) return fn;
+
+			auto fn_ty = llvm::FunctionType::get(int_ty, {int_ty, int_ty}, false);
+			auto fn = llvm::Function::Create(fn_ty, llvm::GlobalValue::InternalLinkage, name, module);
+			fn->setDoesNotThrow();
+			fn->setDoesNotAccessMemory();
+
+			auto arg_it = fn->arg_begin();
+			llvm::Value *a = &*arg_it++;
+			llvm::Value *b = &*arg_it;
+
+			auto entry_bb = llvm::BasicBlock::Create(llvm_ctx, "entry", fn);
+			auto trivial_bb = llvm::BasicBlock::Create(llvm_ctx, "trivial", fn);
+			auto setup_bb = llvm::BasicBlock::Create(llvm_ctx, "setup", fn);
+			auto loop_bb = llvm::BasicBlock::Create(llvm_ctx, "loop", fn);
+			auto done_bb = llvm::BasicBlock::Create(llvm_ctx, "done", fn);
+
+			auto zero = llvm::ConstantInt::get(int_ty, 0);
+
+			llvm::IRBuilder<> builder(entry_bb);
+			auto either = builder.CreateOr(a, b);
+			auto any_zero = builder.CreateOr(builder.CreateICmpEQ(a, zero), builder.CreateICmpEQ(b, zero));
+			builder.CreateCondBr(any_zero, trivial_bb, setup_bb);
+
+			// gcd(0, b) = b, gcd(a, 0) = a
+			builder.SetInsertPoint(trivial_bb);
+			builder.CreateRet(either);
+
+			builder.SetInsertPoint(setup_bb);
+			auto shift = count_trailing_zeros(builder, either);
+			auto a_odd = builder.CreateLShr(a, count_trailing_zeros(builder, a));
+			builder.CreateBr(loop_bb);
+
+			builder.SetInsertPoint(loop_bb);
+			auto a_phi = builder.CreatePHI(int_ty, 2);
+			auto b_phi = builder.CreatePHI(int_ty, 2);
+			auto b_odd = builder.CreateLShr(b_phi, count_trailing_zeros(builder, b_phi));
+			auto swap = builder.CreateICmpUGT(a_phi, b_odd);
+			auto lo = builder.CreateSelect(swap, b_odd, a_phi);
+			auto hi = builder.CreateSelect(swap, a_phi, b_odd);
+			auto diff = builder.CreateSub(hi, lo);
+			a_phi->addIncoming(a_odd, setup_bb);
+			a_phi->addIncoming(lo, loop_bb);
+			b_phi->addIncoming(b, setup_bb);
+			b_phi->addIncoming(diff, loop_bb);
+			builder.CreateCondBr(builder.CreateICmpNE(diff, zero), loop_bb, done_bb);
+
+			builder.SetInsertPoint(done_bb);
+			builder.CreateRet(builder.CreateShl(lo, shift));
+
+			return fn;
+		}
+
+		// divides both components by their gcd
+		llvm::Function *rational_normalize_fn(llvm::VectorType *vec_ty, llvm::Module *module){
+			auto int_ty = llvm::cast<llvm::IntegerType>(vec_ty->getElementType());
+			auto name = fmt::format("__purson_qnorm_i{}", int_ty->getBitWidth());
+			if(auto fn = module->getFunction(name)) return fn;
+
+			auto gcd_fn = rational_gcd_fn(int_ty, module);
+
+			auto fn_ty = llvm::FunctionType::get(vec_ty, {vec_ty}, false);
+			auto fn = llvm::Function::Create(fn_ty, llvm::GlobalValue::InternalLinkage, name, module);
+			fn->setDoesNotThrow();
+			fn->setDoesNotAccessMemory();
+
+			llvm::Value *val = &*fn->arg_begin();
+
+			llvm::IRBuilder<> builder(llvm::BasicBlock::Create(llvm_ctx, "entry", fn));
+
+			auto zero = llvm::ConstantInt::get(int_ty, 0);
+			auto one = llvm::ConstantInt::get(int_ty, 1);
+
+			auto num = builder.CreateExtractElement(val, std::uint64_t(0));
+			auto denom = builder.CreateExtractElement(val, std::uint64_t(1));
+			auto num_mag = builder.CreateSelect(builder.CreateICmpSLT(num, zero), builder.CreateNeg(num), num);
+
+			auto gcd = builder.CreateCall(gcd_fn, {num_mag, denom});
+			auto divisor = builder.CreateSelect(builder.CreateICmpEQ(gcd, zero), one, gcd);
+
+			auto ret = llvm::UndefValue::get(vec_ty);
+			auto res = builder.CreateInsertElement(ret, builder.CreateSDiv(num, divisor), std::uint64_t(0));
+			res = builder.CreateInsertElement(res, builder.CreateSDiv(denom, divisor), std::uint64_t(1));
+			builder.CreateRet(res);
+
+			return fn;
+		}
+
+		llvm::VectorType *widened_type(llvm::VectorType *vec_ty){
+			auto bits = vec_ty->getElementType()->getIntegerBitWidth();
+			return llvm::VectorType::get(llvm::Type::getIntNTy(llvm_ctx, bits * 2), 2);
+		}
+
+		llvm::Value *splat(llvm::IRBuilder<> &builder, llvm::Value *vec, std::uint32_t idx){
+			return builder.CreateShuffleVector(vec, llvm::UndefValue::get(vec->getType()), {idx, idx});
+		}
+
+		llvm::Value *make_rational(llvm::IRBuilder<> &builder, llvm::VectorType *vec_ty, llvm::Value *num, llvm::Value *denom){
+			auto res = builder.CreateInsertElement(llvm::UndefValue::get(vec_ty), num, std::uint64_t(0));
+			return builder.CreateInsertElement(res, denom, std::uint64_t(1));
+		}
+
+		//! end the program with a trap unless cond holds, continuing after it otherwise
+		void trap_unless(llvm::Value *cond, llvm_state *state){
+			auto builder = state->builder();
+			auto fn = builder->GetInsertBlock()->getParent();
+			auto trap_bb = llvm::BasicBlock::Create(llvm_ctx, "q.trap", fn);
+			auto cont_bb = llvm::BasicBlock::Create(llvm_ctx, "q.ok", fn);
+
+			builder->CreateCondBr(cond, cont_bb, trap_bb);
+
+			builder->SetInsertPoint(trap_bb);
+			builder->CreateCall(llvm::Intrinsic::getDeclaration(state->module(), llvm::Intrinsic::trap));
+			builder->CreateUnreachable();
+
+			builder->SetInsertPoint(cont_bb);
+		}
+
+		llvm::Value *components_fit(llvm::IRBuilder<> &builder, llvm::Value *wide, llvm::Value *truncated){
+			auto fits_vec = builder.CreateICmpEQ(builder.CreateSExt(truncated, wide->getType()), wide);
+			return builder.CreateAnd(
+				builder.CreateExtractElement(fits_vec, std::uint64_t(0)),
+				builder.CreateExtractElement(fits_vec, std::uint64_t(1))
+			);
+		}
+
+		/**
+		 * Truncate a rational to a narrower representation, only reducing
+		 * when the components don't already fit. If the reduced value still
+		 * doesn't fit it can't be represented and the program traps.
+		 **/
+		llvm::Value *narrow_rational(llvm::Value *wide, llvm::VectorType *narrow_ty, llvm_state *state){
+			auto builder = state->builder();
+			auto wide_ty = llvm::cast<llvm::VectorType>(wide->getType());
+
+			auto truncated = builder->CreateTrunc(wide, narrow_ty);
+			auto fits = components_fit(*builder, wide, truncated);
+
+			auto fn = builder->GetInsertBlock()->getParent();
+			auto fit_bb = builder->GetInsertBlock();
+			auto reduce_bb = llvm::BasicBlock::Create(llvm_ctx, "q.reduce", fn);
+			auto cont_bb = llvm::BasicBlock::Create(llvm_ctx, "q.cont", fn);
+
+			builder->CreateCondBr(fits, cont_bb, reduce_bb);
+
+			builder->SetInsertPoint(reduce_bb);
+			auto normalized = builder->CreateCall(rational_normalize_fn(wide_ty, state->module()), {wide});
+			auto reduced = builder->CreateTrunc(normalized, narrow_ty);
+			trap_unless(components_fit(*builder, normalized, reduced), state);
+			auto reduced_bb = builder->GetInsertBlock();
+			builder->CreateBr(cont_bb);
+
+			builder->SetInsertPoint(cont_bb);
+			auto res = builder->CreatePHI(narrow_ty, 2);
+			res->addIncoming(truncated, fit_bb);
+			res->addIncoming(reduced, reduced_bb);
+			return res;
+		}
+	}
+
+	llvm::Value *llvm_compile_rational_normalize(llvm::Value *val, const rational_type *ty, llvm_state *state){
+		auto vec_ty = llvm_type(ty);
+		return state->builder()->CreateCall(rational_normalize_fn(vec_ty, state->module()), {val});
+	}
+
+	llvm::Value *llvm_compile_rational_op(operator_type op_ty, const rational_type *ty, llvm::Value *lhs, llvm::Value *rhs, llvm_state *state){
+		auto builder = state->builder();
+		auto vec_ty = llvm_type(ty);
+		auto wide_ty = widened_type(vec_ty);
+
+		// <a, b> op <c, d>, exact at double width
+		auto wide_lhs = builder->CreateSExt(lhs, wide_ty);
+		auto wide_rhs = builder->CreateSExt(rhs, wide_ty);
+
+		switch(op_ty){
+			case operator_type::add:
+			case operator_type::sub:{
+				auto lhs_scaled = builder->CreateMul(wide_lhs, splat(*builder, wide_rhs, 1)); // <ad, bd>
+				auto rhs_scaled = builder->CreateMul(wide_rhs, splat(*builder, wide_lhs, 1)); // <cb, db>
+				auto combined = op_ty == operator_type::add ?
+					builder->CreateAdd(lhs_scaled, rhs_scaled) :
+					builder->CreateSub(lhs_scaled, rhs_scaled);
+
+				auto res = builder->CreateShuffleVector(combined, lhs_scaled, {0, 3});
+				return narrow_rational(res, vec_ty, state);
+			}
+
+			case operator_type::mul:{
+				auto res = builder->CreateMul(wide_lhs, wide_rhs);
+				return narrow_rational(res, vec_ty, state);
+			}
+
+			case operator_type::div:{
+				// dividing by zero would leave a zero denominator
+				auto rhs_num = builder->CreateExtractElement(rhs, std::uint64_t(0));
+				trap_unless(builder->CreateICmpNE(rhs_num, llvm::ConstantInt::get(rhs_num->getType(), 0)), state);
+
+				auto crossed = builder->CreateShuffleVector(wide_rhs, llvm::UndefValue::get(wide_ty), {1, 0});
+				auto res = builder->CreateMul(wide_lhs, crossed); // <ad, bc>
+
+				// keep the denominator positive
+				auto wide_elem_ty = wide_ty->getElementType();
+				auto denom_neg = builder->CreateICmpSLT(
+					builder->CreateExtractElement(res, std::uint64_t(1)), llvm::ConstantInt::get(wide_elem_ty, 0)
+				);
+				res = builder->CreateSelect(denom_neg, builder->CreateNeg(res), res);
+				return narrow_rational(res, vec_ty, state);
+			}
+
+			case operator_type::equ:
+			case operator_type::neq:
+			case operator_type::lt:
+			case operator_type::gt:
+			case operator_type::lte:
+			case operator_type::gte:{
+				auto lhs_cross = builder->CreateExtractElement(builder->CreateMul(wide_lhs, splat(*builder, wide_rhs, 1)), std::uint64_t(0));
+				auto rhs_cross = builder->CreateExtractElement(builder->CreateMul(wide_rhs, splat(*builder, wide_lhs, 1)), std::uint64_t(0));
+
+				switch(op_ty){
+					case operator_type::equ: return builder->CreateICmpEQ(lhs_cross, rhs_cross);
+					case operator_type::neq: return builder->CreateICmpNE(lhs_cross, rhs_cross);
+					case operator_type::lt: return builder->CreateICmpSLT(lhs_cross, rhs_cross);
+					case operator_type::gt: return builder->CreateICmpSGT(lhs_cross, rhs_cross);
+					case operator_type::lte: return builder->CreateICmpSLE(lhs_cross, rhs_cross);
+					default: return builder->CreateICmpSGE(lhs_cross, rhs_cross);
+				}
+			}
+
+			default:
+				throw module_error{"unsupported binary operator for rational"};
+		}
+	}
+
+	llvm::Value *llvm_compile_rational_cast(llvm::Value *val, const type *from, const type *to, llvm_state *state){
+		auto builder = state->builder();
+
+		auto from_cat = numeric_category_of(from);
+		auto to_cat = numeric_category_of(to);
+
+		if(from_cat == numeric_category::rational){
+			auto num = builder->CreateExtractElement(val, std::uint64_t(0));
+			auto denom = builder->CreateExtractElement(val, std::uint64_t(1));
+
+			switch(to_cat){
+				case numeric_category::rational:{
+					auto to_vec_ty = llvm_type(dynamic_cast<const rational_type*>(to));
+					if(to->bits() == from->bits())
+						return val;
+					else if(to->bits() > from->bits())
+						return builder->CreateSExt(val, to_vec_ty);
+					else
+						return narrow_rational(val, to_vec_ty, state);
+				}
+
+				case numeric_category::natural:
+				case numeric_category::integer:{
+					auto quot = builder->CreateSDiv(num, denom);
+					return builder->CreateIntCast(quot, llvm_type(to), true);
+				}
+
+				case numeric_category::real:{
+					auto llvm_ty = llvm_type(to);
+					return builder->CreateFDiv(builder->CreateSIToFP(num, llvm_ty), builder->CreateSIToFP(denom, llvm_ty));
+				}
+
+				default:
+					throw module_error{fmt::format("can not cast from '{}' to '{}'", from->str(), to->str())};
+			}
+		}
+
+		auto vec_ty = llvm_type(dynamic_cast<const rational_type*>(to));
+		auto elem_ty = llvm::cast<llvm::IntegerType>(vec_ty->getElementType());
+
+		switch(from_cat){
+			case numeric_category::natural:
+			case numeric_category::integer:{
+				bool is_signed = from_cat == numeric_category::integer;
+				auto num = builder->CreateIntCast(val, elem_ty, is_signed);
+
+				// the numerator is signed, so a natural as wide as it can't have its top bit set either
+				if(val->getType()->getIntegerBitWidth() >= elem_ty->getBitWidth()){
+					auto fits = builder->CreateICmpEQ(builder->CreateSExt(num, val->getType()), val);
+					if(!is_signed)
+						fits = builder->CreateAnd(fits, builder->CreateICmpSGE(num, llvm::ConstantInt::get(elem_ty, 0)));
+
+					trap_unless(fits, state);
+				}
+
+				return make_rational(*builder, vec_ty, num, llvm::ConstantInt::get(elem_ty, 1));
+			}
+
+			case numeric_category::real:{
+				// the closest fraction with a power of two denominator, using every bit the magnitude leaves free
+				auto bits = static_cast<std::int64_t>(elem_ty->getBitWidth());
+				auto word_ty = builder->getInt64Ty();
+				auto double_ty = builder->getDoubleTy();
+
+				auto real = val->getType()->isDoubleTy() ? val : builder->CreateFPExt(val, double_ty);
+				auto biased = builder->CreateAnd(builder->CreateLShr(builder->CreateBitCast(real, word_ty), 52), 0x7ff);
+
+				// |real| < 2^(exponent + 1), so the integral part fits below 2^(bits - 1)
+				auto exponent = builder->CreateSub(biased, builder->getInt64(1023));
+				trap_unless(builder->CreateAnd(
+					builder->CreateICmpNE(biased, builder->getInt64(0x7ff)),
+					builder->CreateICmpSLT(exponent, builder->getInt64(bits - 1))
+				), state);
+
+				// the denominator has to stay positive as well
+				auto frac_bits = builder->CreateSub(builder->getInt64(bits - 2), exponent);
+				auto max_frac = builder->getInt64(bits - 2);
+				frac_bits = builder->CreateSelect(builder->CreateICmpSGT(frac_bits, max_frac), max_frac, frac_bits);
+
+				// exact, and |scaled| < 2^(bits - 1) so it converts without overflowing
+				auto scale = builder->CreateBitCast(builder->CreateShl(builder->CreateAdd(frac_bits, builder->getInt64(1023)), 52), double_ty);
+				auto num = builder->CreateFPToSI(builder->CreateFMul(real, scale), elem_ty);
+				auto denom = builder->CreateTrunc(builder->CreateShl(builder->getInt64(1), frac_bits), elem_ty);
+
+				// too small to be anything but zero
+				trap_unless(builder->CreateOr(
+					builder->CreateICmpNE(num, llvm::ConstantInt::get(elem_ty, 0)),
+					builder->CreateFCmpOEQ(real, llvm::ConstantFP::get(double_ty, 0.0))
+				), state);
+
+				return llvm_compile_rational_normalize(
+					make_rational(*builder, vec_ty, num, denom), dynamic_cast<const rational_type*>(to), state
+				);
+			}
+
+			default:
+				throw module_error{fmt::format("can not cast from '{}' to '{}'", from->str(), to->str())};
+		}
+	}
+}
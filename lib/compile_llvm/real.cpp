@@ -0,0 +1,278 @@
+#include "../llvm.hpp"
+
+/**
+ * Arbitrary precision reals are handles to MPFR values allocated from a per
+ * thread pool in lib/runtime. Binary operations own the results of nested
+ * binary operations, calls, literals and casts and hand them back to the pool
+ * as soon as they have been consumed. Variables own their value until the
+ * function returns, and functions return a value their caller owns, copying
+ * it if it is still referenced. Constant sub-expressions, including ones
+ * typed as narrower reals, are folded at the precision of the result before
+ * any code is emitted.
+ **/
+
+namespace purson{
+	namespace{
+		std::optional<std::int32_t> compare_code(operator_type op_ty){
+			switch(op_ty){
+				case operator_type::equ: return 0;
+				case operator_type::neq: return 1;
+				case operator_type::lt: return 2;
+				case operator_type::gt: return 3;
+				case operator_type::lte: return 4;
+				case operator_type::gte: return 5;
+				default: return std::nullopt;
+			}
+		}
+
+		bool fold_real(const rvalue_expr *expr, mpfr_t out){
+			if(auto real_lit = dynamic_cast<const real_literal_expr*>(expr)){
+				// re-read the source text so the literal is rounded once at the target precision
+				return mpfr_set_str(out, std::string(real_lit->str()).c_str(), 10, MPFR_RNDN) == 0;
+			}
+			else if(auto int_lit = dynamic_cast<const integer_literal_expr*>(expr)){
+				mpfr_set_z(out, int_lit->value(), MPFR_RNDN);
+				return true;
+			}
+			else if(auto nat_lit = dynamic_cast<const natural_literal_expr*>(expr)){
+				mpfr_set_z(out, nat_lit->value(), MPFR_RNDN);
+				return true;
+			}
+			else if(auto rat_lit = dynamic_cast<const rational_literal_expr*>(expr)){
+				mpfr_set_q(out, rat_lit->value(), MPFR_RNDN);
+				return true;
+			}
+			else if(auto binop = dynamic_cast<const binary_op_expr*>(expr)){
+				// real literals are typed from their context, anything else has the semantics of its own type
+				if(numeric_category_of(binop->value_type()) != numeric_category::real)
+					return false;
+
+				auto op_ty = binop->operator_().op_type();
+				switch(op_ty){
+					case operator_type::add:
+					case operator_type::sub:
+					case operator_type::mul:
+					case operator_type::div: break;
+					default: return false;
+				}
+
+				mpfr_t lhs, rhs;
+				mpfr_inits2(mpfr_get_prec(out), lhs, rhs, (mpfr_ptr)nullptr);
+
+				bool folded = fold_real(binop->lhs().get(), lhs) && fold_real(binop->rhs().get(), rhs);
+				if(folded){
+					switch(op_ty){
+						case operator_type::add: mpfr_add(out, lhs, rhs, MPFR_RNDN); break;
+						case operator_type::sub: mpfr_sub(out, lhs, rhs, MPFR_RNDN); break;
+						case operator_type::mul: mpfr_mul(out, lhs, rhs, MPFR_RNDN); break;
+						default: mpfr_div(out, lhs, rhs, MPFR_RNDN); break;
+					}
+				}
+
+				mpfr_clears(lhs, rhs, (mpfr_ptr)nullptr);
+				return folded;
+			}
+
+			return false;
+		}
+
+		llvm::Value *emit_constant(const mpfr_t val, const real_type *ty, llvm_state *state){
+			if(!state->builder())
+				throw module_error{"arbitrary precision real outside of a function body"};
+
+			// hex float text round trips exactly
+			char *str = nullptr;
+			mpfr_asprintf(&str, "%Ra", val);
+			std::string hex_str(str);
+			mpfr_free_str(str);
+
+			auto builder = state->builder();
+			auto str_ptr = builder->CreateGlobalStringPtr(hex_str);
+			return llvm_call_runtime(*builder, "purson_real_from_str", builder->getInt8PtrTy(), {str_ptr, builder->getInt64(ty->bits())});
+		}
+
+		// operand converted to ty, and whether it is a temporary owned by the caller
+		std::pair<llvm::Value*, bool> compile_operand(const rvalue_expr *expr, const real_type *ty, llvm_state *state){
+			mpfr_t folded;
+			mpfr_init2(folded, ty->bits());
+			if(fold_real(expr, folded)){
+				auto res = emit_constant(folded, ty, state);
+				mpfr_clear(folded);
+				return {res, true};
+			}
+
+			mpfr_clear(folded);
+
+			auto expr_ty = expr->value_type();
+			auto val = llvm_compile_rvalue(expr, state);
+
+			// variables may still be referenced elsewhere
+			bool temporary = is_big_real(expr_ty) && llvm_is_temporary(expr);
+			if(expr_ty == ty)
+				return {val, temporary};
+
+			auto converted = llvm_compile_cast(val, expr_ty, ty, state);
+			if(temporary) llvm_compile_big_real_release(val, state);
+
+			return {converted, true};
+		}
+	}
+
+	llvm::Value *llvm_compile_big_real_binop(const binary_op_expr *binop, const real_type *ty, llvm_state *state){
+		auto builder = state->builder();
+		auto op_ty = binop->operator_().op_type();
+		auto cmp_code = compare_code(op_ty);
+
+		if(!cmp_code){
+			mpfr_t folded;
+			mpfr_init2(folded, ty->bits());
+			if(fold_real(binop, folded)){
+				auto res = emit_constant(folded, ty, state);
+				mpfr_clear(folded);
+				return res;
+			}
+
+			mpfr_clear(folded);
+		}
+
+		auto lhs = compile_operand(binop->lhs().get(), ty, state);
+		auto rhs = compile_operand(binop->rhs().get(), ty, state);
+
+		llvm::Value *res = nullptr;
+
+		if(cmp_code){
+			auto cmp = llvm_call_runtime(
+				*builder, "purson_real_compare", builder->getInt32Ty(),
+				{lhs.first, rhs.first, builder->getInt32(*cmp_code)}
+			);
+			res = builder->CreateICmpNE(cmp, builder->getInt32(0));
+		}
+		else{
+			std::string fn_name;
+			switch(op_ty){
+				case operator_type::add: fn_name = "purson_real_add"; break;
+				case operator_type::sub: fn_name = "purson_real_sub"; break;
+				case operator_type::mul: fn_name = "purson_real_mul"; break;
+				case operator_type::div: fn_name = "purson_real_div"; break;
+				default: throw module_error{"unsupported binary operator for arbitrary precision real"};
+			}
+
+			res = llvm_call_runtime(*builder, fn_name, builder->getInt8PtrTy(), {lhs.first, rhs.first, builder->getInt64(ty->bits())});
+		}
+
+		if(lhs.second) llvm_compile_big_real_release(lhs.first, state);
+		if(rhs.second) llvm_compile_big_real_release(rhs.first, state);
+
+		return res;
+	}
+
+	llvm::Value *llvm_compile_big_real_owned(const rvalue_expr *expr, const real_type *ty, llvm_state *state){
+		auto operand = compile_operand(expr, ty, state);
+		if(operand.second)
+			return operand.first;
+
+		auto builder = state->builder();
+		return llvm_call_runtime(*builder, "purson_real_round", builder->getInt8PtrTy(), {operand.first, builder->getInt64(ty->bits())});
+	}
+
+	void llvm_compile_big_real_release(llvm::Value *val, llvm_state *state){
+		llvm_call_runtime(*state->builder(), "purson_real_release", state->builder()->getVoidTy(), {val});
+	}
+
+	llvm::Value *llvm_compile_big_real_cast(llvm::Value *val, const type *from, const type *to, llvm_state *state){
+		auto builder = state->builder();
+		auto handle_ty = builder->getInt8PtrTy();
+
+		auto from_cat = numeric_category_of(from);
+		auto to_cat = numeric_category_of(to);
+
+		if(is_big_real(from)){
+			if(is_big_real(to))
+				return llvm_call_runtime(*builder, "purson_real_round", handle_ty, {val, builder->getInt64(to->bits())});
+			else if(is_tagged_integer(to))
+				return llvm_call_runtime(*builder, "purson_real_to_int", builder->getInt64Ty(), {val});
+
+			switch(to_cat){
+				case numeric_category::natural:
+				case numeric_category::integer:{
+					auto raw = llvm_call_runtime(*builder, "purson_real_to_i64", builder->getInt64Ty(), {val});
+					return builder->CreateIntCast(raw, llvm_type(to), true);
+				}
+
+				case numeric_category::rational:{
+					auto as_double = llvm_call_runtime(*builder, "purson_real_to_f64", builder->getDoubleTy(), {val});
+					return llvm_compile_rational_cast(as_double, from, to, state);
+				}
+
+				case numeric_category::real:{
+					auto as_double = llvm_call_runtime(*builder, "purson_real_to_f64", builder->getDoubleTy(), {val});
+					return builder->CreateFPCast(as_double, llvm_type(to));
+				}
+
+				default:
+					throw module_error{fmt::format("can not cast from '{}' to '{}'", from->str(), to->str())};
+			}
+		}
+
+		auto prec = builder->getInt64(to->bits());
+
+		if(is_tagged_integer(from))
+			return llvm_call_runtime(*builder, "purson_real_from_int", handle_ty, {val, prec});
+
+		switch(from_cat){
+			case numeric_category::natural:{
+				auto raw = builder->CreateIntCast(val, builder->getInt64Ty(), false);
+				return llvm_call_runtime(*builder, "purson_real_from_u64", handle_ty, {raw, prec});
+			}
+
+			case numeric_category::integer:{
+				auto raw = builder->CreateIntCast(val, builder->getInt64Ty(), true);
+				return llvm_call_runtime(*builder, "purson_real_from_i64", handle_ty, {raw, prec});
+			}
+
+			case numeric_category::rational:{
+				auto num = builder->CreateSExt(builder->CreateExtractElement(val, std::uint64_t(0)), builder->getInt64Ty());
+				auto denom = builder->CreateSExt(builder->CreateExtractElement(val, std::uint64_t(1)), builder->getInt64Ty());
+				return llvm_call_runtime(*builder, "purson_real_from_ratio", handle_ty, {num, denom, prec});
+			}
+
+			case numeric_category::real:{
+				auto as_double = builder->CreateFPCast(val, builder->getDoubleTy());
+				return llvm_call_runtime(*builder, "purson_real_from_f64", handle_ty, {as_double, prec});
+			}
+
+			default:
+				throw module_error{fmt::format("can not cast from '{}' to '{}'", from->str(), to->str())};
+		}
+	}
+
+	llvm::Value *llvm_compile_big_real_literal(const numeric_literal_expr *lit, const real_type *ty, llvm_state *state){
+		mpfr_t val;
+		mpfr_init2(val, ty->bits());
+		if(!fold_real(lit, val)){
+			mpfr_clear(val);
+			throw module_error{fmt::format("invalid real literal '{}'", lit->str())};
+		}
+
+		auto res = emit_constant(val, ty, state);
+		mpfr_clear(val);
+		return res;
+	}
+
+	llvm::Constant *llvm_real_constant(const mpfr_t &val, const real_type *ty){
+		switch(ty->bits()){
+			case 16:{
+				llvm::APFloat half(mpfr_get_d(val, MPFR_RNDN));
+				bool loses_info;
+				half.convert(llvm::APFloat::IEEEhalf(), llvm::APFloat::rmNearestTiesToEven, &loses_info);
+				return llvm::ConstantFP::get(llvm_ctx, half);
+			}
+
+			case 32: return llvm::ConstantFP::get(llvm_ctx, llvm::APFloat(mpfr_get_flt(val, MPFR_RNDN)));
+			case 64: return llvm::ConstantFP::get(llvm_ctx, llvm::APFloat(mpfr_get_d(val, MPFR_RNDN)));
+
+			default:
+				throw module_error{fmt::format("could not create constant for real type '{}'", ty->str())};
+		}
+	}
+}
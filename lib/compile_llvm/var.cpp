@@ -9,6 +9,18 @@ namespace purson{
 
 		auto val_llvm = state->builder()->CreateAlloca(llvm_type(decl->value_type()));
 		state->set_var(decl->name(), decl->value_type(), val_llvm);
+
+		if(is_big_real(decl->value_type())){
+			// releasing a null handle does nothing
+			state->builder()->CreateStore(llvm::Constant::getNullValue(val_llvm->getAllocatedType()), val_llvm);
+			state->own_var(val_llvm, decl->value_type());
+		}
+		else if(is_tagged_integer(decl->value_type())){
+			// an inline zero owns nothing
+			state->builder()->CreateStore(state->builder()->getInt64(1), val_llvm);
+			state->own_var(val_llvm, decl->value_type());
+		}
+
 		return val_llvm;
 	}
 
@@ -18,10 +30,26 @@ namespace purson{
 		else if(state->get_var(def->name()))
 			throw module_error{"variable with same name already exists"};
 
-		auto val_llvm = state->builder()->CreateAlloca(llvm_type(def->value_type()));
-		state->set_var(def->name(), def->value_type(), val_llvm);
-		auto rvalue_llvm = llvm_compile_rvalue(def->value().get(), state);
+		auto ty = def->value_type();
+		auto val_llvm = state->builder()->CreateAlloca(llvm_type(ty));
+
+		// the variable owns its value, constants are folded at its precision
+		auto rvalue_llvm = llvm_compile_owned(def->value().get(), ty, state);
+		if(is_big_real(ty) || is_tagged_integer(ty))
+			state->own_var(val_llvm, ty);
+
+		state->set_var(def->name(), ty, val_llvm);
 		state->builder()->CreateStore(rvalue_llvm, val_llvm);
 		return val_llvm;
 	}
+
+	void llvm_compile_scope_release(llvm_state *state){
+		for(auto &&var : state->owned_vars()){
+			auto val = state->builder()->CreateLoad(var.first);
+			if(is_big_real(var.second))
+				llvm_compile_big_real_release(val, state);
+			else
+				llvm_compile_tagged_integer_release(val, state);
+		}
+	}
 }
@@ -0,0 +1,151 @@
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include "inline_cache.hpp"
+
+namespace purson{
+	namespace{
+		std::size_t num_instructions(const llvm::Function &fn){
+			std::size_t ret = 0;
+			for(auto &&bb : fn)
+				ret += bb.size();
+
+			return ret;
+		}
+
+		//! @returns a module with only the functions keep accepts defined and only what they reference declared
+		template<typename Keep>
+		std::unique_ptr<llvm::Module> extract_fns(const llvm::Module &mod, Keep &&keep){
+			llvm::ValueToValueMapTy vmap;
+			auto ret = llvm::CloneModule(&mod, vmap, [&keep](const llvm::GlobalValue *gv){
+				auto fn = llvm::dyn_cast<llvm::Function>(gv);
+				return fn && keep(*fn);
+			});
+
+			for(auto it = ret->begin(); it != ret->end();){
+				auto &&other = *it++;
+				if(other.isDeclaration() && other.use_empty())
+					other.eraseFromParent();
+			}
+
+			for(auto it = ret->global_begin(); it != ret->global_end();){
+				auto &&global = *it++;
+				if(global.isDeclaration() && global.use_empty())
+					global.eraseFromParent();
+			}
+
+			return ret;
+		}
+	}
+
+	std::vector<llvm_inline_cache::fn_body> llvm_inline_cache::extract_bodies(const llvm::Module &mod, llvm::TargetMachine &tm, opt_level opt){
+		std::vector<fn_body> bodies;
+
+		// nothing would be inlined
+		if(opt == opt_level::O0) return bodies;
+
+		std::map<std::string, std::size_t, std::less<>> sizes;
+		for(auto &&fn : mod){
+			if(fn.isDeclaration() || fn.hasLocalLinkage())
+				continue;
+
+			auto size = num_instructions(fn);
+			if(size <= hot)
+				sizes.emplace(fn.getName().str(), size);
+		}
+
+		if(sizes.empty()) return bodies;
+
+		// one copy of the importable functions optimized together, the rest only declared, then each is split off that
+		auto importable = extract_fns(mod, [&sizes](const llvm::Function &fn){ return sizes.count(fn.getName()) > 0; });
+		llvm_optimize_module(*importable, tm, opt);
+
+		for(auto &&[name, size] : sizes){
+			auto fn = importable->getFunction(name);
+			if(!fn || fn->isDeclaration())
+				continue;
+
+			auto body = extract_fns(*importable, [fn](const llvm::Function &other){ return &other == fn; });
+
+			std::string bitcode;
+			{
+				llvm::raw_string_ostream os(bitcode);
+				llvm::WriteBitcodeToFile(body.get(), os);
+			}
+
+			bodies.push_back({name, size, std::move(bitcode)});
+		}
+
+		return bodies;
+	}
+
+	void llvm_inline_cache::add_bodies(std::vector<fn_body> bodies, const void *owner){
+		std::lock_guard lock(m_mut);
+		for(auto &&body : bodies)
+			m_bodies.insert_or_assign(std::move(body.name), owned_body{owner, body.size, std::move(body.bitcode)});
+	}
+
+	void llvm_inline_cache::mark_hot(llvm::StringRef name){
+		std::lock_guard lock(m_mut);
+		m_hot.insert(name.str());
+	}
+
+	void llvm_inline_cache::forget(const void *owner){
+		std::lock_guard lock(m_mut);
+		for(auto it = begin(m_bodies); it != end(m_bodies);){
+			if(it->second.owner == owner){
+				m_hot.erase(it->first);
+				it = m_bodies.erase(it);
+			}
+			else
+				++it;
+		}
+	}
+
+	std::size_t llvm_inline_cache::import_into(llvm::Module &mod) const{
+		// copied out so compile threads only wait on each other for the lookups
+		std::vector<std::pair<llvm::Function*, std::string>> wanted;
+		{
+			std::lock_guard lock(m_mut);
+			for(auto &&fn : mod){
+				if(!fn.isDeclaration() || fn.isIntrinsic())
+					continue;
+
+				auto res = m_bodies.find(fn.getName());
+				if(res == end(m_bodies))
+					continue;
+
+				if((res->second.size <= small) || m_hot.count(res->first))
+					wanted.emplace_back(&fn, res->second.bitcode);
+			}
+		}
+
+		std::size_t ret = 0;
+		for(auto &&[decl, bitcode] : wanted){
+			auto name = decl->getName();
+
+			auto buffer = llvm::MemoryBuffer::getMemBuffer(bitcode, name, false);
+			auto src = llvm::parseBitcodeFile(buffer->getMemBufferRef(), mod.getContext());
+			if(!src){
+				llvm::consumeError(src.takeError());
+				continue;
+			}
+
+			// the callee may have been redefined with another signature since
+			auto fn = (*src)->getFunction(name);
+			if(!fn || fn->isDeclaration() || (fn->getFunctionType() != decl->getFunctionType()))
+				continue;
+
+			// only there to be inlined, the module's own definition is still called otherwise
+			fn->setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+
+			if(!llvm::Linker::linkModules(mod, std::move(*src)))
+				++ret;
+		}
+
+		return ret;
+	}
+}
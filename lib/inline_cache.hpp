@@ -0,0 +1,78 @@
+#ifndef PURSON_LIB_INLINE_CACHE_HPP
+#define PURSON_LIB_INLINE_CACHE_HPP 1
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "llvm.hpp"
+
+namespace purson{
+	/**
+	 * Optimized bodies of exported functions, for inlining across jit modules.
+	 *
+	 * A module's small enough externally visible functions are optimized
+	 * together, apart from the rest of the module, and each is kept as
+	 * bitcode once it's added to the jit. Modules compiled later
+	 * get copies of the small or hot ones they call as available_externally
+	 * definitions, which the optimizer may inline but never emits.
+	 *
+	 * Code that inlined a body keeps it, so only modules whose functions
+	 * can never be reloaded have their bodies kept.
+	 *
+	 * Bodies are bitcode, so they can be imported in to any context, and
+	 * the cache is safe to use from the compile threads.
+	 **/
+	class llvm_inline_cache{
+		public:
+			struct fn_body{
+				std::string name;
+				std::size_t size;
+				std::string bitcode;
+			};
+
+			//! instructions a function may have to always be imported
+			static constexpr std::size_t small = 32;
+
+			//! instructions a function may have to be imported once it's hot
+			static constexpr std::size_t hot = 256;
+
+			/**
+			 * Optimize and extract the bodies of the importable functions of a module, on any thread
+			 *
+			 * @param[in] mod module before anything was imported in to it
+			 * @param[in] tm target machine to optimize for
+			 **/
+			static std::vector<fn_body> extract_bodies(const llvm::Module &mod, llvm::TargetMachine &tm, opt_level opt);
+
+			/**
+			 * Keep bodies from extract_bodies once their module is in the jit
+			 *
+			 * @param[in] owner what the bodies are forgotten by
+			 **/
+			void add_bodies(std::vector<fn_body> bodies, const void *owner);
+
+			//! allow a function up to the hot size to be imported
+			void mark_hot(llvm::StringRef name);
+
+			//! forget every body kept for owner, modules already compiled keep what they inlined
+			void forget(const void *owner);
+
+			//! @returns the number of bodies imported for declarations in mod
+			std::size_t import_into(llvm::Module &mod) const;
+
+		private:
+			struct owned_body{
+				const void *owner;
+				std::size_t size;
+				std::string bitcode;
+			};
+
+			mutable std::mutex m_mut;
+			std::map<std::string, owned_body, std::less<>> m_bodies;
+			std::set<std::string, std::less<>> m_hot;
+	};
+}
+
+#endif // !PURSON_LIB_INLINE_CACHE_HPP
@@ -0,0 +1,457 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include <dlfcn.h>
+
+#include "fmt/core.h"
+
+#include "purson/module.hpp"
+
+#include "runtime/runtime.hpp"
+#include "bytecode.hpp"
+
+namespace purson{
+	namespace{
+		//! registers shared by every frame, only allocated once something's interpreted
+		constexpr std::size_t interp_stack_slots = 1024 * 1024;
+
+		//! nested interpreted calls before giving up, well short of overflowing the native stack
+		constexpr std::size_t interp_max_depth = 10000;
+
+		constexpr std::uint64_t default_tier_up_threshold = 1000;
+
+		double as_double(std::uint64_t bits) noexcept{
+			double ret;
+			std::memcpy(&ret, &bits, sizeof(ret));
+			return ret;
+		}
+
+		std::uint64_t as_bits(double val) noexcept{
+			std::uint64_t ret;
+			std::memcpy(&ret, &val, sizeof(ret));
+			return ret;
+		}
+
+		std::uint64_t extend_result(std::uint64_t val, const bc_native_sig &sig) noexcept{
+			if(!sig.ret_width) return val;
+
+			auto shift = 64 - sig.ret_width;
+			if(sig.ret_signed)
+				return static_cast<std::uint64_t>(static_cast<std::int64_t>(val << shift) >> shift);
+			else
+				return val & ((std::uint64_t(1) << sig.ret_width) - 1);
+		}
+
+		template<typename T>
+		bool compare(T lhs, T rhs, std::uint8_t cond) noexcept{
+			switch(static_cast<bc_cond>(cond)){
+				case bc_cond::eq: return lhs == rhs;
+				// ordered like the jit's, so nan is never unequal either
+				case bc_cond::ne: return (lhs < rhs) || (lhs > rhs);
+				case bc_cond::lt: return lhs < rhs;
+				case bc_cond::gt: return lhs > rhs;
+				case bc_cond::le: return lhs <= rhs;
+				case bc_cond::ge: return lhs >= rhs;
+				default: return false;
+			}
+		}
+
+		template<typename Arg>
+		Arg from_reg(std::uint64_t reg) noexcept{
+			if constexpr(std::is_same_v<Arg, double>)
+				return as_double(reg);
+			else
+				return reg;
+		}
+
+		template<typename Arg, std::size_t Idx>
+		using arg_t = Arg;
+
+		template<typename Arg, typename Ret, std::size_t ... Is>
+		Ret call_with(void *fn, const std::uint64_t *args, std::index_sequence<Is...>){
+			using fn_type = Ret(*)(arg_t<Arg, Is>...);
+			return reinterpret_cast<fn_type>(fn)(from_reg<Arg>(args[Is])...);
+		}
+
+		template<typename Arg, std::size_t N>
+		std::uint64_t call_native_n(void *fn, const bc_native_sig &sig, const std::uint64_t *args){
+			constexpr auto idxs = std::make_index_sequence<N>();
+
+			switch(sig.ret){
+				case bc_native_sig::kind::ints: return extend_result(call_with<Arg, std::uint64_t>(fn, args, idxs), sig);
+				case bc_native_sig::kind::doubles: return as_bits(call_with<Arg, double>(fn, args, idxs));
+
+				default:
+					call_with<Arg, void>(fn, args, idxs);
+					return 0;
+			}
+		}
+
+		template<typename Arg>
+		std::uint64_t call_native_args(void *fn, const bc_native_sig &sig, const std::uint64_t *args){
+			switch(sig.num_params){
+				case 0: return call_native_n<Arg, 0>(fn, sig, args);
+				case 1: return call_native_n<Arg, 1>(fn, sig, args);
+				case 2: return call_native_n<Arg, 2>(fn, sig, args);
+				case 3: return call_native_n<Arg, 3>(fn, sig, args);
+				case 4: return call_native_n<Arg, 4>(fn, sig, args);
+				case 5: return call_native_n<Arg, 5>(fn, sig, args);
+				case 6: return call_native_n<Arg, 6>(fn, sig, args);
+				default: throw module_error{"too many arguments for a native call"};
+			}
+		}
+
+		//! call native code with the c calling convention, sig must be supported
+		std::uint64_t call_native(void *fn, const bc_native_sig &sig, const std::uint64_t *args){
+			if(sig.params == bc_native_sig::kind::doubles)
+				return call_native_args<double>(fn, sig, args);
+			else
+				return call_native_args<std::uint64_t>(fn, sig, args);
+		}
+	}
+
+	class bc_interp_moduleset;
+
+	class bc_interp_module: public module{
+		public:
+			bc_interp_module(bc_interp_moduleset &set, std::unique_ptr<bc_module> mod)
+				: m_set(set), m_mod(std::move(mod)){}
+
+			void *get_fn_ptr(std::string_view mangled_name) override;
+
+			void write(std::string_view) override{
+				throw module_error{"interpreted modules can't be written, use an object moduleset"};
+			}
+
+			bc_module *bytecode() noexcept{ return m_mod.get(); }
+
+			jit_module *jit_mod() const noexcept{ return m_jit_mod; }
+			void set_jit_mod(jit_module *mod) noexcept{ m_jit_mod = mod; }
+
+		private:
+			bc_interp_moduleset &m_set;
+			std::unique_ptr<bc_module> m_mod;
+
+			//! same module compiled by the jit, once there is one
+			jit_module *m_jit_mod = nullptr;
+	};
+
+	class bc_interp_moduleset: public interp_moduleset{
+		public:
+			explicit bc_interp_moduleset(std::function<std::unique_ptr<jit_moduleset>()> make_jit)
+				: m_make_jit(std::move(make_jit)){}
+
+			module *create_module(std::string_view name, const std::vector<std::shared_ptr<const expr>> &ast) override{
+				auto mod = std::make_unique<bc_interp_module>(*this, bc_compile_module(name, ast));
+
+				if(m_jit)
+					mod->set_jit_mod(m_jit->create_module(mod->bytecode()->name, mod->bytecode()->ast));
+
+				return m_mods.emplace_back(std::move(mod)).get();
+			}
+
+			bool destroy_module(const module *mod) noexcept override{
+				auto res = std::find_if(begin(m_mods), end(m_mods), [mod](auto &&ptr){ return ptr.get() == mod; });
+				if(res == end(m_mods)) return false;
+
+				if(m_jit && (*res)->jit_mod())
+					m_jit->destroy_module((*res)->jit_mod());
+
+				m_mods.erase(res);
+
+				// calls are resolved again, they could have gone to the destroyed module
+				for(auto &&other : m_mods){
+					for(auto &&fn : other->bytecode()->fns){
+						for(auto &&callee : fn->callees){
+							callee.fn = nullptr;
+							callee.native = nullptr;
+						}
+					}
+				}
+
+				return true;
+			}
+
+			void *get_fn_ptr(std::string_view mangled_name) override{
+				return jit().get_fn_ptr(mangled_name);
+			}
+
+			std::uint64_t call(std::string_view mangled_name, const std::vector<std::uint64_t> &args) override{
+				auto fn = find_fn(mangled_name);
+				if(!fn)
+					throw module_error{fmt::format("function '{}' is not defined", mangled_name)};
+				else if(args.size() != fn->num_params)
+					throw module_error{fmt::format("function '{}' takes {} arguments, {} given", mangled_name, fn->num_params, args.size())};
+
+				return invoke(*fn, args.data());
+			}
+
+			void set_tier_up_threshold(std::uint64_t calls) noexcept override{ m_threshold = calls; }
+
+			//! @returns the jit, making it and compiling every module with it the first time
+			jit_moduleset &jit(){
+				if(m_jit) return *m_jit;
+
+				auto made = m_make_jit ? m_make_jit() : make_jit_moduleset();
+				if(!made)
+					throw module_error{"could not create a jit to tier up to"};
+
+				std::vector<jit_moduleset::module_source> srcs;
+				srcs.reserve(m_mods.size());
+				for(auto &&mod : m_mods)
+					srcs.emplace_back(mod->bytecode()->name, mod->bytecode()->ast);
+
+				auto jit_mods = made->create_modules(srcs);
+				for(std::size_t i = 0; i < m_mods.size(); i++)
+					m_mods[i]->set_jit_mod(jit_mods[i]);
+
+				m_jit = std::move(made);
+				return *m_jit;
+			}
+
+		private:
+			std::function<std::unique_ptr<jit_moduleset>()> m_make_jit;
+			std::unique_ptr<jit_moduleset> m_jit;
+			std::vector<std::unique_ptr<bc_interp_module>> m_mods;
+
+			std::uint64_t m_threshold = default_tier_up_threshold;
+
+			std::unique_ptr<std::uint64_t[]> m_stack;
+			std::size_t m_sp = 0;
+			std::size_t m_depth = 0;
+
+			bc_function *find_fn(std::string_view mangled_name) const{
+				for(auto &&mod : m_mods){
+					auto &&fns = mod->bytecode()->fn_by_name;
+					auto res = fns.find(mangled_name);
+					if(res != end(fns))
+						return res->second;
+				}
+
+				return nullptr;
+			}
+
+			void tier_up(bc_function &fn){
+				auto mod = std::find_if(begin(m_mods), end(m_mods), [&fn](auto &&ptr){ return ptr->bytecode() == fn.owner; });
+				jit();
+
+				if(mod != end(m_mods) && (*mod)->jit_mod())
+					fn.native = (*mod)->jit_mod()->get_fn_ptr(fn.mangled_name);
+
+				if(!fn.native && fn.native_only)
+					throw module_error{fmt::format("could not compile function '{}'", fn.mangled_name)};
+			}
+
+			std::uint64_t invoke(bc_function &fn, const std::uint64_t *args){
+				if(!fn.native){
+					if(fn.native_only){
+						if(!fn.sig.supported)
+							throw module_error{fmt::format("function '{}' can't be called from the interpreter", fn.mangled_name)};
+
+						tier_up(fn);
+					}
+					else if(m_threshold && fn.sig.supported && (++fn.calls == m_threshold))
+						tier_up(fn);
+				}
+
+				if(fn.native)
+					return call_native(fn.native, fn.sig, args);
+
+				return run(fn, args);
+			}
+
+			void resolve(const bc_function &caller, bc_callee &callee){
+				auto &&own = caller.owner->fn_by_name;
+				if(auto res = own.find(callee.mangled_name); res != end(own)){
+					callee.fn = res->second;
+					return;
+				}
+
+				for(auto &&mod : m_mods){
+					auto &&fns = mod->bytecode()->fn_by_name;
+					auto res = fns.find(callee.mangled_name);
+					if((res != end(fns)) && res->second->exported){
+						callee.fn = res->second;
+						return;
+					}
+				}
+
+				if(auto addr = runtime_symbol(callee.mangled_name))
+					callee.native = reinterpret_cast<void*>(addr);
+				else
+					callee.native = dlsym(RTLD_DEFAULT, callee.mangled_name.c_str());
+
+				if(!callee.native)
+					throw module_error{fmt::format("function '{}' is not defined", callee.mangled_name)};
+				else if(!callee.sig.supported){
+					callee.native = nullptr;
+					throw module_error{fmt::format("function '{}' can't be called from the interpreter", callee.mangled_name)};
+				}
+			}
+
+			std::uint64_t run(bc_function &fn, const std::uint64_t *args);
+	};
+
+	void *bc_interp_module::get_fn_ptr(std::string_view mangled_name){
+		m_set.jit();
+		return m_jit_mod ? m_jit_mod->get_fn_ptr(mangled_name) : nullptr;
+	}
+
+	std::uint64_t bc_interp_moduleset::run(bc_function &fn, const std::uint64_t *args){
+		// direct threaded, each handler jumps straight to the next one's
+		static const void *const labels[] = {
+			&&op_load_k, &&op_move,
+			&&op_add, &&op_sub, &&op_mul,
+			&&op_sdiv, &&op_udiv,
+			&&op_fadd, &&op_fsub, &&op_fmul, &&op_fdiv,
+			&&op_scmp, &&op_ucmp, &&op_fcmp,
+			&&op_sext, &&op_zext,
+			&&op_sitof, &&op_uitof, &&op_ftosi, &&op_ftoui,
+			&&op_fround32,
+			&&op_int_add, &&op_int_sub, &&op_nat_sub, &&op_int_mul, &&op_int_div,
+			&&op_int_cmp,
+			&&op_int_from_i64, &&op_int_from_u64, &&op_int_from_f64, &&op_int_from_str,
+			&&op_int_to_i64, &&op_int_to_f64,
+			&&op_int_copy, &&op_int_release,
+			&&op_call,
+			&&op_ret,
+			&&op_ret_void
+		};
+
+		static_assert((sizeof(labels) / sizeof(*labels)) == static_cast<std::size_t>(bc_op::count_), "missing bytecode handlers");
+
+		if(m_depth == interp_max_depth)
+			throw module_error{"interpreter call stack overflow"};
+
+		if(!m_stack)
+			m_stack = std::make_unique<std::uint64_t[]>(interp_stack_slots);
+
+		if(fn.num_regs > (interp_stack_slots - m_sp))
+			throw module_error{"interpreter call stack overflow"};
+
+		if(fn.handlers.empty()){
+			fn.handlers.reserve(fn.code.size());
+			for(auto &&instr : fn.code)
+				fn.handlers.push_back(labels[static_cast<std::size_t>(instr.op)]);
+		}
+
+		// the caller's arguments are in its own frame, right below this one
+		auto regs = m_stack.get() + m_sp;
+		std::fill_n(regs, fn.num_regs, 0);
+		std::copy_n(args, fn.num_params, regs);
+
+		struct frame_guard{
+			bc_interp_moduleset &set;
+			std::size_t sp;
+
+			~frame_guard(){
+				set.m_sp = sp;
+				--set.m_depth;
+			}
+		} guard{*this, m_sp};
+
+		m_sp += fn.num_regs;
+		++m_depth;
+
+		auto code = fn.code.data();
+		auto handlers = fn.handlers.data();
+		auto consts = fn.consts.data();
+		const bc_instr *ins = nullptr;
+		std::size_t pc = 0;
+
+#define PURSON_BC_NEXT() ins = &code[pc]; goto *handlers[pc++]
+#define PURSON_BC_BINOP(expr) { auto lhs = regs[ins->b], rhs = regs[ins->c]; regs[ins->a] = (expr); } PURSON_BC_NEXT()
+
+		PURSON_BC_NEXT();
+
+	op_load_k: regs[ins->a] = consts[ins->b]; PURSON_BC_NEXT();
+	op_move: regs[ins->a] = regs[ins->b]; PURSON_BC_NEXT();
+
+	op_add: PURSON_BC_BINOP(lhs + rhs);
+	op_sub: PURSON_BC_BINOP(lhs - rhs);
+	op_mul: PURSON_BC_BINOP(lhs * rhs);
+
+	op_sdiv:{
+		auto lhs = static_cast<std::int64_t>(regs[ins->b]), rhs = static_cast<std::int64_t>(regs[ins->c]);
+		if(rhs == 0)
+			purson_div_zero();
+		else if((rhs == -1) && (lhs == std::numeric_limits<std::int64_t>::min()))
+			regs[ins->a] = static_cast<std::uint64_t>(lhs);
+		else
+			regs[ins->a] = static_cast<std::uint64_t>(lhs / rhs);
+
+		PURSON_BC_NEXT();
+	}
+
+	op_udiv:{
+		if(regs[ins->c] == 0)
+			purson_div_zero();
+
+		regs[ins->a] = regs[ins->b] / regs[ins->c];
+		PURSON_BC_NEXT();
+	}
+
+	op_fadd: PURSON_BC_BINOP(as_bits(as_double(lhs) + as_double(rhs)));
+	op_fsub: PURSON_BC_BINOP(as_bits(as_double(lhs) - as_double(rhs)));
+	op_fmul: PURSON_BC_BINOP(as_bits(as_double(lhs) * as_double(rhs)));
+	op_fdiv: PURSON_BC_BINOP(as_bits(as_double(lhs) / as_double(rhs)));
+
+	op_scmp: PURSON_BC_BINOP(compare(static_cast<std::int64_t>(lhs), static_cast<std::int64_t>(rhs), ins->width));
+	op_ucmp: PURSON_BC_BINOP(compare(lhs, rhs, ins->width));
+	op_fcmp: PURSON_BC_BINOP(compare(as_double(lhs), as_double(rhs), ins->width));
+
+	op_sext:{
+		auto shift = 64 - ins->width;
+		regs[ins->a] = static_cast<std::uint64_t>(static_cast<std::int64_t>(regs[ins->b] << shift) >> shift);
+		PURSON_BC_NEXT();
+	}
+
+	op_zext: regs[ins->a] = regs[ins->b] & ((std::uint64_t(1) << ins->width) - 1); PURSON_BC_NEXT();
+
+	op_sitof: regs[ins->a] = as_bits(static_cast<double>(static_cast<std::int64_t>(regs[ins->b]))); PURSON_BC_NEXT();
+	op_uitof: regs[ins->a] = as_bits(static_cast<double>(regs[ins->b])); PURSON_BC_NEXT();
+	op_ftosi: regs[ins->a] = static_cast<std::uint64_t>(static_cast<std::int64_t>(as_double(regs[ins->b]))); PURSON_BC_NEXT();
+	op_ftoui: regs[ins->a] = static_cast<std::uint64_t>(as_double(regs[ins->b])); PURSON_BC_NEXT();
+	op_fround32: regs[ins->a] = as_bits(static_cast<float>(as_double(regs[ins->b]))); PURSON_BC_NEXT();
+
+	op_int_add: PURSON_BC_BINOP(purson_int_add(lhs, rhs));
+	op_int_sub: PURSON_BC_BINOP(purson_int_sub(lhs, rhs));
+	op_nat_sub: PURSON_BC_BINOP(purson_nat_sub(lhs, rhs));
+	op_int_mul: PURSON_BC_BINOP(purson_int_mul(lhs, rhs));
+	op_int_div: PURSON_BC_BINOP(purson_int_div(lhs, rhs));
+
+	op_int_cmp: PURSON_BC_BINOP(compare<std::int32_t>(purson_int_cmp(lhs, rhs), 0, ins->width));
+
+	op_int_from_i64: regs[ins->a] = purson_int_from_i64(regs[ins->b]); PURSON_BC_NEXT();
+	op_int_from_u64: regs[ins->a] = purson_int_from_u64(regs[ins->b]); PURSON_BC_NEXT();
+	op_int_from_f64: regs[ins->a] = purson_int_from_f64(as_double(regs[ins->b])); PURSON_BC_NEXT();
+	op_int_from_str: regs[ins->a] = purson_int_from_str(fn.strings[ins->b].c_str()); PURSON_BC_NEXT();
+	op_int_to_i64: regs[ins->a] = purson_int_to_i64(regs[ins->b]); PURSON_BC_NEXT();
+	op_int_to_f64: regs[ins->a] = as_bits(purson_int_to_f64(regs[ins->b])); PURSON_BC_NEXT();
+	op_int_copy: regs[ins->a] = purson_int_copy(regs[ins->b]); PURSON_BC_NEXT();
+	op_int_release: purson_int_release(regs[ins->a]); PURSON_BC_NEXT();
+
+	op_call:{
+		auto &&callee = fn.callees[ins->b];
+		if(!callee.fn && !callee.native)
+			resolve(fn, callee);
+
+		auto call_args = regs + ins->c;
+		regs[ins->a] = callee.fn ? invoke(*callee.fn, call_args) : call_native(callee.native, callee.sig, call_args);
+		PURSON_BC_NEXT();
+	}
+
+	op_ret: return regs[ins->a];
+	op_ret_void: return 0;
+
+#undef PURSON_BC_BINOP
+#undef PURSON_BC_NEXT
+	}
+
+	std::unique_ptr<interp_moduleset> make_interp_moduleset(std::function<std::unique_ptr<jit_moduleset>()> make_jit){
+		return std::make_unique<bc_interp_moduleset>(std::move(make_jit));
+	}
+}
@@ -88,7 +88,7 @@ namespace purson{
 					
 					auto cp_data = next_cp();
 					cp = cp_data.cp;
-					line = cp_data.cp;
+					line = cp_data.line;
 					col = cp_data.col;
 				}
 				
@@ -99,11 +99,13 @@ namespace purson{
 				else
 					tok_type = token_type::id;
 			}
-			else if(u_isdigit(cp)){ // integers, reals
+			else if(u_isdigit(cp)){ // integers, reals, imaginaries
 				bool zero_base = false;
 				
 				if(cp == '0') zero_base = true;
 				
+				tok_type = token_type::integer;
+				
 				if(it != it_end){
 					while(1){
 						if(it == it_end) break;
@@ -129,12 +131,21 @@ namespace purson{
 						
 						auto cp_data = next_cp();
 						cp = cp_data.cp;
-						line = cp_data.cp;
+						line = cp_data.line;
 						col = cp_data.col;
 					}
 				}
 				
-				tok_type = token_type::integer;
+				// trailing 'i' makes an imaginary constant
+				if((it != it_end) && (utf8::peek_next(it, it_end) == 'i')){
+					auto cp_data = next_cp();
+					cp = cp_data.cp;
+					line = cp_data.line;
+					col = cp_data.col;
+					
+					tok_type = token_type::imaginary;
+				}
+				
 				tok_size = std::distance(tok_start, it);
 				
 				if(tok_size == 2){
@@ -155,7 +166,7 @@ namespace purson{
 					while(1){
 						auto cp_data = next_cp();
 						cp = cp_data.cp;
-						line = cp_data.cp;
+						line = cp_data.line;
 						col = cp_data.col;
 
 						if(it == it_end) break;
@@ -163,7 +174,7 @@ namespace purson{
 						else if(cp == '\\'){
 							auto cp_data = next_cp();
 							cp = cp_data.cp;
-							line = cp_data.cp;
+							line = cp_data.line;
 							col = cp_data.col;
 
 							switch(cp){
@@ -205,7 +216,7 @@ namespace purson{
 					
 					auto cp_data = next_cp();
 					cp = cp_data.cp;
-					line = cp_data.cp;
+					line = cp_data.line;
 					col = cp_data.col;
 				}
 				
@@ -2,6 +2,65 @@
 #include "llvm.hpp"
 
 namespace purson{
+	namespace{
+		/**
+		 * Integer division that agrees with the interpreter: a zero divisor throws from the runtime,
+		 * and the most negative value divided by -1 wraps to itself instead of trapping in the cpu.
+		 **/
+		llvm::Value *checked_div(llvm::Value *lhs, llvm::Value *rhs, bool is_signed, llvm_state *state){
+			auto builder = state->builder();
+			auto int_ty = llvm::cast<llvm::IntegerType>(lhs->getType());
+			auto fn = builder->GetInsertBlock()->getParent();
+			auto zero_bb = llvm::BasicBlock::Create(llvm_ctx, "div.zero", fn);
+			auto ok_bb = llvm::BasicBlock::Create(llvm_ctx, "div.ok", fn);
+
+			builder->CreateCondBr(builder->CreateICmpEQ(rhs, llvm::ConstantInt::get(int_ty, 0)), zero_bb, ok_bb);
+
+			builder->SetInsertPoint(zero_bb);
+			llvm_call_runtime(*builder, "purson_div_zero", builder->getVoidTy(), {});
+			builder->CreateUnreachable();
+
+			builder->SetInsertPoint(ok_bb);
+			if(!is_signed)
+				return builder->CreateUDiv(lhs, rhs);
+
+			// dividing by 1 instead gives the wrapped result
+			auto min = llvm::ConstantInt::get(int_ty, llvm::APInt::getSignedMinValue(int_ty->getBitWidth()));
+			auto overflows = builder->CreateAnd(
+				builder->CreateICmpEQ(lhs, min),
+				builder->CreateICmpEQ(rhs, llvm::ConstantInt::getSigned(int_ty, -1))
+			);
+
+			auto divisor = builder->CreateSelect(overflows, llvm::ConstantInt::get(int_ty, 1), rhs);
+			return builder->CreateSDiv(lhs, divisor);
+		}
+	}
+
+	llvm::Type *llvm_lower_type(const type *ty){
+		if(!ty) return nullptr;
+		else if(auto unit = dynamic_cast<const unit_type*>(ty)) return llvm_type(unit);
+		else if(auto boolean = dynamic_cast<const boolean_type*>(ty)) return llvm_type(boolean);
+		else if(auto complex = dynamic_cast<const complex_type*>(ty)) return llvm_type(complex);
+		else if(auto real = dynamic_cast<const real_type*>(ty)) return llvm_type(real);
+		else if(auto rational = dynamic_cast<const rational_type*>(ty)) return llvm_type(rational);
+		else if(auto int_ = dynamic_cast<const integer_type*>(ty)) return llvm_type(int_);
+		else if(auto natural = dynamic_cast<const natural_type*>(ty)) return llvm_type(natural);
+		else if(auto type = dynamic_cast<const type_type*>(ty)) return llvm_type(type);
+		else if(auto num_members = ty->num_members()){
+			// members go through the cache so shared member types are only lowered once
+			std::vector<llvm::Type*> member_tys;
+			member_tys.reserve(num_members);
+
+			auto members = ty->members();
+			for(std::size_t i = 0; i < num_members; i++)
+				member_tys.push_back(llvm_type(members[i].second));
+
+			return llvm::StructType::get(llvm_ctx, member_tys);
+		}
+
+		throw module_error{fmt::format("could not get llvm type for type '{}'", ty->str())};
+	}
+
 	llvm::Value *llvm_compile(const expr *expr_, llvm_state *state){
 		if(auto rvalue = dynamic_cast<const rvalue_expr*>(expr_))
 			return llvm_compile_rvalue(rvalue, state);
@@ -42,11 +101,24 @@ namespace purson{
 			if(!state->builder())
 				throw module_error{"return expression outside of a function body"};
 
-			if(dynamic_cast<const unit_type*>(ret->value()->value_type()))
+			if(dynamic_cast<const unit_type*>(ret->value()->value_type())){
+				llvm_compile_scope_release(state);
 				return state->builder()->CreateRetVoid();
+			}
 			else{
 				try{
-					auto llvm_ret_val = llvm_compile_rvalue(ret->value(), state);
+					auto ret_ty = ret->value_type();
+
+					// the caller owns a returned value, so one still referenced here is copied
+					auto llvm_ret_val = llvm_compile_owned(ret->value(), ret_ty, state);
+
+					// rationals are only reduced once they leave the function
+					if(numeric_category_of(ret->value_type()) == numeric_category::rational){
+						auto rational_ty = dynamic_cast<const rational_type*>(ret->value_type());
+						llvm_ret_val = llvm_compile_rational_normalize(llvm_ret_val, rational_ty, state);
+					}
+
+					llvm_compile_scope_release(state);
 					return state->builder()->CreateRet(llvm_ret_val);
 				}
 				catch(const module_error &err){
@@ -63,107 +135,102 @@ namespace purson{
 	}
 
 	llvm::Value *llvm_compile_binop(const binary_op_expr *binop, llvm_state *state){
-		auto lhs_val = llvm_compile_rvalue(binop->lhs().get(), state);
-		auto rhs_val = llvm_compile_rvalue(binop->rhs().get(), state);
-
 		auto lhs_ty = binop->lhs()->value_type();
 		auto rhs_ty = binop->rhs()->value_type();
 
 		auto higher_ty = promote_type(lhs_ty, rhs_ty);
-		auto llvm_ty = llvm_type(higher_ty);
 
-		if(lhs_ty == higher_ty){
-			if(auto nat = dynamic_cast<const natural_type*>(lhs_ty)){
-				rhs_val = state->builder()->CreateIntCast(rhs_val, llvm_ty, false);
-			}
-			else if(auto int_ = dynamic_cast<const integer_type*>(lhs_ty)){
-				if(dynamic_cast<const natural_type*>(rhs_ty)){
-					rhs_val = state->builder()->CreateCast(llvm::CastInst::CastOps::SExt, rhs_val, llvm_ty);
-				}
-				else{
-					rhs_val = state->builder()->CreateIntCast(rhs_val, llvm_ty, true);
-				}
-			}
-			else if(auto rational = dynamic_cast<const rational_type*>(lhs_ty)){
-				throw module_error{"rational compilation currently unsupported"};
-			}
-			else if(auto real = dynamic_cast<const real_type*>(lhs_ty)){
-				if(dynamic_cast<const rational_type*>(rhs_ty)){
-					throw module_error{"rational compilation currently unsupported"};
-				}
-				else if(dynamic_cast<const integer_type*>(rhs_ty)){
-					rhs_val = state->builder()->CreateCast(llvm::CastInst::CastOps::SIToFP, rhs_val, llvm_ty);
-				}
-				else if(dynamic_cast<const natural_type*>(rhs_ty)){
-					rhs_val = state->builder()->CreateCast(llvm::CastInst::CastOps::UIToFP, rhs_val, llvm_ty);
-				}
-				else{
-					rhs_val = state->builder()->CreateCast(llvm::CastInst::CastOps::SIToFP, rhs_val, llvm_ty);
-				}
-			}
-			else
-				throw module_error{"unexpected type in compilation"};
-		}
-		else{
-			if(auto nat = dynamic_cast<const natural_type*>(rhs_ty)){
-				lhs_val = state->builder()->CreateIntCast(lhs_val, llvm_ty, false);
-			}
-			else if(auto int_ = dynamic_cast<const integer_type*>(rhs_ty)){
-				if(dynamic_cast<const natural_type*>(lhs_ty)){
-					lhs_val = state->builder()->CreateCast(llvm::CastInst::CastOps::SExt, lhs_val, llvm_ty);
-				}
-				else{
-					lhs_val = state->builder()->CreateIntCast(lhs_val, llvm_ty, true);
-				}
-			}
-			else if(auto rational = dynamic_cast<const rational_type*>(rhs_ty)){
-				throw module_error{"rational compilation currently unsupported"};
-			}
-			else if(auto real = dynamic_cast<const real_type*>(rhs_ty)){
-				if(dynamic_cast<const rational_type*>(lhs_ty)){
-					throw module_error{"rational compilation currently unsupported"};
-				}
-				else if(dynamic_cast<const integer_type*>(lhs_ty)){
-					lhs_val = state->builder()->CreateCast(llvm::CastInst::CastOps::SIToFP, lhs_val, llvm_ty);
-				}
-				else if(dynamic_cast<const natural_type*>(lhs_ty)){
-					lhs_val = state->builder()->CreateCast(llvm::CastInst::CastOps::UIToFP, lhs_val, llvm_ty);
-				}
-				else{
-					lhs_val = state->builder()->CreateCast(llvm::CastInst::CastOps::SIToFP, lhs_val, llvm_ty);
-				}
-			}
-			else
-				throw module_error{"unexpected type in compilation"};
-		}
+		// folds constants and manages runtime temporaries itself
+		if(is_big_real(higher_ty))
+			return llvm_compile_big_real_binop(binop, dynamic_cast<const real_type*>(higher_ty), state);
+		else if(is_tagged_integer(higher_ty))
+			return llvm_compile_tagged_integer_binop(binop, dynamic_cast<const natural_type*>(higher_ty), state);
 
-		switch(binop->operator_().op_type()){
+		auto lhs_val = llvm_compile_rvalue(binop->lhs().get(), state);
+		auto rhs_val = llvm_compile_rvalue(binop->rhs().get(), state);
+
+		lhs_val = llvm_compile_cast(lhs_val, lhs_ty, higher_ty, state);
+		rhs_val = llvm_compile_cast(rhs_val, rhs_ty, higher_ty, state);
+
+		auto category = numeric_category_of(higher_ty);
+		auto op_ty = binop->operator_().op_type();
+
+		if(category == numeric_category::complex)
+			return llvm_compile_complex_op(op_ty, dynamic_cast<const complex_type*>(higher_ty), lhs_val, rhs_val, state);
+		else if(category == numeric_category::rational)
+			return llvm_compile_rational_op(op_ty, dynamic_cast<const rational_type*>(higher_ty), lhs_val, rhs_val, state);
+
+		bool is_real = category == numeric_category::real;
+		bool is_signed = category == numeric_category::integer;
+
+		switch(op_ty){
 			case operator_type::add:{
-				if(dynamic_cast<const real_type*>(higher_ty))
+				if(is_real)
 					return state->builder()->CreateFAdd(lhs_val, rhs_val);
 				else
 					return state->builder()->CreateAdd(lhs_val, rhs_val);
 			}
 			case operator_type::sub:{
-				if(dynamic_cast<const real_type*>(higher_ty))
+				if(is_real)
 					return state->builder()->CreateFSub(lhs_val, rhs_val);
 				else
 					return state->builder()->CreateSub(lhs_val, rhs_val);
 			}
 			case operator_type::mul:{
-				if(dynamic_cast<const real_type*>(higher_ty))
+				if(is_real)
 					return state->builder()->CreateFMul(lhs_val, rhs_val);
 				else
 					return state->builder()->CreateMul(lhs_val, rhs_val);
 			}
 			case operator_type::div:{
-				if(dynamic_cast<const natural_type*>(higher_ty))
-					return state->builder()->CreateUDiv(lhs_val, rhs_val);
-				else if(dynamic_cast<const integer_type*>(higher_ty))
-					return state->builder()->CreateSDiv(lhs_val, rhs_val);
-				else if(dynamic_cast<const real_type*>(higher_ty)){
+				if(is_real)
 					return state->builder()->CreateFDiv(lhs_val, rhs_val);
-				}
+				else
+					return checked_div(lhs_val, rhs_val, is_signed, state);
+			}
+			case operator_type::equ:{
+				if(is_real)
+					return state->builder()->CreateFCmpOEQ(lhs_val, rhs_val);
+				else
+					return state->builder()->CreateICmpEQ(lhs_val, rhs_val);
+			}
+			case operator_type::neq:{
+				if(is_real)
+					return state->builder()->CreateFCmpONE(lhs_val, rhs_val);
+				else
+					return state->builder()->CreateICmpNE(lhs_val, rhs_val);
+			}
+			case operator_type::lt:{
+				if(is_real)
+					return state->builder()->CreateFCmpOLT(lhs_val, rhs_val);
+				else if(is_signed)
+					return state->builder()->CreateICmpSLT(lhs_val, rhs_val);
+				else
+					return state->builder()->CreateICmpULT(lhs_val, rhs_val);
+			}
+			case operator_type::gt:{
+				if(is_real)
+					return state->builder()->CreateFCmpOGT(lhs_val, rhs_val);
+				else if(is_signed)
+					return state->builder()->CreateICmpSGT(lhs_val, rhs_val);
+				else
+					return state->builder()->CreateICmpUGT(lhs_val, rhs_val);
+			}
+			case operator_type::lte:{
+				if(is_real)
+					return state->builder()->CreateFCmpOLE(lhs_val, rhs_val);
+				else if(is_signed)
+					return state->builder()->CreateICmpSLE(lhs_val, rhs_val);
+				else
+					return state->builder()->CreateICmpULE(lhs_val, rhs_val);
+			}
+			case operator_type::gte:{
+				if(is_real)
+					return state->builder()->CreateFCmpOGE(lhs_val, rhs_val);
+				else if(is_signed)
+					return state->builder()->CreateICmpSGE(lhs_val, rhs_val);
+				else
+					return state->builder()->CreateICmpUGE(lhs_val, rhs_val);
 			}
 
 			default:
@@ -171,6 +238,76 @@ namespace purson{
 		}
 	}
 	
+	llvm::Value *llvm_compile_cast(llvm::Value *val, const type *from, const type *to, llvm_state *state){
+		if(from == to) return val;
+
+		auto from_cat = numeric_category_of(from);
+		auto to_cat = numeric_category_of(to);
+
+		if((from_cat == numeric_category::none) || (to_cat == numeric_category::none))
+			throw module_error{fmt::format("can not cast from '{}' to '{}'", from->str(), to->str())};
+		else if((from_cat == numeric_category::complex) || (to_cat == numeric_category::complex))
+			return llvm_compile_complex_cast(val, from, to, state);
+		else if(is_big_real(from) || is_big_real(to))
+			return llvm_compile_big_real_cast(val, from, to, state);
+		else if(is_tagged_integer(from) || is_tagged_integer(to))
+			return llvm_compile_tagged_integer_cast(val, from, to, state);
+		else if((from_cat == numeric_category::rational) || (to_cat == numeric_category::rational))
+			return llvm_compile_rational_cast(val, from, to, state);
+
+		auto llvm_ty = llvm_type(to);
+		bool from_signed = from_cat == numeric_category::integer;
+
+		switch(to_cat){
+			case numeric_category::natural:
+			case numeric_category::integer:{
+				if(from_cat == numeric_category::real)
+					return to_cat == numeric_category::integer ?
+						state->builder()->CreateFPToSI(val, llvm_ty) :
+						state->builder()->CreateFPToUI(val, llvm_ty);
+				else
+					return state->builder()->CreateIntCast(val, llvm_ty, from_signed);
+			}
+
+			case numeric_category::real:{
+				if(from_cat == numeric_category::real)
+					return state->builder()->CreateFPCast(val, llvm_ty);
+				else if(from_signed)
+					return state->builder()->CreateSIToFP(val, llvm_ty);
+				else
+					return state->builder()->CreateUIToFP(val, llvm_ty);
+			}
+
+			default:
+				throw module_error{fmt::format("can not cast from '{}' to '{}'", from->str(), to->str())};
+		}
+	}
+	
+	bool llvm_is_temporary(const rvalue_expr *expr) noexcept{
+		// calls return values owned by the caller
+		return dynamic_cast<const binary_op_expr*>(expr) || dynamic_cast<const fn_call_expr*>(expr) || dynamic_cast<const literal_expr*>(expr);
+	}
+
+	llvm::Value *llvm_compile_owned(const rvalue_expr *expr, const type *ty, llvm_state *state){
+		if(is_big_real(ty))
+			return llvm_compile_big_real_owned(expr, dynamic_cast<const real_type*>(ty), state);
+		else if(is_tagged_integer(ty))
+			return llvm_compile_tagged_integer_owned(expr, dynamic_cast<const natural_type*>(ty), state);
+
+		auto expr_ty = expr->value_type();
+		auto val = llvm_compile_rvalue(expr, state);
+		auto converted = llvm_compile_cast(val, expr_ty, ty, state);
+
+		if(llvm_is_temporary(expr)){
+			if(is_big_real(expr_ty))
+				llvm_compile_big_real_release(val, state);
+			else if(is_tagged_integer(expr_ty))
+				llvm_compile_tagged_integer_release(val, state);
+		}
+
+		return converted;
+	}
+
 	llvm::Value *llvm_compile_fn_call(const fn_call_expr *call, llvm_state *state){
 		if(call->args().size()){
 			std::vector<const type *> subs{call->fn()->return_type()};
@@ -201,7 +338,20 @@ namespace purson{
 					};
 			}
 
-			return state->builder()->CreateCall(fn, llvm_arg_values);
+			auto res = state->builder()->CreateCall(fn, llvm_arg_values);
+
+			// arguments are only borrowed by the callee
+			for(std::size_t i = 0; i < call->args().size(); i++){
+				auto &&arg = call->args()[i];
+				if(!llvm_is_temporary(arg.get()))
+					continue;
+				else if(is_big_real(arg->value_type()))
+					llvm_compile_big_real_release(llvm_arg_values[i], state);
+				else if(is_tagged_integer(arg->value_type()))
+					llvm_compile_tagged_integer_release(llvm_arg_values[i], state);
+			}
+
+			return res;
 		}
 		else{
 			auto mangled = mangle_fn_name(call->fn()->name(), call->fn()->return_type(), {});
@@ -210,9 +360,12 @@ namespace purson{
 		}
 	}
 	
-	llvm::Constant *llvm_compile_literal(const literal_expr *lit, llvm_state *state){
+	llvm::Value *llvm_compile_literal(const literal_expr *lit, llvm_state *state){
 		if(auto num = dynamic_cast<const numeric_literal_expr*>(lit)){
 			if(auto nat_lit = dynamic_cast<const natural_literal_expr*>(num)){
+				if(is_tagged_integer(nat_lit->value_type()))
+					return llvm_compile_tagged_integer_literal(nat_lit->value(), state);
+
 				std::string val_str;
 				auto val = nat_lit->value();
 				val_str.resize(mpz_sizeinbase(val, 10) + 1);
@@ -221,6 +374,9 @@ namespace purson{
 				return llvm::ConstantInt::get(llvm_ctx, llvm::APInt(nat_lit->value_type()->bits(), val_str, 10));
 			}
 			else if(auto int_lit = dynamic_cast<const integer_literal_expr*>(num)){
+				if(is_tagged_integer(int_lit->value_type()))
+					return llvm_compile_tagged_integer_literal(int_lit->value(), state);
+
 				std::string val_str;
 				auto val = int_lit->value();
 				val_str.resize(mpz_sizeinbase(val, 10) + 1);
@@ -252,11 +408,13 @@ namespace purson{
 				return llvm::ConstantVector::get({num_constant, denom_constant});
 			}
 			else if(auto real_lit = dynamic_cast<const real_literal_expr*>(num)){
-				auto val = real_lit->value();
-				fmt::print(stderr, "WARNING: real literals currently shortened to long double\n");
-				auto constant_val = mpfr_get_d(val, MPFR_RNDN);
-				return llvm::ConstantFP::get(llvm_ctx, llvm::APFloat(constant_val));
+				if(is_big_real(real_lit->value_type()))
+					return llvm_compile_big_real_literal(real_lit, real_lit->value_type(), state);
+
+				return llvm_real_constant(real_lit->value(), real_lit->value_type());
 			}
+			else if(auto imag_lit = dynamic_cast<const imaginary_literal_expr*>(num))
+				return llvm_compile_imaginary_literal(imag_lit);
 			else
 				throw module_error{"unexpected numeric literal expression type"};
 		}
@@ -1,7 +1,9 @@
 #ifndef PURSON_LIB_LLVM_HPP
 #define PURSON_LIB_LLVM_HPP 1
 
+#include <map>
 #include <optional>
+#include <unordered_map>
 
 #include "fmt/format.h"
 
@@ -10,6 +12,7 @@
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/Linker/Linker.h>
+#include <llvm/Target/TargetMachine.h>
 
 #include "purson/module.hpp"
 #include "purson/expressions/literal.hpp"
@@ -31,15 +34,36 @@ namespace purson{
 		return llvm::StructType::get(llvm_ctx, elem_types);
 	}
 
-	inline llvm::IntegerType *llvm_type(const integer_type *integer_ty){ return llvm::Type::getIntNTy(llvm_ctx, integer_ty->bits()); }
-	inline llvm::IntegerType *llvm_type(const natural_type *natural_ty){ return llvm::Type::getIntNTy(llvm_ctx, natural_ty->bits()); }
+	inline llvm::IntegerType *llvm_type(const boolean_type*){ return llvm::Type::getInt1Ty(llvm_ctx); }
+
+	//! arbitrary precision integer or natural, lowered to a tagged word
+	inline bool is_tagged_integer(const type *ty) noexcept{
+		auto category = numeric_category_of(ty);
+		return ((category == numeric_category::natural) || (category == numeric_category::integer)) && is_arbitrary_precision(ty);
+	}
+
+	inline llvm::IntegerType *llvm_type(const integer_type *integer_ty){
+		return llvm::Type::getIntNTy(llvm_ctx, is_arbitrary_precision(integer_ty) ? 64 : integer_ty->bits());
+	}
+
+	inline llvm::IntegerType *llvm_type(const natural_type *natural_ty){
+		return llvm::Type::getIntNTy(llvm_ctx, is_arbitrary_precision(natural_ty) ? 64 : natural_ty->bits());
+	}
 
 	inline llvm::VectorType *llvm_type(const rational_type *rational_ty){
 		auto int_ty = llvm::Type::getIntNTy(llvm_ctx, rational_ty->bits() / 2);
 		return llvm::VectorType::get(int_ty, 2);
 	}
 
+	//! arbitrary precision real, lowered to a handle to a runtime value
+	inline bool is_big_real(const type *ty) noexcept{
+		return (numeric_category_of(ty) == numeric_category::real) && is_arbitrary_precision(ty);
+	}
+
 	inline llvm::Type *llvm_type(const real_type *real_ty){
+		if(is_arbitrary_precision(real_ty))
+			return llvm::Type::getInt8PtrTy(llvm_ctx);
+
 		switch(real_ty->bits()){
 			case 16: return llvm::Type::getHalfTy(llvm_ctx);
 			case 32: return llvm::Type::getFloatTy(llvm_ctx);
@@ -48,15 +72,50 @@ namespace purson{
 		}
 	}
 
+	//! interleaved {real, imaginary} lanes, so arrays of complex values are contiguous pairs
+	inline llvm::VectorType *llvm_type(const complex_type *complex_ty){
+		return llvm::VectorType::get(llvm_type(complex_ty->component_type()), 2);
+	}
+
+	//! lower a type to llvm without consulting the cache, use llvm_type(const type*) instead
+	llvm::Type *llvm_lower_type(const type *ty);
+
+	/**
+	 * Types are owned by their typeset and never change, so each only has to be lowered once per context.
+	 * The cache is thread local like llvm_ctx, so every type it holds already belongs to this thread's context.
+	 **/
+	inline thread_local std::unordered_map<const type*, llvm::Type*> llvm_type_cache;
+
 	inline llvm::Type *llvm_type(const type *ty){
 		if(!ty) return nullptr;
-		else if(auto unit = dynamic_cast<const unit_type*>(ty)) return llvm_type(unit);
-		else if(auto int_ = dynamic_cast<const integer_type*>(ty)) return llvm_type(int_);
-		else if(auto natural = dynamic_cast<const natural_type*>(ty)) return llvm_type(natural);
-		else if(auto rational = dynamic_cast<const rational_type*>(ty)) return llvm_type(rational);
-		else if(auto real = dynamic_cast<const real_type*>(ty)) return llvm_type(real);
-		else if(auto type = dynamic_cast<const type_type*>(ty)) return llvm_type(type);
-		throw module_error{fmt::format("could not get llvm type for type '{}'", ty->str())};
+
+		auto res = llvm_type_cache.find(ty);
+		if(res != end(llvm_type_cache))
+			return res->second;
+
+		auto lowered = llvm_lower_type(ty);
+		llvm_type_cache.emplace(ty, lowered);
+		return lowered;
+	}
+	
+	//! get or declare a function from lib/runtime in a module
+	inline llvm::Function *llvm_runtime_fn(llvm::Module *module, const std::string &name, llvm::Type *ret_ty, const std::vector<llvm::Type*> &param_tys){
+		if(auto fn = module->getFunction(name)) return fn;
+
+		auto fn_ty = llvm::FunctionType::get(ret_ty, param_tys, false);
+		auto fn = llvm::Function::Create(fn_ty, llvm::GlobalValue::ExternalLinkage, name, module);
+		fn->setDoesNotThrow();
+		return fn;
+	}
+
+	inline llvm::Value *llvm_call_runtime(llvm::IRBuilder<> &builder, const std::string &name, llvm::Type *ret_ty, const std::vector<llvm::Value*> &args){
+		std::vector<llvm::Type*> param_tys;
+		param_tys.reserve(args.size());
+		for(auto arg : args)
+			param_tys.push_back(arg->getType());
+
+		auto fn = llvm_runtime_fn(builder.GetInsertBlock()->getModule(), name, ret_ty, param_tys);
+		return builder.CreateCall(fn, args);
 	}
 	
 	using llvm_fn_gen_t = std::function<llvm::Function*(const type*, const std::vector<const type*>&)>;
@@ -109,6 +168,10 @@ namespace purson{
 			void set_mangled_fn(std::string_view mangled_name, llvm::Function *llvm_fn){
 				m_mangled_fns[mangled_name] = llvm_fn;
 			}
+
+			//! slot of a ty variable whose runtime value is released when the scope is left
+			void own_var(llvm::Value *slot, const type *ty){ m_owned_vars.emplace_back(slot, ty); }
+			const std::vector<std::pair<llvm::Value*, const type*>> &owned_vars() const noexcept{ return m_owned_vars; }
 			
 		private:
 			llvm::Module *m_module;
@@ -118,13 +181,107 @@ namespace purson{
 			std::map<std::string_view, std::pair<const type*, llvm::Value*>> m_vars;
 			std::map<std::string_view, llvm_fn_gen_t> m_fn_defs;
 			std::map<std::string_view, llvm::Function*> m_mangled_fns;
+			std::vector<std::pair<llvm::Value*, const type*>> m_owned_vars;
 	};
 	
+	//! code generator optimization level matching opt
+	llvm::CodeGenOpt::Level llvm_codegen_opt_level(opt_level opt) noexcept;
+
+	//! run the standard function and module pipelines for opt over a module
+	void llvm_optimize_module(llvm::Module &mod, llvm::TargetMachine &tm, opt_level opt);
+
+	//! everything needed to create matching target machines on other threads
+	struct llvm_target_desc{
+		std::string triple;
+		std::string cpu;
+		std::vector<std::string> attrs;
+	};
+
+	/**
+	 * Describe the target machine for t and cpu
+	 *
+	 * @param[in] t target to compile for
+	 * @param[in] cpu cpu to compile for, "native" is the host cpu with all of its features
+	 * @param[in] host_by_default whether an empty cpu name means the host cpu, otherwise it's a baseline cpu for t
+	 * @returns the triple, cpu and features, resolving the host's where asked for
+	 **/
+	llvm_target_desc llvm_describe_target(target t, const target_cpu &cpu, bool host_by_default = true);
+
+	//! @returns whether code for desc can run in this process
+	bool llvm_target_is_host(const llvm_target_desc &desc);
+
+	/**
+	 * Initialize the native target and its object emission, once per process
+	 *
+	 * Nothing is initialized until something is compiled, so programs that
+	 * only lex and parse never pay for it. Set PURSON_TIME_INIT in the
+	 * environment to have the time it took printed to stderr.
+	 **/
+	void llvm_init_codegen();
+
+	//! initialize every target llvm was built with and their object emission, for objects another machine runs
+	void llvm_init_cross_codegen();
+
+	//! llvm_init_codegen, and make the process's own symbols visible to jit code
+	void llvm_init_jit();
+
+	/**
+	 * Create a target machine for desc
+	 *
+	 * @param[in] desc target to compile for
+	 * @param[in] cg_opt code generator optimization level
+	 * @param[in] aot_reloc relocation model for objects linked ahead of time, the jit's defaults if empty
+	 **/
+	std::unique_ptr<llvm::TargetMachine> llvm_make_target_machine(
+		const llvm_target_desc &desc, llvm::CodeGenOpt::Level cg_opt,
+		std::optional<llvm::Reloc::Model> aot_reloc = std::nullopt
+	);
+
 	llvm::Value *llvm_compile(const expr *expr_, llvm_state *state);
 
 	llvm::Value *llvm_compile_rvalue(const rvalue_expr *rvalue, llvm_state *state);
 	llvm::Value *llvm_compile_binop(const binary_op_expr *binop, llvm_state *state);
 
+	llvm::Value *llvm_compile_cast(llvm::Value *val, const type *from, const type *to, llvm_state *state);
+
+	//! whether expr makes a new runtime value owned by its user, instead of referring to one
+	bool llvm_is_temporary(const rvalue_expr *expr) noexcept;
+
+	//! expr converted to ty and owned by the caller, a temporary it was converted from is released
+	llvm::Value *llvm_compile_owned(const rvalue_expr *expr, const type *ty, llvm_state *state);
+
+	//! release the values owned by variables of state, before leaving it
+	void llvm_compile_scope_release(llvm_state *state);
+
+	llvm::Value *llvm_compile_rational_op(operator_type op_ty, const rational_type *ty, llvm::Value *lhs, llvm::Value *rhs, llvm_state *state);
+	llvm::Value *llvm_compile_rational_cast(llvm::Value *val, const type *from, const type *to, llvm_state *state);
+	llvm::Value *llvm_compile_rational_normalize(llvm::Value *val, const rational_type *ty, llvm_state *state);
+
+	llvm::Value *llvm_compile_tagged_integer_binop(const binary_op_expr *binop, const natural_type *ty, llvm_state *state);
+	llvm::Value *llvm_compile_tagged_integer_op(operator_type op_ty, const natural_type *ty, llvm::Value *lhs, llvm::Value *rhs, llvm_state *state);
+	llvm::Value *llvm_compile_tagged_integer_cast(llvm::Value *val, const type *from, const type *to, llvm_state *state);
+	llvm::Value *llvm_compile_tagged_integer_literal(const mpz_t &val, llvm_state *state);
+
+	//! expr as a word owned by the caller, boxed words still referenced elsewhere are copied
+	llvm::Value *llvm_compile_tagged_integer_owned(const rvalue_expr *expr, const natural_type *ty, llvm_state *state);
+
+	void llvm_compile_tagged_integer_release(llvm::Value *word, llvm_state *state);
+
+	llvm::Value *llvm_compile_big_real_binop(const binary_op_expr *binop, const real_type *ty, llvm_state *state);
+
+	//! expr as a new ty owned by the caller, constants are folded at ty's precision
+	llvm::Value *llvm_compile_big_real_owned(const rvalue_expr *expr, const real_type *ty, llvm_state *state);
+
+	void llvm_compile_big_real_release(llvm::Value *val, llvm_state *state);
+
+	llvm::Value *llvm_compile_big_real_cast(llvm::Value *val, const type *from, const type *to, llvm_state *state);
+	llvm::Value *llvm_compile_big_real_literal(const numeric_literal_expr *lit, const real_type *ty, llvm_state *state);
+	llvm::Constant *llvm_real_constant(const mpfr_t &val, const real_type *ty);
+
+	llvm::Value *llvm_compile_complex_op(operator_type op_ty, const complex_type *ty, llvm::Value *lhs, llvm::Value *rhs, llvm_state *state);
+	llvm::Value *llvm_compile_complex_cast(llvm::Value *val, const type *from, const type *to, llvm_state *state);
+	llvm::Constant *llvm_compile_imaginary_literal(const imaginary_literal_expr *lit);
+
 	llvm::Value *llvm_compile_ret(const return_expr *ret, llvm_state *state);
 
 	llvm::Value *llvm_compile_var_decl(const var_decl_expr *decl, llvm_state *state);
@@ -134,7 +291,7 @@ namespace purson{
 	llvm_fn_gen_t &llvm_compile_fn_def(const fn_def_expr *def, llvm_state *state);
 	
 	llvm::Value *llvm_compile_fn_call(const fn_call_expr *call, llvm_state *state);
-	llvm::Constant *llvm_compile_literal(const literal_expr *lit, llvm_state *state);
+	llvm::Value *llvm_compile_literal(const literal_expr *lit, llvm_state *state);
 }
 
 #endif // !PURSON_LIB_LLVM_HPP
@@ -1,4 +1,12 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <set>
 #include <string>
+#include <unordered_map>
 
 #include "fmt/core.h"
 
@@ -6,14 +14,32 @@
 #include "purson/module.hpp"
 
 #include "llvm.hpp"
+#include "runtime/runtime.hpp"
+#include "tier.hpp"
+#include "object_cache.hpp"
+#include "parallel.hpp"
+#include "thread_pool.hpp"
+#include "speculate.hpp"
+#include "code_memory.hpp"
+#include "partition.hpp"
+#include "thin_lto.hpp"
+#include "multiversion.hpp"
+#include "callback_manager.hpp"
+#include "code_cache.hpp"
+#include "snapshot.hpp"
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
 
 #include <llvm/ExecutionEngine/MCJIT.h>
-#include <llvm/ExecutionEngine/Interpreter.h>
 #include <llvm/IR/Mangler.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 #include <llvm/IR/PassManager.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/LegacyPassManagers.h>
 #include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Target/TargetMachine.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
@@ -30,21 +56,8 @@
 #include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
 #include <llvm/ExecutionEngine/Orc/IndirectionUtils.h>
 #include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
-#include <llvm/Transforms/InstCombine/InstCombine.h>
-#include <llvm/Transforms/Scalar.h>
-#include <llvm/Transforms/Scalar/GVN.h>
 
 namespace purson{
-	struct llvm_dummy_t{
-		llvm_dummy_t(){
-			llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
-			LLVMInitializeNativeAsmParser();
-			LLVMInitializeNativeAsmPrinter();
-			LLVMInitializeNativeDisassembler();
-			LLVMInitializeNativeTarget();
-		}
-	} static dummy;
-	
 	std::string mangle_fn_name(std::string_view name, const type *ret, const std::vector<const type*> params, fn_linkage linkage){
 		if(linkage == fn_linkage::C) return std::string(name);
 
@@ -65,188 +78,633 @@ namespace purson{
 		return fmt::format("{}{}{}", str, ret->str(), name);
 	}
 	
+	namespace{
+		void emit_object(llvm::Module &mod, llvm::TargetMachine &tm, std::string_view path){
+			std::string filename(path);
+			std::error_code EC;
+			llvm::raw_fd_ostream dest(filename, EC, llvm::sys::fs::F_None);
+
+			if(EC)
+				throw module_error{fmt::format("could not open file: {}", EC.message())};
+
+			llvm::legacy::PassManager pass;
+			auto file_type = llvm::TargetMachine::CGFT_ObjectFile;
+
+			if(tm.addPassesToEmitFile(pass, dest, file_type))
+				throw module_error{"target machine can't emit object files"};
+
+			pass.run(mod);
+			dest.flush();
+		}
+	}
+
 	class llvm_module: public jit_module{
 		public:
-			llvm_module(std::string_view name, std::unique_ptr<llvm::TargetMachine> &tm, const llvm::DataLayout &dl)
-				: m_mod(std::make_shared<llvm::Module>(name.data(), llvm_ctx)), m_global_state{m_mod.get()}, m_tm(tm.get()){
+			llvm_module(std::string_view name, std::unique_ptr<llvm::TargetMachine> &tm, const llvm::DataLayout &dl, opt_level opt)
+				: m_mod(std::make_shared<llvm::Module>(name.data(), llvm_ctx)), m_global_state{m_mod.get()}, m_tm(tm.get()), m_opt(opt), m_name(name){
 				m_mod->setTargetTriple(tm->getTargetTriple().str());
 				m_mod->setDataLayout(dl);
 			}
+
+			//! module compiled on another thread or loaded from a snapshot, the ir is only parsed back in if it's needed again
+			//! @param[in] mapping snapshot file the module's objects point in to, kept as long as the module
+			llvm_module(
+				std::string_view name, std::string bitcode, std::unique_ptr<llvm::TargetMachine> &tm, opt_level opt,
+				std::shared_ptr<const llvm::MemoryBuffer> mapping = nullptr
+			)
+				: m_global_state{nullptr}, m_tm(tm.get()), m_opt(opt), m_name(name), m_bitcode(std::move(bitcode)), m_mapping(std::move(mapping)){}
 			
 			~llvm_module(){}
 
+			//! do everything that touches the ir on pool's thread, with mut held, like the rest of the moduleset
+			void bind_ir_thread(thread_pool &pool, std::recursive_mutex &mut) noexcept{
+				m_ir_thread = &pool;
+				m_ir_mut = &mut;
+			}
+
+			//! look functions up in the jit mod was added to
+			void bind_jit(jit_moduleset &jit) noexcept{ m_jit = &jit; }
+
 			void register_func(const std::string &name, void *fn_ptr, const function_type *fn_ty) override{
-				auto llvm_ret_ty = llvm_type(fn_ty->return_type());
-				std::vector<llvm::Type*> llvm_param_tys(fn_ty->num_params());
-				for(std::size_t i = 0; i < fn_ty->num_params(); i++)
-					llvm_param_tys[i] = llvm_type(fn_ty->param_type(i));
-
-				auto llvm_fn_ty = llvm::FunctionType::get(llvm_ret_ty, llvm_param_tys, false);
-				auto llvm_fn = llvm::Function::Create(
-					llvm_fn_ty, llvm::Function::ExternalLinkage, name, m_mod.get()
-				);
+				in_ir_context([&]{
+					auto llvm_ret_ty = llvm_type(fn_ty->return_type());
+					std::vector<llvm::Type*> llvm_param_tys(fn_ty->num_params());
+					for(std::size_t i = 0; i < fn_ty->num_params(); i++)
+						llvm_param_tys[i] = llvm_type(fn_ty->param_type(i));
 
-				llvm_fn->setCallingConv(llvm::CallingConv::C);
+					auto llvm_fn_ty = llvm::FunctionType::get(llvm_ret_ty, llvm_param_tys, false);
+					auto llvm_fn = llvm::Function::Create(
+						llvm_fn_ty, llvm::Function::ExternalLinkage, name, module().get()
+					);
+
+					llvm_fn->setCallingConv(llvm::CallingConv::C);
+				});
 			}
 
+			//! modules share one namespace in a jit, so this is the moduleset's lookup, and null outside of one
 			void *get_fn_ptr(std::string_view mangled_name) override{
-				auto fnPtr = m_mod->getFunction(std::string(mangled_name));
-				if(fnPtr){
-					fmt::print("found fn {}\n", fnPtr->getName().str());
-				}
-
-				return nullptr;
+				return m_jit ? m_jit->get_fn_ptr(mangled_name) : nullptr;
 			}
 			
 			void compile(const std::vector<std::shared_ptr<const expr>> &ast) override{
-				std::vector<llvm::Value*> values;
-				for(auto &&ptr : ast){
-					if(ptr) values.emplace_back(llvm_compile(ptr.get(), &m_global_state));
-				}
+				in_ir_context([&]{
+					module();
+
+					std::vector<llvm::Value*> values;
+					for(auto &&ptr : ast){
+						if(ptr) values.emplace_back(llvm_compile(ptr.get(), &m_global_state));
+					}
+				});
 			}
 
 			void write(std::string_view path) override{
-				std::string filename(path);
-				std::error_code EC;
-				llvm::raw_fd_ostream dest(filename, EC, llvm::sys::fs::F_None);
+				in_ir_context([&]{
+					auto mod = module();
+					llvm_optimize_module(*mod, *m_tm, m_opt);
+					emit_object(*mod, *m_tm, path);
+				});
+			}
+
+			std::shared_ptr<llvm::Module> module(){
+				if(m_released)
+					throw module_error{fmt::format("the ir of module '{}' was released once it was compiled", m_name)};
+
+				if(!m_mod){
+					auto buffer = llvm::MemoryBuffer::getMemBuffer(m_bitcode, m_name, false);
+					auto res = llvm::parseBitcodeFile(buffer->getMemBufferRef(), llvm_ctx);
+					if(!res){
+						llvm::consumeError(res.takeError());
+						throw module_error{fmt::format("could not read back ir for module '{}'", m_name)};
+					}
 
-				auto cpu = "generic";
-				auto features = "sse sse2";
+					m_mod = std::move(*res);
+					m_global_state = llvm_state{m_mod.get()};
+					m_bitcode.clear();
+				}
+
+				return m_mod;
+			}
 
-				if(EC)
-					throw module_error{fmt::format("could not open file: {}", EC.message())};
+			const std::string &name() const noexcept{ return m_name; }
 
-				llvm::TargetOptions opts;
-				auto RM = llvm::Optional<llvm::Reloc::Model>();
+			//! @returns the ir if it's currently loaded, without reading it back in
+			llvm::Module *loaded_module() const noexcept{ return m_mod.get(); }
 
-				llvm::legacy::PassManager pass;
-				auto file_type = llvm::TargetMachine::CGFT_ObjectFile;
+			//! @returns whether the ir is gone for good
+			bool released() const noexcept{ return m_released; }
 
-				if(m_tm->addPassesToEmitFile(pass, dest, file_type))
-					throw module_error{"target machine can't emit object files"};
+			//! start counting down the functions left to compile before the ir can be released
+			void track_materialization(){
+				m_unmaterialized = static_cast<std::size_t>(
+					std::count_if(m_mod->begin(), m_mod->end(), [](auto &&fn){ return !fn.isDeclaration(); })
+				);
+			}
 
-				pass.run(*m_mod);
-				dest.flush();
+			//! @returns whether that was the last function left to compile
+			bool materialized_fn() noexcept{
+				return m_unmaterialized && (--m_unmaterialized == 0);
 			}
 
-			std::shared_ptr<llvm::Module> module() noexcept{ return m_mod; }
+			//! drop the ir and codegen state for good, anything that needs the ir afterwards throws
+			void release_ir(){
+				if(!m_mod) return;
+
+				// the compile on demand layer holds on to the module too, so the bodies go in place
+				for(auto &&fn : *m_mod){
+					if(!fn.isDeclaration())
+						fn.deleteBody();
+				}
+
+				m_global_state = llvm_state{nullptr};
+				m_mod.reset();
+				m_released = true;
+			}
 			
 		private:
 			std::shared_ptr<llvm::Module> m_mod;
 			llvm_state m_global_state;
 			llvm::TargetMachine *m_tm;
+			opt_level m_opt;
+
+			std::string m_name;
+			std::string m_bitcode;
+			std::shared_ptr<const llvm::MemoryBuffer> m_mapping;
+
+			std::size_t m_unmaterialized = 0;
+			bool m_released = false;
+
+			thread_pool *m_ir_thread = nullptr;
+			std::recursive_mutex *m_ir_mut = nullptr;
+
+			jit_moduleset *m_jit = nullptr;
+
+			template<typename Fn>
+			auto in_ir_context(Fn &&fn){
+				// either not in a jit, or already on the ir thread for whoever holds the lock
+				if(!m_ir_thread || m_ir_thread->is_worker())
+					return fn();
+
+				std::lock_guard lock(*m_ir_mut);
+				return m_ir_thread->submit(std::forward<Fn>(fn)).get();
+			}
 	};
 	
+	namespace{
+		//! link copies of every module in to one, leaving the originals as they were
+		std::unique_ptr<llvm::Module> link_modules(
+			std::string_view name, const std::vector<std::unique_ptr<llvm_module>> &mods, const llvm::TargetMachine &tm
+		){
+			auto linked = std::make_unique<llvm::Module>(std::string(name), llvm_ctx);
+			linked->setTargetTriple(tm.getTargetTriple().str());
+			linked->setDataLayout(tm.createDataLayout());
+
+			llvm::Linker linker(*linked);
+			for(auto &&mod : mods){
+				if(linker.linkInModule(llvm::CloneModule(mod->module().get())))
+					throw module_error{fmt::format("could not link module in to '{}'", name)};
+			}
+
+			return linked;
+		}
+
+		//! define a c main function that calls entry and returns its result
+		void add_c_main(llvm::Module &mod, std::string_view entry){
+			auto target = mod.getFunction(std::string(entry));
+			if(!target || target->isDeclaration())
+				throw module_error{fmt::format("entry point '{}' is not defined", entry)};
+
+			if(target->arg_size())
+				throw module_error{fmt::format("entry point '{}' can not take parameters", entry)};
+
+			auto &&ctx = mod.getContext();
+			auto int_ty = llvm::Type::getInt32Ty(ctx);
+			auto argv_ty = llvm::Type::getInt8PtrTy(ctx)->getPointerTo();
+
+			auto main_fn = llvm::Function::Create(
+				llvm::FunctionType::get(int_ty, {int_ty, argv_ty}, false),
+				llvm::Function::ExternalLinkage, "main", &mod
+			);
+
+			llvm::IRBuilder<> builder(llvm::BasicBlock::Create(ctx, "entry", main_fn));
+			auto ret = builder.CreateCall(target);
+
+			auto ret_ty = target->getReturnType();
+			if(ret_ty->isVoidTy())
+				builder.CreateRet(builder.getInt32(0));
+			else if(ret_ty->isIntegerTy())
+				builder.CreateRet(builder.CreateIntCast(ret, int_ty, true));
+			else
+				throw module_error{fmt::format("entry point '{}' must return an integer or nothing", entry)};
+		}
+	}
+
 	class llvm_moduleset: public jit_moduleset{
 		public:
-			llvm_moduleset(target t_): t(t_), tm(llvm::EngineBuilder().selectTarget()), dl(tm->createDataLayout()),
-			  objectLayer([](){ return std::make_shared<llvm::SectionMemoryManager>(); }),
-			  compileLayer(objectLayer, llvm::orc::SimpleCompiler(*tm)),
+			llvm_moduleset(target t_, opt_level opt_, bool tiered, llvm_target_desc desc, std::shared_ptr<const llvm_code_cache> shared = nullptr)
+			: m_shared(std::move(shared)), t(t_), opt(opt_), targetDesc(std::move(desc)),
+			  // the baseline tier goes through fast instruction selection
+			  tm(llvm_make_target_machine(targetDesc, tiered ? llvm::CodeGenOpt::None : llvm_codegen_opt_level(opt_))),
+			  dl(tm->createDataLayout()),
+			  objectCache(llvm_object_cache::target_salt(*tm, opt_)),
+			  codePool(std::make_shared<llvm_code_pool>()),
+			  objectLayer([pool = codePool]() -> std::shared_ptr<llvm::RuntimeDyld::MemoryManager>{
+				  if(pool->usable())
+					  return std::make_shared<llvm_pooled_memory_manager>(pool);
+
+				  return std::make_shared<llvm::SectionMemoryManager>();
+			  }),
+			  // baseline objects embed addresses from this process, so only peak objects are cached when tiered
+			  compileLayer(objectLayer, llvm::orc::SimpleCompiler(*tm, tiered ? nullptr : &objectCache)),
 			  optimizeLayer(compileLayer, [this](std::shared_ptr<llvm::Module> m){
 				  return optimizeModule(std::move(m));
 			  }),
-			  compileCallbackManager(llvm::orc::createLocalCompileCallbackManager(tm->getTargetTriple(), 0)),
+			  compileCallbackManager(llvm_make_locked_callback_manager(tm->getTargetTriple(), m_mut)),
 			  codLayer(
 				  optimizeLayer,
-				  [this](llvm::Function &f){ return std::set<llvm::Function*>{&f}; },
+				  [this](llvm::Function &f){ return m_partitioner(f); },
 				  *compileCallbackManager,
 				  llvm::orc::createLocalIndirectStubsManagerBuilder(tm->getTargetTriple())
 			  )
 			  //, mapLayer(codLayer)
 			  {
-				llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+				llvm_init_jit();
 				//mapLayer.setGlobalMapping("pursonEcho", (std::uintptr_t)pursonEcho);
 				//mapLayer.setGlobalMapping("pursonStr", (std::uintptr_t)pursonStr);
 				//mapLayer.setGlobalMapping("pursonPrint", (std::uintptr_t)pursonPrint);
 				//mapLayer.setGlobalMapping("pursonVecToStr", (std::uintptr_t)pursonVec4ToStr);
 
 				//mod->setDataLayout(m_dl);
+
+				// the baseline tier is cheap enough to compile on first call
+				if(tiered)
+					m_tiers = std::make_unique<llvm_tier_compiler>(targetDesc, opt, &objectCache, &m_inlines);
+				else
+					// isolates are cheap to make, so they don't each get a thread per core
+					m_spec = std::make_unique<llvm_speculator>(targetDesc, opt, &objectCache, m_shared ? 1 : 0, &m_inlines);
 			}
 			
-			~llvm_moduleset(){}
+			~llvm_moduleset(){
+				// no thread can be running jit code any more
+				std::lock_guard lock(m_mut);
+				for(auto &&retired : m_retired)
+					free_retired(retired);
+
+				// objects of modules loaded from a snapshot point in to a mapping the modules own, and go before them
+				for(auto &&handles : m_obj_handles){
+					for(auto &&obj : handles)
+						cantFail(objectLayer.removeObject(obj));
+				}
+
+				m_obj_handles.clear();
+			}
+
+			void set_cache_dir(std::string_view dir, std::size_t max_bytes) override{
+				std::lock_guard lock(m_mut);
+				objectCache.set_dir(dir, max_bytes);
+			}
+
+			void set_release_ir(bool release) noexcept override{
+				std::lock_guard lock(m_mut);
+				m_release_ir = release;
+			}
+
+			void set_compile_threads(std::size_t n) override{
+				std::lock_guard lock(m_mut);
+				m_pool.reset();
+				m_pool_threads = n;
+			}
+
+			std::size_t enter() noexcept override{
+				while(1){
+					auto phase = m_phase.load();
+					m_readers[phase].fetch_add(1);
+
+					// a flip in between could have missed this reader, so it has to count in the new phase
+					if(m_phase.load() == phase)
+						return phase;
+
+					m_readers[phase].fetch_sub(1);
+				}
+			}
+
+			void leave(std::size_t phase) noexcept override{
+				m_readers[phase].fetch_sub(1);
+
+				// this thread may have been the last one holding destroyed code, but never wait on a compile for it
+				if(m_has_retired.load() && m_mut.try_lock()){
+					collect_retired();
+					m_mut.unlock();
+				}
+			}
 
 			void set_fn_ptr(std::string_view identifier, void *fn_ptr) override{
 				//codLayer.setGlobalMapping(std::string(identifier), llvm::JITTargetAddress(fn_ptr));
 			}
 
 			void *get_fn_ptr(std::string_view mangled_name) override{
-				auto name = std::string(mangled_name);
-				std::string llvmName;
-				llvm::raw_string_ostream str(llvmName);
-				llvm::Mangler::getNameWithPrefix(str, name, dl);
+				auto key = std::string(mangled_name);
 
-				for(auto &&mod : m_mod_handles){
-					llvm::JITSymbol fn = mod->findSymbol(optimizeLayer, str.str(), true);
-					if(fn)
-						return reinterpret_cast<void*>(fn.getAddress().get());
+				{
+					auto fns = std::atomic_load(&m_fns);
+					auto res = fns->find(key);
+					if(res != end(*fns))
+						return res->second.ptr;
 				}
 
-				return nullptr;
+				std::lock_guard lock(m_mut);
+				catch_up();
+
+				auto found = find_fn_ptr(key);
+				if(!found.ptr)
+					return nullptr;
+
+				// likely to be called soon
+				if(m_spec)
+					m_spec->speculate(key);
+
+				publish_fns({{std::move(key), found}});
+				return found.ptr;
 			}
-			
-			jit_module *create_module(std::string_view name, const std::vector<std::shared_ptr<const expr>> &ast) override{
-				if(t != target::auto_)
-					throw module_error{"only automatic target selection currently supported"};
 
-				auto mod = new llvm_module(name, tm, dl);
+			std::vector<void*> get_fn_ptrs(const std::vector<std::string_view> &mangled_names) override{
+				std::vector<void*> ret(mangled_names.size(), nullptr);
+				std::vector<std::size_t> missing;
 
-				mod->compile(ast);
+				{
+					auto fns = std::atomic_load(&m_fns);
+					for(std::size_t i = 0; i < mangled_names.size(); i++){
+						auto res = fns->find(std::string(mangled_names[i]));
+						if(res != end(*fns))
+							ret[i] = res->second.ptr;
+						else
+							missing.push_back(i);
+					}
+				}
 
-				m_mods.emplace_back(std::unique_ptr<llvm_module>(mod));
+				if(missing.empty())
+					return ret;
 
-				auto resolver = llvm::orc::createLambdaResolver(
-						[this](const std::string &name) -> llvm::JITSymbol{
-							auto sym = codLayer.findSymbol(name, false);
-							if(sym) return sym;
-							else if(auto err = sym.takeError())
-								return std::move(err);
+				std::lock_guard lock(m_mut);
+				catch_up();
 
-							return nullptr;
-						},
-						[](const std::string &name) -> llvm::JITSymbol{
-							if(auto symAddr = llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name))
-								return llvm::JITSymbol(symAddr, llvm::JITSymbolFlags::Exported);
-							return nullptr;
-						}
-				);
+				fn_table found;
+				found.reserve(missing.size());
 
-				auto res = codLayer.addModule(mod->module(), std::move(resolver));
-				if(!res)
-					throw module_error{"failed to add module"};
+				for(auto &&i : missing){
+					auto key = std::string(mangled_names[i]);
+					auto fn = find_fn_ptr(key);
+					if(!fn.ptr) continue;
 
-				auto &&module_handle = m_mod_handles.emplace_back(*res);
+					if(m_spec)
+						m_spec->speculate(key);
 
-				return m_mod_ptrs.emplace_back(mod);
+					ret[i] = fn.ptr;
+					found.emplace(std::move(key), fn);
+				}
+
+				publish_fns(std::move(found));
+				return ret;
+			}
+			
+			jit_module *create_module(std::string_view name, const std::vector<std::shared_ptr<const expr>> &ast) override{
+				std::lock_guard lock(m_mut);
+				collect_retired();
+				auto ret = on_ir_thread([&]{ return add_module(name, ast); });
+
+				// the isolate's own functions take precedence over shared ones looked up before
+				if(m_shared)
+					drop_fns(nullptr);
+
+				return ret;
+			}
+
+			std::vector<jit_module*> create_modules(const std::vector<module_source> &srcs) override{
+				// held while compiling too, lazy compiles meanwhile would only compete for the same threads
+				std::lock_guard lock(m_mut);
+				collect_retired();
+				auto ret = add_modules(srcs);
+
+				if(m_shared)
+					drop_fns(nullptr);
+
+				return ret;
 			}
 			
 			bool destroy_module(const module *mod) noexcept override{
 				if(!mod) return false;
 
+				std::lock_guard lock(m_mut);
+
 			    auto res = std::find_if(begin(m_mods), end(m_mods), [mod](auto &&ptr){ return ptr.get() == mod; });
 				if(res == end(m_mods))
 					return false;
 				
 				auto dist = std::distance(begin(m_mods), res);
-				
-				cantFail(codLayer.removeModule(m_mod_handles[dist]));
+
+				for(auto it = begin(m_fn_owners); it != end(m_fn_owners);){
+					if(it->second == res->get())
+						it = m_fn_owners.erase(it);
+					else
+						++it;
+				}
+
+				m_partitioner.forget((*res)->loaded_module());
+				m_inlines.forget(res->get());
+
+				for(auto it = begin(m_reloaded); it != end(m_reloaded);){
+					if(it->second == res->get())
+						it = m_reloaded.erase(it);
+					else
+						++it;
+				}
+
+				m_to_release.erase(std::remove(begin(m_to_release), end(m_to_release), res->get()), end(m_to_release));
+
+				drop_fns(mod);
+
+				// stale recompiles must not be pointed at by a new module's stubs of the same name
+				if(m_tiers){
+					m_tiers->invalidate(res->get());
+
+					for(auto it = begin(m_tier_owners); it != end(m_tier_owners);){
+						if(it->second == res->get())
+							it = m_tier_owners.erase(it);
+						else
+							++it;
+					}
+				}
+
+				if(m_spec)
+					m_spec->invalidate();
+
+				// nothing new can find it now, but threads that entered before may still be running its code
+				m_retired[m_phase.load()].push_back({std::move(m_mod_handles[dist]), std::move(m_obj_handles[dist]), std::move(*res)});
+				m_has_retired = true;
 				
 				m_mods.erase(res);
 				m_mod_handles.erase(begin(m_mod_handles) + dist);
+				m_obj_handles.erase(begin(m_obj_handles) + dist);
 				m_mod_ptrs.erase(begin(m_mod_ptrs) + dist);
+
+				collect_retired();
 				return true;
 			}
-			
+
+			std::vector<std::string> reload_fns(const jit_module *mod, const std::vector<std::shared_ptr<const expr>> &ast) override{
+				std::lock_guard lock(m_mut);
+				collect_retired();
+				return on_ir_thread([&]{ return replace_fns(mod, ast); });
+			}
+
+			// only stable while no other thread creates or destroys modules
 			std::size_t num_modules() const noexcept override{ return m_mod_ptrs.size(); }
 			const jit_module *const *modules() const noexcept override{ return m_mod_ptrs.data(); }
 
 			void write(std::string_view path) override{
+				std::lock_guard lock(m_mut);
+				on_ir_thread([&]{
+					// the jit's own target machine uses the jit code model
+					auto aot_tm = llvm_make_target_machine(targetDesc, llvm_codegen_opt_level(opt), llvm::Reloc::PIC_);
+
+					auto linked = link_modules(path, m_mods, *aot_tm);
+					llvm_optimize_module(*linked, *aot_tm, opt);
+					emit_object(*linked, *aot_tm, path);
+				});
+			}
+
+			void save_snapshot(std::string_view path, std::string_view user_data) override{
+				std::lock_guard lock(m_mut);
+
+				// the new bodies only exist as objects, the ir still has the old ones
+				if(!m_reloaded.empty())
+					throw module_error{fmt::format("module '{}' had functions reloaded and can not be snapshotted", begin(m_reloaded)->second->name())};
+
+				struct saved_module{
+					std::string bitcode;
+					std::vector<std::string> objs;
+				};
+
+				auto peak_tm = llvm_make_target_machine(targetDesc, llvm_codegen_opt_level(opt));
+
+				auto saved = on_ir_thread([&]{
+					std::vector<saved_module> ret;
+					ret.reserve(m_mods.size());
+
+					for(auto &&mod : m_mods){
+						auto &&entry = ret.emplace_back();
+
+						// the compile on demand layer may still be compiling parts of the original
+						auto clone = llvm::CloneModule(mod->module().get());
+						{
+							llvm::raw_string_ostream os(entry.bitcode);
+							llvm::WriteBitcodeToFile(clone.get(), os);
+						}
+
+						m_inlines.import_into(*clone);
+						llvm_optimize_module(*clone, *peak_tm, opt);
+
+						auto obj = llvm::orc::SimpleCompiler(*peak_tm, &objectCache)(*clone);
+						if(!obj.getBinary())
+							throw module_error{fmt::format("failed to compile module '{}' for a snapshot", mod->name())};
+
+						entry.objs.push_back(obj.getBinary()->getData().str());
+					}
+
+					return ret;
+				});
+
+				auto salt = llvm_object_cache::target_salt(*peak_tm, opt);
+
+				llvm_snapshot snapshot;
+				snapshot.salt = salt;
+				snapshot.user_data = user_data;
+				snapshot.mods.reserve(m_mods.size());
+
+				for(std::size_t i = 0; i < m_mods.size(); i++){
+					auto &&mod = snapshot.mods.emplace_back();
+					mod.name = m_mods[i]->name();
+					mod.bitcode = saved[i].bitcode;
+					mod.objs.assign(begin(saved[i].objs), end(saved[i].objs));
+				}
+
+				llvm_write_snapshot(path, snapshot);
+			}
+
+			std::vector<jit_module*> load_snapshot(std::string_view path, std::string *user_data) override{
+				// mapped rather than read for anything but small files
+				auto file = llvm::MemoryBuffer::getFile(std::string(path), -1, false);
+				if(!file)
+					throw module_error{fmt::format("could not open snapshot '{}': {}", path, file.getError().message())};
+
+				// shared by the modules loaded from it, the objects point in to it
+				std::shared_ptr<const llvm::MemoryBuffer> data = std::move(*file);
+				auto snapshot = llvm_read_snapshot(std::string_view(data->getBufferStart(), data->getBufferSize()));
+
+				auto peak_tm = llvm_make_target_machine(targetDesc, llvm_codegen_opt_level(opt));
+				if(snapshot.salt != llvm_object_cache::target_salt(*peak_tm, opt))
+					throw module_error{fmt::format("snapshot '{}' was made for another target or optimization level", path)};
+
+				// objects are parsed in place before anything is added, so a bad one leaves the moduleset as it was
+				std::vector<std::vector<llvm_object_ptr>> objs;
+				objs.reserve(snapshot.mods.size());
+
+				for(auto &&mod : snapshot.mods){
+					auto &&mod_objs = objs.emplace_back();
+					for(auto &&obj : mod.objs){
+						auto buffer = llvm::MemoryBuffer::getMemBuffer(
+							llvm::StringRef(obj.data(), obj.size()), llvm::StringRef(mod.name.data(), mod.name.size()), false
+						);
+
+						auto obj_file = llvm::object::ObjectFile::createObjectFile(buffer->getMemBufferRef());
+						if(!obj_file){
+							llvm::consumeError(obj_file.takeError());
+							throw module_error{fmt::format("snapshot '{}' has a bad object for module '{}'", path, mod.name)};
+						}
+
+						mod_objs.push_back(std::make_shared<llvm::object::OwningBinary<llvm::object::ObjectFile>>(
+							std::move(*obj_file), std::move(buffer)
+						));
+					}
+				}
+
+				std::lock_guard lock(m_mut);
+				collect_retired();
+
+				std::vector<jit_module*> ret;
+				ret.reserve(snapshot.mods.size());
+
+				for(std::size_t i = 0; i < snapshot.mods.size(); i++){
+					auto &&mod = snapshot.mods[i];
+					ret.push_back(add_compiled(mod.name, std::string(mod.bitcode), std::move(objs[i]), data));
+				}
+
+				if(m_shared)
+					drop_fns(nullptr);
+
+				if(user_data)
+					*user_data = snapshot.user_data;
+
+				return ret;
 			}
 
 		private:
+			// every module's ir lives in this thread's context, whichever thread created it
+			thread_pool m_ir_thread{1};
+
+			// held by whichever thread is using the layers, including lazy compiles from jit code
+			std::recursive_mutex m_mut;
+
+			// code shared with other isolates, outlives everything linked against it
+			std::shared_ptr<const llvm_code_cache> m_shared;
+
 			target t;
+			opt_level opt;
+			llvm_target_desc targetDesc;
 
 			std::unique_ptr<llvm::TargetMachine> tm;
 			const llvm::DataLayout dl;
+			llvm_object_cache objectCache;
+			std::shared_ptr<llvm_code_pool> codePool;
 			mutable llvm::orc::RTDyldObjectLinkingLayer objectLayer;
 			mutable llvm::orc::IRCompileLayer<decltype(objectLayer), llvm::orc::SimpleCompiler> compileLayer;
 
@@ -259,30 +717,761 @@ namespace purson{
 			//mutable llvm::orc::GlobalMappingLayer<decltype(codLayer)> mapLayer;
 
 			using module_handle_t = decltype(codLayer)::ModuleHandleT;
+			using object_handle_t = decltype(objectLayer)::ObjHandleT;
 			
 			std::vector<std::unique_ptr<llvm_module>> m_mods;
-			std::vector<module_handle_t> m_mod_handles;
+			std::vector<std::optional<module_handle_t>> m_mod_handles; // empty for modules compiled with create_modules
+			std::vector<std::vector<object_handle_t>> m_obj_handles;
 			std::vector<jit_module*> m_mod_ptrs;
-			
+
+			// objects of single functions compiled off the jit thread, they live as long as the moduleset
+			std::vector<object_handle_t> m_fn_objs;
+
+			struct cached_fn{
+				void *ptr;
+				const module *owner;
+			};
+
+			using fn_table = std::unordered_map<std::string, cached_fn>;
+
+			// stub and object addresses never move, so lookups only have to search the modules once
+			// copied on write and swapped in whole, so readers never lock
+			std::shared_ptr<const fn_table> m_fns = std::make_shared<const fn_table>();
+
+			struct retired_module{
+				std::optional<module_handle_t> handle;
+				std::vector<object_handle_t> objs;
+				std::unique_ptr<llvm_module> mod;
+			};
+
+			// destroyed modules are freed once the threads that entered before are gone, two phases so they never wait on new ones
+			std::atomic<std::size_t> m_phase = 0;
+			std::atomic<std::size_t> m_readers[2] = {0, 0};
+			std::vector<retired_module> m_retired[2];
+			std::atomic<bool> m_has_retired = false;
+
+			// functions replaced by reload_fns, recompiles of their old bodies are stale
+			std::unordered_map<std::string, const llvm_module*> m_reloaded;
+
+			// owners of functions not yet compiled, only while releasing ir
+			bool m_release_ir = false;
+			std::unordered_map<std::string, llvm_module*> m_fn_owners;
+			std::vector<llvm_module*> m_to_release;
+
+			// optimized bodies of small and hot exported functions, used by the compile threads too
+			llvm_inline_cache m_inlines;
+
+			std::size_t m_pool_threads = 0;
+			std::unique_ptr<thread_pool> m_pool;
+
+			std::unique_ptr<llvm_tier_compiler> m_tiers;
+
+			// modules the functions compiled in the baseline tier came from, and what instrumented code passes to the hook
+			std::unordered_map<std::string, const llvm_module*> m_tier_owners;
+			void *m_tier_jit = this;
+			std::unique_ptr<llvm_speculator> m_spec;
+			llvm_call_graph_partitioner m_partitioner;
+
+			//! run fn on the ir thread, the caller must hold m_mut and fn must not take it
+			template<typename Fn>
+			auto on_ir_thread(Fn &&fn){ return m_ir_thread.submit(std::forward<Fn>(fn)).get(); }
+
+			//! link whatever was compiled in the background and free what's done with
+			void catch_up(){
+				install_tiered();
+				install_speculated();
+				release_materialized();
+				collect_retired();
+			}
+
+			void publish_fns(fn_table found){
+				if(found.empty()) return;
+
+				auto fns = std::make_shared<fn_table>(*std::atomic_load(&m_fns));
+				for(auto &&fn : found)
+					fns->insert_or_assign(fn.first, fn.second);
+
+				std::atomic_store(&m_fns, std::shared_ptr<const fn_table>(std::move(fns)));
+			}
+
+			//! forget the functions of owner, null for shared functions
+			void drop_fns(const module *owner){
+				auto fns = std::make_shared<fn_table>(*std::atomic_load(&m_fns));
+				for(auto it = begin(*fns); it != end(*fns);){
+					if(it->second.owner == owner)
+						it = fns->erase(it);
+					else
+						++it;
+				}
+
+				std::atomic_store(&m_fns, std::shared_ptr<const fn_table>(std::move(fns)));
+			}
+
+			void free_retired(std::vector<retired_module> &mods){
+				for(auto &&mod : mods){
+					if(mod.handle)
+						cantFail(codLayer.removeModule(*mod.handle));
+
+					for(auto &&obj : mod.objs)
+						cantFail(objectLayer.removeObject(obj));
+				}
+
+				mods.clear();
+			}
+
+			//! free destroyed modules no thread can be running any more, m_mut must be held
+			void collect_retired(){
+				auto cur = m_phase.load();
+				auto old = cur ^ 1;
+
+				// readers from before the last flip are still going
+				if(m_readers[old].load() != 0) return;
+
+				free_retired(m_retired[old]);
+
+				// every reader is in the current phase, so new ones go to the other and the current one only drains
+				if(!m_retired[cur].empty()){
+					m_phase.store(old);
+					if(m_readers[cur].load() == 0)
+						free_retired(m_retired[cur]);
+				}
+
+				m_has_retired = !m_retired[0].empty() || !m_retired[1].empty();
+			}
+
+			jit_module *add_module(std::string_view name, const std::vector<std::shared_ptr<const expr>> &ast){
+				auto mod = new llvm_module(name, tm, dl, opt);
+				mod->bind_ir_thread(m_ir_thread, m_mut);
+				mod->bind_jit(*this);
+
+				mod->compile(ast);
+
+				m_mods.emplace_back(std::unique_ptr<llvm_module>(mod));
+
+				auto res = codLayer.addModule(mod->module(), make_resolver());
+				if(!res)
+					throw module_error{"failed to add module"};
+
+				m_mod_handles.emplace_back(*res);
+				m_obj_handles.emplace_back();
+
+				// after addModule so the bitcode has the symbols the layer made external
+				if(m_spec)
+					m_spec->add_module(*mod->module());
+
+				if(m_tiers){
+					for(auto &&fn : *mod->module()){
+						if(!fn.isDeclaration())
+							m_tier_owners[fn.getName().str()] = mod;
+					}
+				}
+
+				if(m_release_ir){
+					mod->track_materialization();
+					for(auto &&fn : *mod->module()){
+						if(!fn.isDeclaration())
+							m_fn_owners[fn.getName().str()] = mod;
+					}
+				}
+
+				return m_mod_ptrs.emplace_back(mod);
+			}
+
+			std::vector<jit_module*> add_modules(const std::vector<module_source> &srcs){
+				if(!m_pool)
+					m_pool = std::make_unique<thread_pool>(m_pool_threads);
+
+				// spare threads go to splitting the code generation of big modules
+				auto max_splits = std::max<std::size_t>(1, m_pool->num_threads() / std::max<std::size_t>(srcs.size(), 1));
+
+				std::vector<std::future<llvm_compiled_module>> jobs;
+				jobs.reserve(srcs.size());
+				for(auto &&src : srcs){
+					jobs.push_back(m_pool->submit([this, &src, max_splits]{
+						return llvm_compile_module_objects(src.first, src.second, targetDesc, opt, &objectCache, max_splits, &m_inlines);
+					}));
+				}
+
+				// every job has to finish before srcs goes away, even if one of them failed
+				std::vector<llvm_compiled_module> compiled;
+				compiled.reserve(srcs.size());
+				std::exception_ptr err;
+				for(auto &&job : jobs){
+					try{
+						compiled.push_back(job.get());
+					}
+					catch(...){
+						if(!err) err = std::current_exception();
+					}
+				}
+
+				if(err) std::rethrow_exception(err);
+
+				std::vector<jit_module*> ret;
+				ret.reserve(srcs.size());
+
+				// their functions can never be reloaded, so code inlining them never runs stale bodies
+				for(std::size_t i = 0; i < srcs.size(); i++){
+					ret.push_back(add_compiled(srcs[i].first, std::move(compiled[i].bitcode), std::move(compiled[i].objs)));
+					m_inlines.add_bodies(std::move(compiled[i].inline_bodies), m_mods.back().get());
+				}
+
+				return ret;
+			}
+
+			//! add a module that's already compiled, linking its objects straight away
+			jit_module *add_compiled(
+				std::string_view name, std::string bitcode, std::vector<llvm_object_ptr> objs,
+				std::shared_ptr<const llvm::MemoryBuffer> mapping = nullptr
+			){
+				auto &&handles = m_obj_handles.emplace_back();
+				for(auto &&obj : objs){
+					auto handle = objectLayer.addObject(std::move(obj), make_resolver());
+					if(!handle){
+						llvm::consumeError(handle.takeError());
+						throw module_error{fmt::format("failed to add objects for module '{}'", name)};
+					}
+
+					handles.push_back(*handle);
+				}
+
+				auto mod = new llvm_module(name, std::move(bitcode), tm, opt, std::move(mapping));
+				mod->bind_ir_thread(m_ir_thread, m_mut);
+				mod->bind_jit(*this);
+				m_mods.emplace_back(std::unique_ptr<llvm_module>(mod));
+				m_mod_handles.emplace_back(std::nullopt);
+				return m_mod_ptrs.emplace_back(mod);
+			}
+
+			//! recompile functions in a module of their own and point mod's stubs at them
+			std::vector<std::string> replace_fns(const jit_module *mod, const std::vector<std::shared_ptr<const expr>> &ast){
+				auto res = std::find_if(begin(m_mods), end(m_mods), [mod](auto &&ptr){ return ptr.get() == mod; });
+				if(res == end(m_mods))
+					throw module_error{"can not reload functions of a module from another moduleset"};
+
+				auto dist = std::distance(begin(m_mods), res);
+				auto owner = res->get();
+
+				if(!m_mod_handles[dist])
+					throw module_error{fmt::format("functions of module '{}' are linked directly and can not be reloaded", owner->name())};
+				else if(owner->released())
+					throw module_error{fmt::format("functions of module '{}' can not be reloaded once its ir was released", owner->name())};
+
+				auto replacement = std::make_unique<llvm::Module>(owner->name() + ".reload", llvm_ctx);
+				replacement->setTargetTriple(tm->getTargetTriple().str());
+				replacement->setDataLayout(dl);
+
+				{
+					llvm_state state{replacement.get()};
+					for(auto &&ptr : ast){
+						if(ptr) llvm_compile(ptr.get(), &state);
+					}
+				}
+
+				auto src = owner->module();
+
+				// the rest of a replaced function's partition calls its old body directly rather than through
+				// its stub, so those functions are compiled again here, calling the new code, and switched over too
+				std::set<std::string> repointed;
+				for(auto &&fn : *replacement){
+					if(fn.isDeclaration()) continue;
+
+					auto old = src->getFunction(fn.getName());
+					if(!old || old->isDeclaration()) continue;
+
+					for(auto &&member : m_partitioner.cluster(*old)){
+						auto name = member->getName().str();
+						auto replaced = replacement->getFunction(name);
+						if(!replaced || replaced->isDeclaration())
+							repointed.insert(std::move(name));
+					}
+				}
+
+				if(!repointed.empty()){
+					llvm::ValueToValueMapTy vmap;
+					auto callers = llvm::CloneModule(src.get(), vmap, [&repointed](const llvm::GlobalValue *gv){
+						return llvm::isa<llvm::Function>(gv) && repointed.count(gv->getName().str());
+					});
+
+					for(auto it = callers->begin(); it != callers->end();){
+						auto &&fn = *it++;
+						if(fn.isDeclaration() && fn.use_empty())
+							fn.eraseFromParent();
+					}
+
+					for(auto it = callers->global_begin(); it != callers->global_end();){
+						auto &&global = *it++;
+						if(global.isDeclaration() && global.use_empty())
+							global.eraseFromParent();
+					}
+
+					// the copies only declare the replaced functions, so they end up calling the new definitions
+					if(llvm::Linker::linkModules(*replacement, std::move(callers)))
+						throw module_error{fmt::format("failed to recompile the callers of reloaded functions in module '{}'", owner->name())};
+				}
+
+				// the old code keeps running on the original globals, so the new code must too
+				for(auto &&global : replacement->globals()){
+					if(global.isDeclaration()) continue;
+
+					auto sym = (*m_mod_handles[dist])->findSymbol(optimizeLayer, mangle(global.getName().str()), false);
+					if(!sym)
+						throw module_error{fmt::format("reloaded code in module '{}' can not add global '{}'", owner->name(), global.getName().str())};
+
+					global.setInitializer(nullptr);
+					global.setLinkage(llvm::GlobalValue::ExternalLinkage);
+				}
+
+				std::vector<std::string> ret, switched;
+				for(auto &&fn : *replacement){
+					if(fn.isDeclaration()) continue;
+
+					// local functions are visible to the original module's code too, as the compile on demand layer does
+					if(fn.hasLocalLinkage()){
+						fn.setLinkage(llvm::GlobalValue::ExternalLinkage);
+						fn.setVisibility(llvm::GlobalValue::HiddenVisibility);
+					}
+
+					// new functions are only reachable through the new code and get_fn_ptr
+					if(!(*m_mod_handles[dist])->findSymbol(optimizeLayer, mangle(fn.getName().str()), false))
+						continue;
+
+					switched.push_back(fn.getName().str());
+					if(!repointed.count(switched.back()))
+						ret.push_back(switched.back());
+				}
+
+				m_inlines.import_into(*replacement);
+
+				// optimized fully straight away, it's never tiered up
+				auto peak_tm = llvm_make_target_machine(targetDesc, llvm_codegen_opt_level(opt));
+				llvm_optimize_module(*replacement, *peak_tm, opt);
+
+				auto obj = std::make_shared<llvm::object::OwningBinary<llvm::object::ObjectFile>>(
+					llvm::orc::SimpleCompiler(*peak_tm, &objectCache)(*replacement)
+				);
+
+				auto handle = objectLayer.addObject(std::move(obj), make_resolver());
+				if(!handle){
+					llvm::consumeError(handle.takeError());
+					throw module_error{fmt::format("failed to add reloaded code for module '{}'", owner->name())};
+				}
+
+				// resolve everything before a single stub is switched over
+				std::vector<llvm::JITTargetAddress> addrs;
+				addrs.reserve(switched.size());
+				for(auto &&name : switched){
+					llvm::JITTargetAddress addr = 0;
+					if(auto sym = objectLayer.findSymbolIn(*handle, mangle(name), false)){
+						if(auto sym_addr = sym.getAddress())
+							addr = *sym_addr;
+						else
+							llvm::consumeError(sym_addr.takeError());
+					}
+
+					if(!addr){
+						cantFail(objectLayer.removeObject(*handle));
+						throw module_error{fmt::format("failed to link reloaded function '{}'", name)};
+					}
+
+					addrs.push_back(addr);
+				}
+
+				m_obj_handles[dist].push_back(*handle);
+
+				for(std::size_t i = 0; i < switched.size(); i++){
+					auto &&name = switched[i];
+
+					// the old body must never be compiled and pointed at again
+					if(auto old = src->getFunction(name))
+						m_partitioner.exclude(*old);
+
+					if(m_spec)
+						m_spec->replaced(name);
+
+					note_materialized(name);
+					m_reloaded[name] = owner;
+
+					// the stub pointer is a single aligned word, callers see either the old or the new code
+					if(auto err = codLayer.updatePointer(mangle(name), addrs[i]))
+						llvm::consumeError(std::move(err));
+				}
+
+				return ret;
+			}
+
+			std::string mangle(const std::string &name) const{
+				std::string ret;
+				llvm::raw_string_ostream str(ret);
+				llvm::Mangler::getNameWithPrefix(str, name, dl);
+				return str.str();
+			}
+
+			std::shared_ptr<llvm::JITSymbolResolver> make_resolver(){
+				return llvm::orc::createLambdaResolver(
+						[this](const std::string &name) -> llvm::JITSymbol{
+							// only live modules, destroyed ones may still be waiting for threads to leave their code
+							for(std::size_t i = 0; i < m_mods.size(); i++){
+								if(m_mod_handles[i]){
+									auto sym = (*m_mod_handles[i])->findSymbol(optimizeLayer, name, false);
+									if(sym) return sym;
+									else if(auto err = sym.takeError())
+										return std::move(err);
+								}
+
+								// modules linked eagerly by create_modules and reloaded functions
+								for(auto &&obj : m_obj_handles[i]){
+									if(auto sym = objectLayer.findSymbolIn(obj, name, false))
+										return sym;
+								}
+							}
+
+							for(auto &&obj : m_fn_objs){
+								if(auto sym = objectLayer.findSymbolIn(obj, name, false))
+									return sym;
+							}
+
+							if(m_shared){
+								if(auto addr = m_shared->find(name))
+									return llvm::JITSymbol(addr, llvm::JITSymbolFlags::Exported);
+							}
+
+							return nullptr;
+						},
+						[this](const std::string &name) -> llvm::JITSymbol{
+							std::string_view unprefixed = name;
+							if(dl.getGlobalPrefix() && !unprefixed.empty() && (unprefixed[0] == dl.getGlobalPrefix()))
+								unprefixed.remove_prefix(1);
+
+							if(unprefixed == llvm_tier_compiler::hook_name)
+								return llvm::JITSymbol(reinterpret_cast<std::uintptr_t>(&tier_up_hook), llvm::JITSymbolFlags::Exported);
+
+							if(unprefixed == llvm_tier_compiler::jit_name)
+								return llvm::JITSymbol(reinterpret_cast<std::uintptr_t>(&m_tier_jit), llvm::JITSymbolFlags::Exported);
+
+							return llvm_process_symbol(name, dl);
+						}
+				);
+			}
+
+			static void tier_up_hook(void *self, std::uint64_t id, std::uint64_t *counter){
+				auto moduleset = static_cast<llvm_moduleset*>(self);
+				moduleset->m_tiers->request(id);
+
+				// called from jit code on any thread, which must never wait on a compile
+				if(moduleset->m_mut.try_lock()){
+					moduleset->install_tiered();
+					moduleset->m_mut.unlock();
+				}
+
+				// poll again later in case the recompile hasn't finished yet
+				*counter = llvm_tier_compiler::threshold - llvm_tier_compiler::recheck_interval;
+			}
+
+			cached_fn find_fn_ptr(const std::string &mangled_name){
+				auto llvmName = mangle(mangled_name);
+
+				for(std::size_t i = 0; i < m_mods.size(); i++){
+					if(m_mod_handles[i]){
+						llvm::JITSymbol fn = (*m_mod_handles[i])->findSymbol(optimizeLayer, llvmName, true);
+						if(fn)
+							return {reinterpret_cast<void*>(fn.getAddress().get()), m_mods[i].get()};
+					}
+
+					for(auto &&obj : m_obj_handles[i]){
+						auto fn = objectLayer.findSymbolIn(obj, llvmName, true);
+						if(fn)
+							return {reinterpret_cast<void*>(fn.getAddress().get()), m_mods[i].get()};
+					}
+				}
+
+				if(m_shared){
+					if(auto addr = m_shared->find(llvmName))
+						return {reinterpret_cast<void*>(addr), nullptr};
+				}
+
+				return {nullptr, nullptr};
+			}
+
+			//! link an object compiled off the jit thread, @returns the address of sym_name in it or 0
+			llvm::JITTargetAddress link_object(llvm_object_ptr obj, const std::string &sym_name){
+				auto handle = objectLayer.addObject(std::move(obj), make_resolver());
+				if(!handle){
+					llvm::consumeError(handle.takeError());
+					return 0;
+				}
+
+				auto sym = objectLayer.findSymbolIn(*handle, mangle(sym_name), false);
+				if(!sym){
+					llvm::consumeError(sym.takeError());
+					cantFail(objectLayer.removeObject(*handle));
+					return 0;
+				}
+
+				auto addr = sym.getAddress();
+				if(!addr){
+					llvm::consumeError(addr.takeError());
+					cantFail(objectLayer.removeObject(*handle));
+					return 0;
+				}
+
+				m_fn_objs.push_back(*handle);
+				return *addr;
+			}
+
+			//! link finished recompiles and point their stubs at them
+			void install_tiered(){
+				if(!m_tiers) return;
+
+				for(auto &&res : m_tiers->take_finished()){
+					if(m_reloaded.count(res.name)) continue;
+
+					auto addr = link_object(std::move(res.obj), llvm_tier_compiler::peak_name(res.name));
+					if(!addr) continue;
+
+					// later modules may inline it even if it's a bit bigger
+					m_inlines.mark_hot(res.name);
+
+					if(auto err = codLayer.updatePointer(mangle(res.name), addr))
+						llvm::consumeError(std::move(err));
+				}
+			}
+
+			//! link finished speculative compiles and point their stubs at them before they're ever called
+			void install_speculated(){
+				if(!m_spec) return;
+
+				for(auto &&res : m_spec->take_finished()){
+					auto addr = link_object(std::move(res.obj), llvm_speculator::spec_name(res.name));
+					if(!addr) continue;
+
+					if(auto err = codLayer.updatePointer(mangle(res.name), addr)){
+						llvm::consumeError(std::move(err));
+						continue;
+					}
+
+					m_spec->materialized(res.name);
+					note_materialized(res.name);
+				}
+			}
+
+			void note_materialized(const std::string &name){
+				if(!m_release_ir) return;
+
+				auto res = m_fn_owners.find(name);
+				if(res == end(m_fn_owners)) return;
+
+				auto owner = res->second;
+				m_fn_owners.erase(res);
+
+				if(owner->materialized_fn())
+					m_to_release.push_back(owner);
+			}
+
+			//! release the ir of modules that were completely compiled since the last call
+			void release_materialized(){
+				// deferred because the layer may still be using the source module while a partition is compiled
+				for(auto &&mod : m_to_release){
+					m_partitioner.forget(mod->loaded_module());
+					mod->release_ir();
+				}
+
+				m_to_release.clear();
+			}
+
+			//! replace the body of fn with a tail call to its speculatively compiled body
+			void forward_to_speculated(llvm::Function &fn){
+				auto target = llvm::Function::Create(
+					fn.getFunctionType(), llvm::Function::ExternalLinkage,
+					llvm_speculator::spec_name(fn.getName()), fn.getParent()
+				);
+
+				auto linkage = fn.getLinkage();
+				fn.deleteBody();
+				fn.setLinkage(linkage);
+
+				llvm::IRBuilder<> builder(llvm::BasicBlock::Create(fn.getContext(), "entry", &fn));
+
+				std::vector<llvm::Value*> args;
+				args.reserve(fn.arg_size());
+				for(auto &&arg : fn.args())
+					args.push_back(&arg);
+
+				auto call = builder.CreateCall(target, args);
+				call->setTailCall();
+
+				if(fn.getReturnType()->isVoidTy())
+					builder.CreateRetVoid();
+				else
+					builder.CreateRet(call);
+			}
+
 			std::shared_ptr<llvm::Module> optimizeModule(std::shared_ptr<llvm::Module> m){
-				auto fpm = llvm::make_unique<llvm::legacy::FunctionPassManager>(m.get());
-				fpm->add(llvm::createPromoteMemoryToRegisterPass());
-				fpm->add(llvm::createInstructionCombiningPass());
-				fpm->add(llvm::createReassociatePass());
-				fpm->add(llvm::createGVNPass());
-				fpm->add(llvm::createCFGSimplificationPass());
-				fpm->doInitialization();
+				release_materialized();
 
-				for(auto &f : *m){
-					fpm->run(f);
+				if(m_release_ir){
+					for(auto &&fn : *m){
+						if(!fn.isDeclaration())
+							note_materialized(fn.getName().str());
+					}
 				}
 
-				fpm->doFinalization();
+				if(!m_tiers){
+					// this is a lazy compile, so it's also where speculation gets going
+					install_speculated();
+
+					for(auto &&fn : *m){
+						if(fn.isDeclaration()) continue;
+
+						if(auto obj = m_spec->claim(fn.getName())){
+							if(link_object(std::move(obj), llvm_speculator::spec_name(fn.getName())))
+								forward_to_speculated(fn);
+						}
+
+						m_spec->materialized(fn.getName());
+					}
+
+					// small functions from modules created together, which can't be reloaded
+					m_inlines.import_into(*m);
+
+					llvm_optimize_module(*m, *tm, opt);
+					return m;
+				}
+
+				// baseline tier, hot functions are recompiled at opt later
+				const llvm_module *owner = nullptr;
+				for(auto &&fn : *m){
+					if(fn.isDeclaration()) continue;
+
+					auto res = m_tier_owners.find(fn.getName().str());
+					if(res != end(m_tier_owners)){
+						owner = res->second;
+						break;
+					}
+				}
+
+				m_tiers->instrument(*m, owner);
+
 				return m;
 			};
 	};
 	
-	std::unique_ptr<jit_moduleset> make_jit_moduleset(target t){
-		return std::unique_ptr<jit_moduleset>(new llvm_moduleset(t));
+	class llvm_object_moduleset: public object_moduleset{
+		public:
+			llvm_object_moduleset(opt_level opt_, llvm_target_desc desc, bool pic)
+			: opt(opt_), targetDesc(std::move(desc)),
+			  tm(llvm_make_target_machine(targetDesc, llvm_codegen_opt_level(opt_), pic ? llvm::Reloc::PIC_ : llvm::Reloc::Static)),
+			  dl(tm->createDataLayout()){}
+
+			module *create_module(std::string_view name, const std::vector<std::shared_ptr<const expr>> &ast) override{
+				auto mod = new llvm_module(name, tm, dl, opt);
+				m_mods.emplace_back(std::unique_ptr<llvm_module>(mod));
+
+				mod->compile(ast);
+				return mod;
+			}
+
+			bool destroy_module(const module *mod) noexcept override{
+				auto res = std::find_if(begin(m_mods), end(m_mods), [mod](auto &&ptr){ return ptr.get() == mod; });
+				if(res == end(m_mods))
+					return false;
+
+				m_mods.erase(res);
+				return true;
+			}
+
+			// nothing runs until it's linked
+			void *get_fn_ptr(std::string_view) override{ return nullptr; }
+
+			void write(std::string_view path, std::string_view entry) override{
+				auto linked = link_modules(path, m_mods, *tm);
+				if(!entry.empty())
+					add_c_main(*linked, entry);
+
+				auto versioned = llvm_multiversion(*linked, m_multiversioned);
+				check_multiversioned({begin(versioned), end(versioned)});
+
+				// everything is in one module now, so this inlines across source files too
+				llvm_optimize_module(*linked, *tm, opt);
+				emit_object(*linked, *tm, path);
+			}
+
+			std::vector<std::string> write_thin(std::string_view path, std::string_view entry, bool keep_exports) override{
+				std::vector<std::unique_ptr<llvm::Module>> mods;
+				mods.reserve(m_mods.size());
+
+				bool has_entry = entry.empty();
+				std::set<std::string> versioned;
+				for(auto &&mod : m_mods){
+					auto &&copy = mods.emplace_back(llvm::CloneModule(mod->module().get()));
+
+					auto entry_fn = has_entry ? nullptr : copy->getFunction(std::string(entry));
+					if(entry_fn && !entry_fn->isDeclaration()){
+						add_c_main(*copy, entry);
+						has_entry = true;
+					}
+
+					for(auto &&name : llvm_multiversion(*copy, m_multiversioned))
+						versioned.insert(std::move(name));
+				}
+
+				if(!has_entry)
+					throw module_error{fmt::format("entry point '{}' is not defined", entry)};
+
+				check_multiversioned(versioned);
+
+				return llvm_thin_link(std::move(mods), targetDesc, opt, path, keep_exports);
+			}
+
+			void set_multiversioned(std::vector<std::string> names) override{ m_multiversioned = std::move(names); }
+
+		private:
+			opt_level opt;
+			llvm_target_desc targetDesc;
+			std::unique_ptr<llvm::TargetMachine> tm;
+			const llvm::DataLayout dl;
+
+			std::vector<std::unique_ptr<llvm_module>> m_mods;
+			std::vector<std::string> m_multiversioned;
+
+			//! @throws module_error if a function asked to be versioned wasn't defined by any module
+			void check_multiversioned(const std::set<std::string> &versioned) const{
+				for(auto &&name : m_multiversioned){
+					if(!versioned.count(name))
+						throw module_error{fmt::format("function '{}' to multiversion is not defined in any module", name)};
+				}
+			}
+	};
+
+	std::unique_ptr<object_moduleset> make_object_moduleset(target t, opt_level opt, const target_cpu &cpu, bool pic){
+		// objects are usually run on other machines, so they only use the host's cpu when asked to
+		return std::unique_ptr<object_moduleset>(new llvm_object_moduleset(opt, llvm_describe_target(t, cpu, false), pic));
+	}
+
+	std::unique_ptr<jit_moduleset> make_jit_moduleset(target t, opt_level opt, bool tiered, const target_cpu &cpu){
+		auto desc = llvm_describe_target(t, cpu);
+		if(!llvm_target_is_host(desc))
+			throw module_error{fmt::format("can not jit compile for '{}' on this machine", desc.triple)};
+
+		return std::unique_ptr<jit_moduleset>(new llvm_moduleset(t, opt, tiered, std::move(desc)));
+	}
+
+	std::shared_ptr<jit_code_cache> make_jit_code_cache(target t, opt_level opt, const target_cpu &cpu){
+		auto desc = llvm_describe_target(t, cpu);
+		if(!llvm_target_is_host(desc))
+			throw module_error{fmt::format("can not jit compile for '{}' on this machine", desc.triple)};
+
+		return std::make_shared<llvm_code_cache>(t, opt, std::move(desc));
+	}
+
+	std::unique_ptr<jit_moduleset> make_jit_isolate(std::shared_ptr<const jit_code_cache> shared, bool tiered){
+		auto cache = std::dynamic_pointer_cast<const llvm_code_cache>(shared);
+		if(!cache)
+			throw module_error{"isolates can only share code from make_jit_code_cache"};
+
+		auto t = cache->get_target();
+		auto opt = cache->get_opt();
+		auto desc = cache->desc();
+		return std::unique_ptr<jit_moduleset>(new llvm_moduleset(t, opt, tiered, std::move(desc), std::move(cache)));
 	}
 }
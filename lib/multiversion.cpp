@@ -0,0 +1,95 @@
+#include <llvm/ADT/Triple.h>
+#include <llvm/IR/GlobalIFunc.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include "multiversion.hpp"
+
+namespace purson{
+	namespace{
+		struct feature_level{
+			std::int32_t level; // as returned by purson_cpu_level
+			const char *suffix;
+			const char *cpu;
+			const char *features;
+		};
+
+		// best first, these roughly follow the x86-64-v2 to v4 psABI levels
+		const feature_level feature_levels[] = {
+			{3, "avx512", "skylake-avx512", "+avx512f,+avx512cd,+avx512bw,+avx512dq,+avx512vl,+avx2,+fma,+bmi,+bmi2,+lzcnt,+movbe"},
+			{2, "avx2", "haswell", "+avx2,+fma,+bmi,+bmi2,+lzcnt,+movbe"},
+			{1, "sse42", "nehalem", "+sse4.2,+popcnt"}
+		};
+
+		void multiversion_fn(llvm::Module &mod, llvm::Function &fn){
+			auto &&ctx = mod.getContext();
+
+			auto name = fn.getName().str();
+			auto linkage = fn.getLinkage();
+			auto visibility = fn.getVisibility();
+
+			// the original body becomes the fallback
+			fn.setName(name + ".default");
+			fn.setLinkage(llvm::GlobalValue::InternalLinkage);
+			fn.setVisibility(llvm::GlobalValue::DefaultVisibility);
+
+			std::vector<std::pair<std::int32_t, llvm::Function*>> variants;
+			for(auto &&level : feature_levels){
+				llvm::ValueToValueMapTy vmap;
+				auto variant = llvm::CloneFunction(&fn, vmap);
+				variant->setName(fmt::format("{}.{}", name, level.suffix));
+				variant->addFnAttr("target-cpu", level.cpu);
+
+				auto features = fn.getFnAttribute("target-features").getValueAsString().str();
+				variant->addFnAttr("target-features", features.empty() ? std::string(level.features) : fmt::format("{},{}", features, level.features));
+
+				variants.emplace_back(level.level, variant);
+			}
+
+			auto resolver = llvm::Function::Create(
+				llvm::FunctionType::get(fn.getType(), false),
+				llvm::GlobalValue::InternalLinkage, name + ".resolver", &mod
+			);
+
+			auto ifunc = llvm::GlobalIFunc::create(fn.getFunctionType(), 0, linkage, name, resolver, &mod);
+			ifunc->setVisibility(visibility);
+
+			// callers, including recursive calls in the variants, go through the ifunc
+			fn.replaceAllUsesWith(ifunc);
+
+			// the resolver runs before relocations are done, so the runtime function must be hidden to be called directly
+			auto cpu_level = llvm_runtime_fn(&mod, "purson_cpu_level", llvm::Type::getInt32Ty(ctx), {});
+			cpu_level->setVisibility(llvm::GlobalValue::HiddenVisibility);
+
+			llvm::IRBuilder<> builder(llvm::BasicBlock::Create(ctx, "entry", resolver));
+			auto level = builder.CreateCall(cpu_level);
+
+			llvm::Value *chosen = &fn;
+			for(auto it = variants.rbegin(); it != variants.rend(); ++it){
+				auto supported = builder.CreateICmpSGE(level, builder.getInt32(it->first));
+				chosen = builder.CreateSelect(supported, it->second, chosen);
+			}
+
+			builder.CreateRet(chosen);
+		}
+	}
+
+	std::vector<std::string> llvm_multiversion(llvm::Module &mod, const std::vector<std::string> &names){
+		std::vector<std::string> ret;
+		if(names.empty()) return ret;
+
+		llvm::Triple triple(mod.getTargetTriple());
+		if((triple.getArch() != llvm::Triple::x86_64) || !triple.isOSBinFormatELF())
+			throw module_error{fmt::format("function multiversioning needs an x86-64 elf target, not '{}'", triple.str())};
+
+		for(auto &&name : names){
+			auto fn = mod.getFunction(name);
+			if(!fn || fn->isDeclaration())
+				continue;
+
+			multiversion_fn(mod, *fn);
+			ret.push_back(name);
+		}
+
+		return ret;
+	}
+}
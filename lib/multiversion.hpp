@@ -0,0 +1,29 @@
+#ifndef PURSON_LIB_MULTIVERSION_HPP
+#define PURSON_LIB_MULTIVERSION_HPP 1
+
+#include "llvm.hpp"
+
+namespace purson{
+	/**
+	 * Compile functions for several cpu feature levels, picking one when the program is loaded
+	 *
+	 * Each function is cloned once per x86-64 feature level with that
+	 * level's cpu and features as function attributes, so the vectorizers
+	 * and instruction selection can use them. The original body is kept
+	 * as the fallback for the module's own target. The function's name
+	 * becomes an ifunc whose resolver asks the runtime for the best level
+	 * the cpu supports, so the dynamic loader binds every call to a
+	 * variant once and calls cost the same as any other through the plt.
+	 *
+	 * The module's target should be a baseline cpu like x86-64, variants
+	 * can only add features on top of it.
+	 *
+	 * @param[in] mod module to change, before it's optimized
+	 * @param[in] names mangled names of the functions to version, names not defined in mod are skipped
+	 * @returns the names that mod defines, which were versioned
+	 * @throws module_error if mod isn't for an x86-64 elf target
+	 **/
+	std::vector<std::string> llvm_multiversion(llvm::Module &mod, const std::vector<std::string> &names);
+}
+
+#endif // !PURSON_LIB_MULTIVERSION_HPP
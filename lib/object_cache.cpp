@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SHA1.h>
+
+#include "object_cache.hpp"
+
+namespace fs = std::filesystem;
+
+namespace purson{
+	std::string llvm_object_cache::target_salt(const llvm::TargetMachine &tm, opt_level opt){
+		return fmt::format(
+			"{}|{}|{}|{}",
+			tm.getTargetTriple().str(), tm.getTargetCPU().str(), tm.getTargetFeatureString().str(), static_cast<int>(opt)
+		);
+	}
+
+	void llvm_object_cache::set_dir(std::string_view dir, std::size_t max_bytes){
+		std::error_code ec;
+		fs::create_directories(fs::path(dir), ec);
+		if(ec)
+			throw module_error{fmt::format("could not create object cache directory '{}': {}", dir, ec.message())};
+
+		std::lock_guard lock(m_mut);
+		m_dir = dir;
+		m_max_bytes = max_bytes;
+		m_sized = false;
+	}
+
+	std::string llvm_object_cache::key(const llvm::Module *mod) const{
+		std::string bitcode;
+		{
+			llvm::raw_string_ostream os(bitcode);
+			llvm::WriteBitcodeToFile(mod, os);
+		}
+
+		llvm::SHA1 hasher;
+		hasher.update(m_salt);
+		hasher.update(bitcode);
+		return llvm::toHex(hasher.final(), true);
+	}
+
+	std::unique_ptr<llvm::MemoryBuffer> llvm_object_cache::getObject(const llvm::Module *mod){
+		fs::path path;
+		{
+			std::lock_guard lock(m_mut);
+			if(m_dir.empty()) return nullptr;
+			path = fs::path(m_dir);
+		}
+
+		auto mod_key = key(mod);
+		path /= mod_key + ".o";
+
+		auto buffer = llvm::MemoryBuffer::getFile(path.string());
+		if(!buffer){
+			std::lock_guard lock(m_mut);
+			m_pending[mod] = std::move(mod_key);
+			return nullptr;
+		}
+
+		// recently used objects are the last to be evicted
+		std::error_code ec;
+		fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+		return std::move(*buffer);
+	}
+
+	void llvm_object_cache::notifyObjectCompiled(const llvm::Module *mod, llvm::MemoryBufferRef obj){
+		std::lock_guard lock(m_mut);
+		if(m_dir.empty()) return;
+
+		auto res = m_pending.find(mod);
+		if(res == end(m_pending)) return;
+
+		auto path = fs::path(m_dir) / (res->second + ".o");
+		m_pending.erase(res);
+
+		// written under a temporary name so other processes never see half an object
+		auto tmp_path = path;
+		tmp_path += ".tmp";
+
+		{
+			std::ofstream out(tmp_path, std::ios::binary);
+			out.write(obj.getBufferStart(), obj.getBufferSize());
+			if(!out) return;
+		}
+
+		std::error_code ec;
+		fs::rename(tmp_path, path, ec);
+		if(ec){
+			fs::remove(tmp_path, ec);
+			return;
+		}
+
+		// the directory is only scanned once it might have grown past the limit
+		m_size += obj.getBufferSize();
+		if(!m_sized || (m_size > m_max_bytes))
+			evict();
+	}
+
+	void llvm_object_cache::evict(){
+		struct cached_obj{
+			fs::path path;
+			std::uintmax_t size;
+			fs::file_time_type used;
+		};
+
+		std::vector<cached_obj> objs;
+		std::uintmax_t total = 0;
+
+		std::error_code ec;
+		for(auto &&dir_entry : fs::directory_iterator(m_dir, ec)){
+			if(!dir_entry.is_regular_file(ec) || (dir_entry.path().extension() != ".o"))
+				continue;
+
+			auto size = dir_entry.file_size(ec);
+			if(ec) continue;
+
+			total += size;
+			objs.push_back({dir_entry.path(), size, dir_entry.last_write_time(ec)});
+		}
+
+		m_size = total;
+		m_sized = true;
+
+		if(total <= m_max_bytes) return;
+
+		std::sort(begin(objs), end(objs), [](auto &&lhs, auto &&rhs){ return lhs.used < rhs.used; });
+
+		for(auto &&obj : objs){
+			if(m_size <= m_max_bytes) break;
+			if(fs::remove(obj.path, ec))
+				m_size -= obj.size;
+		}
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef PURSON_LIB_OBJECT_CACHE_HPP
+#define PURSON_LIB_OBJECT_CACHE_HPP 1
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+
+#include "llvm.hpp"
+
+namespace purson{
+	/**
+	 * On disk cache of compiled objects.
+	 *
+	 * Objects are keyed by a hash of the module bitcode and a salt describing
+	 * the target machine and optimization level, and stored as one file each
+	 * in a directory. Once the directory grows past its size limit the least
+	 * recently used objects are removed. Does nothing until a directory is set.
+	 **/
+	class llvm_object_cache: public llvm::ObjectCache{
+		public:
+			//! @param[in] salt extra data hashed into every key
+			explicit llvm_object_cache(std::string salt): m_salt(std::move(salt)){}
+
+			//! @returns salt for objects compiled by tm at opt
+			static std::string target_salt(const llvm::TargetMachine &tm, opt_level opt);
+
+			void set_dir(std::string_view dir, std::size_t max_bytes);
+
+			void notifyObjectCompiled(const llvm::Module *mod, llvm::MemoryBufferRef obj) override;
+			std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *mod) override;
+
+		private:
+			std::string m_salt;
+			std::string m_dir;
+			std::size_t m_max_bytes = 0;
+
+			std::mutex m_mut;
+
+			// bytes in the directory as of the last scan plus what was written since, other processes may add more
+			std::uintmax_t m_size = 0;
+			bool m_sized = false;
+
+			// keys of modules looked up but not yet compiled
+			std::map<const llvm::Module*, std::string> m_pending;
+
+			std::string key(const llvm::Module *mod) const;
+
+			//! scan the directory for its real size and remove the least recently used objects past the limit
+			void evict();
+	};
+}
+
+#endif // !PURSON_LIB_OBJECT_CACHE_HPP
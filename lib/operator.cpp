@@ -3,7 +3,7 @@
 #include <fmt/format.h>
 
 namespace purson{
-	void op::set_op(binary_op_tag_t, std::optional<operator_type> op_ty_opt, const type *lhs, const type *rhs){
+	void op::set_op(binary_op_tag_t, std::optional<operator_type> op_ty_opt, const type *lhs, const type *rhs, const typeset *types){
 		if(!op_ty_opt) throw operator_error{"invalid binary operator '{}'"};
 		
 		auto &op_ty = op_ty_opt.value();
@@ -16,7 +16,24 @@ namespace purson{
 		
 		m_bin = true;
 		m_op_type = op_ty;
-		m_result_type = promote_type(lhs, rhs);
+		
+		switch(op_ty){
+			case operator_type::equ:
+			case operator_type::neq:
+			case operator_type::lt:
+			case operator_type::gt:
+			case operator_type::lte:
+			case operator_type::gte:{
+				if(!types) throw operator_error{"typeset required for comparison operator"};
+				promote_type(lhs, rhs); // operands must still be comparable
+				m_result_type = types->boolean();
+				break;
+			}
+			
+			default:
+				m_result_type = promote_type(lhs, rhs);
+				break;
+		}
 	}
 	
 	void op::set_op(unary_op_tag_t, std::optional<operator_type> op_ty_opt, const type *operand){
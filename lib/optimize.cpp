@@ -0,0 +1,53 @@
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+
+#include "llvm.hpp"
+
+namespace purson{
+	llvm::CodeGenOpt::Level llvm_codegen_opt_level(opt_level opt) noexcept{
+		switch(opt){
+			case opt_level::O0: return llvm::CodeGenOpt::None;
+			case opt_level::O1: return llvm::CodeGenOpt::Less;
+			case opt_level::O3: return llvm::CodeGenOpt::Aggressive;
+			default: return llvm::CodeGenOpt::Default;
+		}
+	}
+
+	void llvm_optimize_module(llvm::Module &mod, llvm::TargetMachine &tm, opt_level opt){
+		if(opt == opt_level::O0) return;
+
+		llvm::PassManagerBuilder builder;
+		switch(opt){
+			case opt_level::O1: builder.OptLevel = 1; break;
+			case opt_level::O3: builder.OptLevel = 3; break;
+			default: builder.OptLevel = 2; break;
+		}
+
+		builder.SizeLevel = opt == opt_level::Os ? 1 : 0;
+		builder.Inliner = llvm::createFunctionInliningPass(builder.OptLevel, builder.SizeLevel, false);
+		builder.LoopVectorize = builder.OptLevel > 1;
+		builder.SLPVectorize = builder.OptLevel > 1;
+
+		// lets the target add its own passes and cost model
+		tm.adjustPassManager(builder);
+
+		llvm::legacy::FunctionPassManager fpm(&mod);
+		llvm::legacy::PassManager mpm;
+
+		fpm.add(llvm::createTargetTransformInfoWrapperPass(tm.getTargetIRAnalysis()));
+		mpm.add(llvm::createTargetTransformInfoWrapperPass(tm.getTargetIRAnalysis()));
+
+		builder.populateFunctionPassManager(fpm);
+		builder.populateModulePassManager(mpm);
+
+		fpm.doInitialization();
+		for(auto &f : mod)
+			fpm.run(f);
+
+		fpm.doFinalization();
+
+		mpm.run(mod);
+	}
+}
@@ -0,0 +1,83 @@
+#include <algorithm>
+
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/CodeGen/ParallelCG.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "parallel.hpp"
+
+namespace purson{
+	namespace{
+		llvm_object_ptr make_object(llvm::StringRef data, llvm::StringRef name){
+			auto buffer = llvm::MemoryBuffer::getMemBufferCopy(data, name);
+			auto obj = llvm::object::ObjectFile::createObjectFile(buffer->getMemBufferRef());
+			if(!obj){
+				llvm::consumeError(obj.takeError());
+				throw module_error{fmt::format("invalid object generated for module '{}'", name.str())};
+			}
+
+			return std::make_shared<llvm::object::OwningBinary<llvm::object::ObjectFile>>(std::move(*obj), std::move(buffer));
+		}
+	}
+
+	llvm_compiled_module llvm_compile_module_objects(
+		std::string_view name, const std::vector<std::shared_ptr<const expr>> &ast,
+		const llvm_target_desc &desc, opt_level opt, llvm::ObjectCache *cache, std::size_t max_splits,
+		const llvm_inline_cache *inlines
+	){
+		auto tm = llvm_make_target_machine(desc, llvm_codegen_opt_level(opt));
+
+		auto mod = std::make_unique<llvm::Module>(std::string(name), llvm_ctx);
+		mod->setTargetTriple(tm->getTargetTriple().str());
+		mod->setDataLayout(tm->createDataLayout());
+
+		{
+			llvm_state state{mod.get()};
+			for(auto &&ptr : ast){
+				if(ptr) llvm_compile(ptr.get(), &state);
+			}
+		}
+
+		llvm_compiled_module ret;
+
+		// before importing, so only the module's own functions are extracted
+		if(inlines){
+			ret.inline_bodies = llvm_inline_cache::extract_bodies(*mod, *tm, opt);
+			inlines->import_into(*mod);
+		}
+
+		llvm_optimize_module(*mod, *tm, opt);
+
+		{
+			llvm::raw_string_ostream os(ret.bitcode);
+			llvm::WriteBitcodeToFile(mod.get(), os);
+		}
+
+		auto num_defs = static_cast<std::size_t>(std::count_if(mod->begin(), mod->end(), [](auto &&fn){ return !fn.isDeclaration(); }));
+		auto num_splits = std::clamp<std::size_t>(num_defs / llvm_functions_per_split, 1, std::max<std::size_t>(max_splits, 1));
+
+		if(num_splits == 1){
+			llvm::orc::SimpleCompiler compiler(*tm, cache);
+			ret.objs.push_back(std::make_shared<llvm::object::OwningBinary<llvm::object::ObjectFile>>(compiler(*mod)));
+			return ret;
+		}
+
+		// each part is reparsed into a context of its own and compiled on its own thread
+		std::vector<llvm::SmallVector<char, 0>> bufs(num_splits);
+		std::vector<std::unique_ptr<llvm::raw_svector_ostream>> streams;
+		std::vector<llvm::raw_pwrite_stream*> stream_ptrs;
+		streams.reserve(num_splits);
+		stream_ptrs.reserve(num_splits);
+
+		for(auto &&buf : bufs)
+			stream_ptrs.push_back(streams.emplace_back(std::make_unique<llvm::raw_svector_ostream>(buf)).get());
+
+		llvm::splitCodeGen(std::move(mod), stream_ptrs, {}, [&desc, opt]{ return llvm_make_target_machine(desc, llvm_codegen_opt_level(opt)); });
+
+		for(auto &&buf : bufs)
+			ret.objs.push_back(make_object(llvm::StringRef(buf.data(), buf.size()), llvm::StringRef(name.data(), name.size())));
+
+		return ret;
+	}
+}
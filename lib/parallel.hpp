@@ -0,0 +1,45 @@
+#ifndef PURSON_LIB_PARALLEL_HPP
+#define PURSON_LIB_PARALLEL_HPP 1
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Object/ObjectFile.h>
+
+#include "llvm.hpp"
+#include "inline_cache.hpp"
+
+namespace purson{
+	using llvm_object_ptr = std::shared_ptr<llvm::object::OwningBinary<llvm::object::ObjectFile>>;
+
+	//! module compiled to machine code away from the jit thread
+	struct llvm_compiled_module{
+		//! optimized ir, in no particular context
+		std::string bitcode;
+		std::vector<llvm_object_ptr> objs;
+
+		//! importable function bodies, only extracted when compiled with an inline cache
+		std::vector<llvm_inline_cache::fn_body> inline_bodies;
+	};
+
+	//! modules with at least this many functions per available thread have their code generation split
+	constexpr std::size_t llvm_functions_per_split = 32;
+
+	/**
+	 * Generate, optimize and compile a module entirely in the calling thread's context
+	 *
+	 * @param[in] name module name
+	 * @param[in] ast expressions to compile
+	 * @param[in] desc target to compile for
+	 * @param[in] opt optimization level
+	 * @param[in] cache object cache to use, may be null
+	 * @param[in] max_splits maximum number of parts code generation may be split in to
+	 * @param[in] inlines bodies of other modules' functions to inline, may be null to neither import nor extract any
+	 * @returns the optimized ir and an object for each part
+	 **/
+	llvm_compiled_module llvm_compile_module_objects(
+		std::string_view name, const std::vector<std::shared_ptr<const expr>> &ast,
+		const llvm_target_desc &desc, opt_level opt, llvm::ObjectCache *cache, std::size_t max_splits,
+		const llvm_inline_cache *inlines = nullptr
+	);
+}
+
+#endif // !PURSON_LIB_PARALLEL_HPP
@@ -12,6 +12,7 @@ namespace purson{
 		switch(it->type()){
 			case token_type::integer:
 			case token_type::real:
+			case token_type::imaginary:
 			case token_type::string:{
 				auto &&lit = *it;
 				return parse_literal(lit, delim_fn, ++it, end, scope);
@@ -45,6 +46,7 @@ namespace purson{
 		switch(it->type()){
 			case token_type::integer:
 			case token_type::real:
+			case token_type::imaginary:
 			case token_type::string:{
 				auto &&lit = *it++;
 				return parse_literal(lit, delim_fn, it, end, scope);
@@ -233,7 +235,8 @@ namespace purson{
 		
 		switch(it->type()){
 			case token_type::integer:
-			case token_type::real:{
+			case token_type::real:
+			case token_type::imaginary:{
 				auto &&lit = *it;
 				auto val = parse_literal(lit, delim_fn, ++it, end, scope);
 				return std::make_shared<const unary_op_expr>(*op_opt, val);
@@ -253,7 +256,7 @@ namespace purson{
 		else if(delim_fn(*it)) throw parser_error{op.loc(), "expected value after binary operator"};
 
 		auto rhs = parse_value(delim_fn, it, end, scope);
-		return std::make_shared<const binary_op_expr>(*op_opt, std::move(lhs), std::move(rhs));
+		return std::make_shared<const binary_op_expr>(*op_opt, std::move(lhs), std::move(rhs), scope.typeset());
 	}
 	
 	std::shared_ptr<const rvalue_expr> parse_literal(const token &lit, delim_fn_t delim_fn, token_iterator_t &it, token_iterator_t end, parser_scope &scope){
@@ -264,6 +267,7 @@ namespace purson{
 		switch(lit.type()){
 			case token_type::integer: ret = std::make_shared<integer_literal_expr>(lit.str(), scope.typeset()); break;
 			case token_type::real: ret = std::make_shared<real_literal_expr>(lit.str(), scope.typeset()); break;
+			case token_type::imaginary: ret = std::make_shared<imaginary_literal_expr>(lit.str(), scope.typeset()); break;
 			case token_type::string: ret = std::make_shared<string_literal_expr>(lit.str(), scope.typeset()); break;
 			default:
 				throw parser_error{it->loc(), "unexpected token for literal"};
@@ -53,6 +53,7 @@ namespace purson{
 					else if(
 						(it->type() == token_type::integer) ||
 						(it->type() == token_type::real) ||
+						(it->type() == token_type::imaginary) ||
 						(it->type() == token_type::string)
 					)
 						throw parser_error{it->loc(), "pattern matching isn't implemented yet :^("};
@@ -157,7 +158,12 @@ namespace purson{
 			++it;
 			auto val_it = it;
 			auto ret_val = parse_value(delim_fn, it, end, fn_scope);
-			if(ret_ty && (ret_val->value_type() != ret_ty))
+			// numbers convert to the return type like they do to a variable's type
+			if(
+				ret_ty && (ret_val->value_type() != ret_ty) &&
+				((numeric_category_of(ret_ty) == numeric_category::none) ||
+				 (numeric_category_of(ret_val->value_type()) == numeric_category::none))
+			)
 				throw parser_error{val_it->loc(), "return value has type different to specified return type"};
 			else if(!ret_ty)
 				ret_ty = ret_val->value_type();
@@ -182,7 +188,7 @@ namespace purson{
 				linkage
 			);
 
-			auto ret = std::make_shared<const return_expr>(std::move(ret_val));
+			auto ret = std::make_shared<const return_expr>(std::move(ret_val), ret_ty);
 			scope.add_fn(fn_name->str(), {}, decl);
 			return std::make_shared<const fn_def_expr>(std::move(decl), std::move(ret));
 		}
@@ -51,7 +51,7 @@ namespace purson{
 			return std::make_shared<const var_decl_expr>(id.str(), ty, is_mutable);
 		} else if(it->str() == "="){
 			auto return_expr = parse_value(delim_fn, ++it, end, scope);
-			return std::make_shared<var_def_expr>(id.str(), is_mutable, std::move(return_expr));
+			return std::make_shared<var_def_expr>(id.str(), is_mutable, std::move(return_expr), ty);
 		} else
 			throw parser_error{it->loc(), "only variable definitions currently supported"};
 	}
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <limits>
+
+#include <llvm/ADT/SCCIterator.h>
+#include <llvm/Analysis/CallGraph.h>
+
+#include "partition.hpp"
+
+namespace purson{
+	std::set<llvm::Function*> llvm_call_graph_partitioner::operator()(llvm::Function &f){
+		auto &&info = clusters_of(*f.getParent());
+
+		std::set<llvm::Function*> ret{&f};
+		info.emitted.insert(&f);
+
+		// added after the module was analyzed
+		auto cluster = info.cluster_of.find(&f);
+		if(cluster == end(info.cluster_of))
+			return ret;
+
+		for(auto &&fn : info.clusters[cluster->second]){
+			if(info.emitted.insert(fn).second)
+				ret.insert(fn);
+		}
+
+		return ret;
+	}
+
+	void llvm_call_graph_partitioner::exclude(llvm::Function &f){
+		clusters_of(*f.getParent()).emitted.insert(&f);
+	}
+
+	std::vector<llvm::Function*> llvm_call_graph_partitioner::cluster(llvm::Function &f){
+		auto &&info = clusters_of(*f.getParent());
+
+		auto res = info.cluster_of.find(&f);
+		if(res == end(info.cluster_of))
+			return {&f};
+
+		return info.clusters[res->second];
+	}
+
+	void llvm_call_graph_partitioner::forget(const llvm::Module *mod){
+		m_mods.erase(mod);
+	}
+
+	llvm_call_graph_partitioner::module_clusters &llvm_call_graph_partitioner::clusters_of(llvm::Module &mod){
+		auto res = m_mods.find(&mod);
+		if(res == end(m_mods))
+			res = m_mods.emplace(&mod, analyze(mod)).first;
+
+		return res->second;
+	}
+
+	llvm_call_graph_partitioner::module_clusters llvm_call_graph_partitioner::analyze(llvm::Module &mod){
+		constexpr auto npos = std::numeric_limits<std::size_t>::max();
+
+		llvm::CallGraph cg(mod);
+
+		// components come callees first
+		std::vector<std::vector<llvm::Function*>> sccs;
+		std::map<const llvm::Function*, std::size_t> scc_of;
+
+		for(auto it = llvm::scc_begin(&cg); !it.isAtEnd(); ++it){
+			std::vector<llvm::Function*> members;
+			for(auto &&node : *it){
+				auto fn = node->getFunction();
+				if(fn && !fn->isDeclaration())
+					members.push_back(fn);
+			}
+
+			if(members.empty()) continue;
+
+			for(auto &&fn : members)
+				scc_of[fn] = sccs.size();
+
+			sccs.push_back(std::move(members));
+		}
+
+		std::vector<std::size_t> sizes(sccs.size(), 0);
+		std::vector<std::set<std::size_t>> callees(sccs.size()), callers(sccs.size());
+
+		for(std::size_t i = 0; i < sccs.size(); i++){
+			for(auto &&fn : sccs[i]){
+				for(auto &&bb : *fn)
+					sizes[i] += bb.size();
+
+				for(auto &&call : *cg[fn]){
+					auto callee = call.second->getFunction();
+					auto callee_scc = scc_of.find(callee);
+					if((callee_scc == end(scc_of)) || (callee_scc->second == i))
+						continue;
+
+					callees[i].insert(callee_scc->second);
+					callers[callee_scc->second].insert(i);
+				}
+			}
+		}
+
+		module_clusters ret;
+		std::vector<std::size_t> cluster_of_scc(sccs.size(), npos);
+
+		for(std::size_t root = sccs.size(); root-- > 0;){
+			if(cluster_of_scc[root] != npos) continue;
+
+			auto id = ret.clusters.size();
+			auto &&cluster = ret.clusters.emplace_back();
+			std::size_t cluster_size = 0;
+
+			std::vector<std::size_t> work{root};
+			while(!work.empty()){
+				auto scc = work.back();
+				work.pop_back();
+
+				if(cluster_of_scc[scc] != npos) continue;
+
+				if(scc != root){
+					auto only_here = std::all_of(begin(callers[scc]), end(callers[scc]), [&](auto caller){ return cluster_of_scc[caller] == id; });
+					if(!(only_here || (sizes[scc] <= tiny)) || ((cluster_size + sizes[scc]) > budget))
+						continue;
+				}
+
+				cluster_of_scc[scc] = id;
+				cluster_size += sizes[scc];
+
+				for(auto &&fn : sccs[scc]){
+					cluster.push_back(fn);
+					ret.cluster_of[fn] = id;
+				}
+
+				work.insert(end(work), begin(callees[scc]), end(callees[scc]));
+			}
+		}
+
+		return ret;
+	}
+}
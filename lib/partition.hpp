@@ -0,0 +1,58 @@
+#ifndef PURSON_LIB_PARTITION_HPP
+#define PURSON_LIB_PARTITION_HPP 1
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "llvm.hpp"
+
+namespace purson{
+	/**
+	 * Groups functions in to shared compile on demand partitions.
+	 *
+	 * The direct call graph of each module is split in to strongly connected
+	 * components, which are then merged in to clusters from the callers
+	 * down. A callee joins its caller's cluster if it's tiny or nothing
+	 * outside the cluster calls it, as long as the cluster stays within
+	 * the size budget. Compiling any function compiles the rest of its
+	 * cluster with it, so calls within a cluster skip the stubs and can be
+	 * inlined. That's also why reloading a function recompiles the rest of
+	 * its cluster.
+	 **/
+	class llvm_call_graph_partitioner{
+		public:
+			//! instructions allowed in a cluster before it stops taking callees
+			static constexpr std::size_t budget = 1024;
+
+			//! functions at most this many instructions join their first caller's cluster
+			static constexpr std::size_t tiny = 32;
+
+			//! @returns functions to compile along with f, never anything already returned
+			std::set<llvm::Function*> operator()(llvm::Function &f);
+
+			//! never put f in a partition, e.g. once its code was replaced
+			void exclude(llvm::Function &f);
+
+			//! @returns every function that is or will be compiled in the same partition as f, f included
+			std::vector<llvm::Function*> cluster(llvm::Function &f);
+
+			//! drop everything known about a module, e.g. once it's removed
+			void forget(const llvm::Module *mod);
+
+		private:
+			struct module_clusters{
+				std::map<const llvm::Function*, std::size_t> cluster_of;
+				std::vector<std::vector<llvm::Function*>> clusters;
+				std::set<const llvm::Function*> emitted;
+			};
+
+			std::map<const llvm::Module*, module_clusters> m_mods;
+
+			module_clusters &clusters_of(llvm::Module &mod);
+
+			static module_clusters analyze(llvm::Module &mod);
+	};
+}
+
+#endif // !PURSON_LIB_PARTITION_HPP
@@ -0,0 +1,24 @@
+#include "runtime.hpp"
+
+extern "C"{
+	std::int32_t purson_cpu_level(){
+	#if defined(__x86_64__)
+		// may run from an ifunc resolver before the runtime's own constructors
+		__builtin_cpu_init();
+
+		if(
+			__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+			__builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl")
+		)
+			return 3;
+
+		if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("bmi2"))
+			return 2;
+
+		if(__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+			return 1;
+	#endif
+
+		return 0;
+	}
+}
@@ -0,0 +1,214 @@
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include <gmp.h>
+
+#include "purson/module.hpp"
+
+#include "runtime.hpp"
+
+namespace{
+	// boxed values are allocated so the tag bit of their address is always clear
+	struct big_int{
+		mpz_t value;
+	};
+
+	constexpr std::int64_t small_min = -(std::int64_t(1) << 62);
+	constexpr std::int64_t small_max = (std::int64_t(1) << 62) - 1;
+
+	bool is_small(std::int64_t word) noexcept{ return word & 1; }
+	
+	std::int64_t tag(std::int64_t val) noexcept{ return (val * 2) | 1; }
+
+	/**
+	 * Per thread free list of released boxed values, their limbs are kept
+	 * allocated for the next value boxed on the thread. Each value is
+	 * allocated on its own because values may be released on a different
+	 * thread to the one they came from.
+	 **/
+	class int_pool{
+		public:
+			~int_pool(){
+				for(auto boxed : m_free)
+					destroy(boxed);
+			}
+
+			big_int *acquire(){
+				if(m_free.empty()){
+					auto boxed = new big_int;
+					mpz_init(boxed->value);
+					return boxed;
+				}
+
+				auto boxed = m_free.back();
+				m_free.pop_back();
+				return boxed;
+			}
+
+			void release(big_int *boxed){
+				if(m_free.size() < max_free)
+					m_free.push_back(boxed);
+				else
+					destroy(boxed);
+			}
+
+		private:
+			static constexpr std::size_t max_free = 1024;
+
+			std::vector<big_int*> m_free;
+
+			static void destroy(big_int *boxed){
+				mpz_clear(boxed->value);
+				delete boxed;
+			}
+	};
+
+	thread_local int_pool pool;
+
+	std::int64_t box(const mpz_t val){
+		if(mpz_fits_slong_p(val)){
+			std::int64_t small = mpz_get_si(val);
+			if((small >= small_min) && (small <= small_max))
+				return tag(small);
+		}
+		
+		auto boxed = pool.acquire();
+		mpz_set(boxed->value, val);
+		return reinterpret_cast<std::intptr_t>(boxed);
+	}
+
+	struct unboxed{
+		explicit unboxed(std::int64_t word){
+			if(is_small(word))
+				mpz_init_set_si(value, word >> 1);
+			else
+				mpz_init_set(value, reinterpret_cast<const big_int*>(word)->value);
+		}
+		
+		~unboxed(){ mpz_clear(value); }
+		
+		mpz_t value;
+	};
+
+	template<typename Fn>
+	std::int64_t binary_op(std::int64_t lhs, std::int64_t rhs, Fn &&fn){
+		unboxed a(lhs), b(rhs);
+		mpz_t res;
+		mpz_init(res);
+		fn(res, a.value, b.value);
+		auto ret = box(res);
+		mpz_clear(res);
+		return ret;
+	}
+}
+
+extern "C"{
+	std::int64_t purson_int_add(std::int64_t lhs, std::int64_t rhs){ return binary_op(lhs, rhs, mpz_add); }
+	std::int64_t purson_int_sub(std::int64_t lhs, std::int64_t rhs){ return binary_op(lhs, rhs, mpz_sub); }
+	std::int64_t purson_int_mul(std::int64_t lhs, std::int64_t rhs){ return binary_op(lhs, rhs, mpz_mul); }
+
+	std::int64_t purson_int_div(std::int64_t lhs, std::int64_t rhs){
+		// zero is always inline, gmp would raise a signal instead
+		if(rhs == tag(0))
+			purson_div_zero();
+
+		return binary_op(lhs, rhs, mpz_tdiv_q);
+	}
+	
+	std::int32_t purson_int_cmp(std::int64_t lhs, std::int64_t rhs){
+		if(is_small(lhs) && is_small(rhs))
+			return (lhs > rhs) - (lhs < rhs);
+		
+		unboxed a(lhs), b(rhs);
+		auto res = mpz_cmp(a.value, b.value);
+		return (res > 0) - (res < 0);
+	}
+	
+	std::int64_t purson_nat_sub(std::int64_t lhs, std::int64_t rhs){
+		// naturals saturate at zero
+		return binary_op(lhs, rhs, [](mpz_t res, const mpz_t a, const mpz_t b){
+			mpz_sub(res, a, b);
+			if(mpz_sgn(res) < 0) mpz_set_ui(res, 0);
+		});
+	}
+
+	std::int64_t purson_int_from_i64(std::int64_t val){
+		if((val >= small_min) && (val <= small_max))
+			return tag(val);
+		
+		mpz_t tmp;
+		mpz_init_set_si(tmp, val);
+		auto ret = box(tmp);
+		mpz_clear(tmp);
+		return ret;
+	}
+	
+	std::int64_t purson_int_from_u64(std::uint64_t val){
+		if(val <= std::uint64_t(small_max))
+			return tag(std::int64_t(val));
+		
+		mpz_t tmp;
+		mpz_init_set_ui(tmp, val);
+		auto ret = box(tmp);
+		mpz_clear(tmp);
+		return ret;
+	}
+	
+	std::int64_t purson_int_from_f64(double val){
+		// nan and infinities have no integer value
+		if(!std::isfinite(val))
+			return tag(0);
+
+		mpz_t tmp;
+		mpz_init_set_d(tmp, val);
+		auto ret = box(tmp);
+		mpz_clear(tmp);
+		return ret;
+	}
+	
+	std::int64_t purson_int_from_str(const char *str){
+		mpz_t tmp;
+		mpz_init_set_str(tmp, str, 10);
+		auto ret = box(tmp);
+		mpz_clear(tmp);
+		return ret;
+	}
+	
+	std::int64_t purson_int_to_i64(std::int64_t word){
+		if(is_small(word)) return word >> 1;
+		return mpz_get_si(reinterpret_cast<const big_int*>(word)->value);
+	}
+	
+	double purson_int_to_f64(std::int64_t word){
+		if(is_small(word)) return double(word >> 1);
+		return mpz_get_d(reinterpret_cast<const big_int*>(word)->value);
+	}
+
+	std::int64_t purson_int_copy(std::int64_t word){
+		if(is_small(word)) return word;
+		return box(reinterpret_cast<const big_int*>(word)->value);
+	}
+
+	void purson_int_release(std::int64_t word){
+		if(word && !is_small(word))
+			pool.release(reinterpret_cast<big_int*>(word));
+	}
+}
+
+extern "C"{
+	void purson_div_zero(){
+		throw purson::module_error{"division by zero"};
+	}
+}
+
+namespace purson{
+	void runtime_int_get_mpz(std::int64_t word, mpz_ptr out){
+		if(is_small(word))
+			mpz_set_si(out, word >> 1);
+		else
+			mpz_set(out, reinterpret_cast<const big_int*>(word)->value);
+	}
+	
+	std::int64_t runtime_int_from_mpz(mpz_srcptr val){ return box(val); }
+}
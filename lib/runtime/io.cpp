@@ -0,0 +1,8 @@
+#include <cinttypes>
+#include <cstdio>
+
+#include "runtime.hpp"
+
+extern "C"{
+	void f1i32u0println(std::int32_t i){ std::printf("%" PRId32 "\n", i); }
+}
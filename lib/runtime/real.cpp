@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstddef>
+#include <map>
+#include <vector>
+
+#include <mpfr.h>
+
+#include "runtime.hpp"
+
+namespace{
+	// limbs are stored directly after the header in the same block
+	struct pooled_real{
+		mpfr_t value;
+	};
+
+	/**
+	 * Per thread free lists of real blocks bucketed by size, refilled from
+	 * large chunks. Chunks are never returned to the system because values
+	 * may be released on a different thread to the one they came from.
+	 **/
+	class real_pool{
+		public:
+			pooled_real *acquire(mpfr_prec_t prec){
+				auto size = block_size(prec);
+
+				void *mem;
+				auto &free_list = m_free[size];
+				if(!free_list.empty()){
+					mem = free_list.back();
+					free_list.pop_back();
+				}
+				else
+					mem = bump(size);
+
+				auto real = static_cast<pooled_real*>(mem);
+				auto limbs = static_cast<char*>(mem) + sizeof(pooled_real);
+				mpfr_custom_init(limbs, prec);
+				mpfr_custom_init_set(real->value, MPFR_NAN_KIND, 0, prec, limbs);
+				return real;
+			}
+
+			void release(pooled_real *real){
+				m_free[block_size(mpfr_get_prec(real->value))].push_back(real);
+			}
+
+		private:
+			static constexpr std::size_t chunk_size = 64 * 1024;
+
+			std::map<std::size_t, std::vector<void*>> m_free;
+			char *m_chunk = nullptr;
+			std::size_t m_remaining = 0;
+
+			static std::size_t block_size(mpfr_prec_t prec) noexcept{
+				constexpr auto align = alignof(std::max_align_t);
+				auto size = sizeof(pooled_real) + mpfr_custom_get_size(prec);
+				return (size + align - 1) & ~(align - 1);
+			}
+
+			void *bump(std::size_t size){
+				if(m_remaining < size){
+					auto new_size = std::max(size, chunk_size);
+					m_chunk = static_cast<char*>(std::malloc(new_size));
+					m_remaining = new_size;
+				}
+
+				auto ret = m_chunk;
+				m_chunk += size;
+				m_remaining -= size;
+				return ret;
+			}
+	};
+
+	thread_local real_pool pool;
+
+	pooled_real *make_real(std::uint64_t prec){ return pool.acquire(mpfr_prec_t(prec)); }
+
+	mpfr_srcptr value_of(const void *val){ return static_cast<const pooled_real*>(val)->value; }
+
+	template<typename Fn>
+	void *binary_op(const void *lhs, const void *rhs, std::uint64_t prec, Fn &&fn){
+		auto res = make_real(prec);
+		fn(res->value, value_of(lhs), value_of(rhs), MPFR_RNDN);
+		return res;
+	}
+}
+
+extern "C"{
+	void *purson_real_from_str(const char *str, std::uint64_t prec){
+		auto res = make_real(prec);
+		mpfr_set_str(res->value, str, 0, MPFR_RNDN);
+		return res;
+	}
+
+	void *purson_real_from_f64(double val, std::uint64_t prec){
+		auto res = make_real(prec);
+		mpfr_set_d(res->value, val, MPFR_RNDN);
+		return res;
+	}
+
+	void *purson_real_from_i64(std::int64_t val, std::uint64_t prec){
+		auto res = make_real(prec);
+		mpfr_set_si(res->value, val, MPFR_RNDN);
+		return res;
+	}
+
+	void *purson_real_from_u64(std::uint64_t val, std::uint64_t prec){
+		auto res = make_real(prec);
+		mpfr_set_ui(res->value, val, MPFR_RNDN);
+		return res;
+	}
+
+	void *purson_real_from_int(std::int64_t word, std::uint64_t prec){
+		mpz_t tmp;
+		mpz_init(tmp);
+		purson::runtime_int_get_mpz(word, tmp);
+
+		auto res = make_real(prec);
+		mpfr_set_z(res->value, tmp, MPFR_RNDN);
+		mpz_clear(tmp);
+		return res;
+	}
+
+	void *purson_real_from_ratio(std::int64_t num, std::int64_t denom, std::uint64_t prec){
+		auto res = make_real(prec);
+		mpfr_set_si(res->value, num, MPFR_RNDN);
+		mpfr_div_si(res->value, res->value, denom, MPFR_RNDN);
+		return res;
+	}
+
+	void *purson_real_round(const void *val, std::uint64_t prec){
+		auto res = make_real(prec);
+		mpfr_set(res->value, value_of(val), MPFR_RNDN);
+		return res;
+	}
+
+	void *purson_real_add(const void *lhs, const void *rhs, std::uint64_t prec){ return binary_op(lhs, rhs, prec, mpfr_add); }
+	void *purson_real_sub(const void *lhs, const void *rhs, std::uint64_t prec){ return binary_op(lhs, rhs, prec, mpfr_sub); }
+	void *purson_real_mul(const void *lhs, const void *rhs, std::uint64_t prec){ return binary_op(lhs, rhs, prec, mpfr_mul); }
+	void *purson_real_div(const void *lhs, const void *rhs, std::uint64_t prec){ return binary_op(lhs, rhs, prec, mpfr_div); }
+
+	std::int32_t purson_real_compare(const void *lhs, const void *rhs, std::int32_t op){
+		auto a = value_of(lhs), b = value_of(rhs);
+		switch(op){
+			case 0: return mpfr_equal_p(a, b);
+			case 1: return !mpfr_equal_p(a, b);
+			case 2: return mpfr_less_p(a, b);
+			case 3: return mpfr_greater_p(a, b);
+			case 4: return mpfr_lessequal_p(a, b);
+			case 5: return mpfr_greaterequal_p(a, b);
+			default: return 0;
+		}
+	}
+
+	double purson_real_to_f64(const void *val){ return mpfr_get_d(value_of(val), MPFR_RNDN); }
+	std::int64_t purson_real_to_i64(const void *val){ return mpfr_get_si(value_of(val), MPFR_RNDZ); }
+
+	std::int64_t purson_real_to_int(const void *val){
+		mpz_t tmp;
+		mpz_init(tmp);
+		mpfr_get_z(tmp, value_of(val), MPFR_RNDZ);
+		auto ret = purson::runtime_int_from_mpz(tmp);
+		mpz_clear(tmp);
+		return ret;
+	}
+
+	void purson_real_release(void *val){
+		if(val) pool.release(static_cast<pooled_real*>(val));
+	}
+}
@@ -0,0 +1,52 @@
+#include <map>
+
+#include "runtime.hpp"
+
+#define PURSON_RUNTIME_SYMBOL(name) { #name, reinterpret_cast<std::uintptr_t>(&name) }
+
+namespace purson{
+	std::uintptr_t runtime_symbol(std::string_view name){
+		static const std::map<std::string_view, std::uintptr_t> symbols{
+			PURSON_RUNTIME_SYMBOL(purson_int_add),
+			PURSON_RUNTIME_SYMBOL(purson_int_sub),
+			PURSON_RUNTIME_SYMBOL(purson_int_mul),
+			PURSON_RUNTIME_SYMBOL(purson_int_div),
+			PURSON_RUNTIME_SYMBOL(purson_int_cmp),
+			PURSON_RUNTIME_SYMBOL(purson_nat_sub),
+			PURSON_RUNTIME_SYMBOL(purson_int_from_i64),
+			PURSON_RUNTIME_SYMBOL(purson_int_from_u64),
+			PURSON_RUNTIME_SYMBOL(purson_int_from_f64),
+			PURSON_RUNTIME_SYMBOL(purson_int_from_str),
+			PURSON_RUNTIME_SYMBOL(purson_int_to_i64),
+			PURSON_RUNTIME_SYMBOL(purson_int_to_f64),
+			PURSON_RUNTIME_SYMBOL(purson_int_copy),
+			PURSON_RUNTIME_SYMBOL(purson_int_release),
+			PURSON_RUNTIME_SYMBOL(purson_div_zero),
+			PURSON_RUNTIME_SYMBOL(purson_real_from_str),
+			PURSON_RUNTIME_SYMBOL(purson_real_from_f64),
+			PURSON_RUNTIME_SYMBOL(purson_real_from_i64),
+			PURSON_RUNTIME_SYMBOL(purson_real_from_u64),
+			PURSON_RUNTIME_SYMBOL(purson_real_from_int),
+			PURSON_RUNTIME_SYMBOL(purson_real_from_ratio),
+			PURSON_RUNTIME_SYMBOL(purson_real_round),
+			PURSON_RUNTIME_SYMBOL(purson_real_add),
+			PURSON_RUNTIME_SYMBOL(purson_real_sub),
+			PURSON_RUNTIME_SYMBOL(purson_real_mul),
+			PURSON_RUNTIME_SYMBOL(purson_real_div),
+			PURSON_RUNTIME_SYMBOL(purson_real_compare),
+			PURSON_RUNTIME_SYMBOL(purson_real_to_f64),
+			PURSON_RUNTIME_SYMBOL(purson_real_to_i64),
+			PURSON_RUNTIME_SYMBOL(purson_real_to_int),
+			PURSON_RUNTIME_SYMBOL(purson_real_release),
+			PURSON_RUNTIME_SYMBOL(f1i32u0println)
+		};
+		
+		auto res = symbols.find(name);
+		if(res != end(symbols))
+			return res->second;
+		
+		return 0;
+	}
+}
+
+#undef PURSON_RUNTIME_SYMBOL
@@ -0,0 +1,80 @@
+#ifndef PURSON_LIB_RUNTIME_HPP
+#define PURSON_LIB_RUNTIME_HPP 1
+
+#include <cstdint>
+#include <string_view>
+
+#include <gmp.h>
+
+/**
+ * 
+ * @file lib/runtime/runtime.hpp
+ * 
+ * Functions called from generated code
+ * 
+ **/
+
+extern "C"{
+	// integer division by zero, throws a module_error through the calling code
+	[[noreturn]] void purson_div_zero();
+
+	// arbitrary precision integers, see lib/compile_llvm/integer.cpp for the word layout
+	std::int64_t purson_int_add(std::int64_t lhs, std::int64_t rhs);
+	std::int64_t purson_int_sub(std::int64_t lhs, std::int64_t rhs);
+	std::int64_t purson_int_mul(std::int64_t lhs, std::int64_t rhs);
+	std::int64_t purson_int_div(std::int64_t lhs, std::int64_t rhs);
+	std::int32_t purson_int_cmp(std::int64_t lhs, std::int64_t rhs);
+	std::int64_t purson_nat_sub(std::int64_t lhs, std::int64_t rhs);
+
+	std::int64_t purson_int_from_i64(std::int64_t val);
+	std::int64_t purson_int_from_u64(std::uint64_t val);
+	std::int64_t purson_int_from_f64(double val);
+	std::int64_t purson_int_from_str(const char *str);
+	std::int64_t purson_int_to_i64(std::int64_t word);
+	double purson_int_to_f64(std::int64_t word);
+	std::int64_t purson_int_copy(std::int64_t word); // a word the caller owns with the same value
+	void purson_int_release(std::int64_t word); // boxed words go back to the pool, inline ones are ignored
+
+	// arbitrary precision reals, handles to pooled MPFR values
+	void *purson_real_from_str(const char *str, std::uint64_t prec);
+	void *purson_real_from_f64(double val, std::uint64_t prec);
+	void *purson_real_from_i64(std::int64_t val, std::uint64_t prec);
+	void *purson_real_from_u64(std::uint64_t val, std::uint64_t prec);
+	void *purson_real_from_int(std::int64_t word, std::uint64_t prec);
+	void *purson_real_from_ratio(std::int64_t num, std::int64_t denom, std::uint64_t prec);
+	void *purson_real_round(const void *val, std::uint64_t prec);
+	void *purson_real_add(const void *lhs, const void *rhs, std::uint64_t prec);
+	void *purson_real_sub(const void *lhs, const void *rhs, std::uint64_t prec);
+	void *purson_real_mul(const void *lhs, const void *rhs, std::uint64_t prec);
+	void *purson_real_div(const void *lhs, const void *rhs, std::uint64_t prec);
+	std::int32_t purson_real_compare(const void *lhs, const void *rhs, std::int32_t op); // op: == != < > <= >=
+	double purson_real_to_f64(const void *val);
+	std::int64_t purson_real_to_i64(const void *val);
+	std::int64_t purson_real_to_int(const void *val);
+	void purson_real_release(void *val);
+
+	// basic io, mangled as the purson functions they implement
+	void f1i32u0println(std::int32_t i);
+
+	// best cpu feature level supported, 0 to 3 for baseline, sse4.2, avx2 and avx-512
+	// hidden so multiversioned function resolvers can call it before relocations are done
+	__attribute__((visibility("hidden"))) std::int32_t purson_cpu_level();
+}
+
+namespace purson{
+	/**
+	 * Get the address of a runtime function
+	 * 
+	 * @param[in] name unprefixed symbol name
+	 * @returns 0 if there is no runtime function with that name, otherwise its address
+	 **/
+	std::uintptr_t runtime_symbol(std::string_view name);
+
+	//! value of an arbitrary precision integer word, out must be initialized
+	void runtime_int_get_mpz(std::int64_t word, mpz_ptr out);
+
+	//! arbitrary precision integer word for a value
+	std::int64_t runtime_int_from_mpz(mpz_srcptr val);
+}
+
+#endif // !PURSON_LIB_RUNTIME_HPP
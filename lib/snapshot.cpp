@@ -0,0 +1,146 @@
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "fmt/core.h"
+
+#include "snapshot.hpp"
+
+namespace fs = std::filesystem;
+
+namespace purson{
+	namespace{
+		constexpr std::string_view snapshot_magic = "PURSNAP1";
+
+		class snapshot_writer{
+			public:
+				explicit snapshot_writer(std::ofstream &out): m_out(out){}
+
+				void write_raw(std::string_view bytes){
+					m_out.write(bytes.data(), bytes.size());
+					m_off += bytes.size();
+				}
+
+				void write_u64(std::uint64_t val){
+					write_raw(std::string_view(reinterpret_cast<const char*>(&val), sizeof(val)));
+				}
+
+				void write_bytes(std::string_view bytes){
+					write_u64(bytes.size());
+					write_raw(bytes);
+				}
+
+				//! pad so the bytes after the size are aligned
+				void write_aligned_bytes(std::string_view bytes){
+					write_u64(bytes.size());
+
+					static const char zeros[llvm_snapshot_align] = {};
+					write_raw(std::string_view(zeros, (llvm_snapshot_align - (m_off % llvm_snapshot_align)) % llvm_snapshot_align));
+					write_raw(bytes);
+				}
+
+			private:
+				std::ofstream &m_out;
+				std::size_t m_off = 0;
+		};
+
+		class snapshot_reader{
+			public:
+				explicit snapshot_reader(std::string_view data): m_data(data){}
+
+				std::uint64_t read_u64(){
+					std::uint64_t ret;
+					std::memcpy(&ret, take(sizeof(ret)).data(), sizeof(ret));
+					return ret;
+				}
+
+				std::string_view read_bytes(){
+					return take(read_u64());
+				}
+
+				std::string_view read_aligned_bytes(){
+					auto size = read_u64();
+					take((llvm_snapshot_align - (m_off % llvm_snapshot_align)) % llvm_snapshot_align);
+					return take(size);
+				}
+
+				std::string_view take(std::size_t n){
+					if(n > (m_data.size() - m_off))
+						throw module_error{"snapshot is truncated"};
+
+					auto ret = m_data.substr(m_off, n);
+					m_off += n;
+					return ret;
+				}
+
+			private:
+				std::string_view m_data;
+				std::size_t m_off = 0;
+		};
+	}
+
+	void llvm_write_snapshot(std::string_view path, const llvm_snapshot &snapshot){
+		auto dest = fs::path(path);
+
+		// written under a temporary name so a crash never leaves half a snapshot
+		auto tmp_path = dest;
+		tmp_path += ".tmp";
+
+		{
+			std::ofstream out(tmp_path, std::ios::binary);
+			if(!out)
+				throw module_error{fmt::format("could not open file: {}", tmp_path.string())};
+
+			snapshot_writer writer(out);
+			writer.write_raw(snapshot_magic);
+
+			writer.write_bytes(snapshot.salt);
+			writer.write_bytes(snapshot.user_data);
+
+			writer.write_u64(snapshot.mods.size());
+			for(auto &&mod : snapshot.mods){
+				writer.write_bytes(mod.name);
+				writer.write_bytes(mod.bitcode);
+
+				writer.write_u64(mod.objs.size());
+				for(auto &&obj : mod.objs)
+					writer.write_aligned_bytes(obj);
+			}
+
+			if(!out)
+				throw module_error{fmt::format("could not write snapshot '{}'", path)};
+		}
+
+		std::error_code ec;
+		fs::rename(tmp_path, dest, ec);
+		if(ec){
+			fs::remove(tmp_path, ec);
+			throw module_error{fmt::format("could not write snapshot '{}': {}", path, ec.message())};
+		}
+	}
+
+	llvm_snapshot llvm_read_snapshot(std::string_view data){
+		// offsets are from the start of the file, which is mapped page aligned
+		snapshot_reader reader(data);
+		if((data.size() < snapshot_magic.size()) || (reader.take(snapshot_magic.size()) != snapshot_magic))
+			throw module_error{"not a snapshot"};
+
+		llvm_snapshot ret;
+		ret.salt = reader.read_bytes();
+		ret.user_data = reader.read_bytes();
+
+		auto num_mods = reader.read_u64();
+		for(std::uint64_t i = 0; i < num_mods; i++){
+			auto &&mod = ret.mods.emplace_back();
+			mod.name = reader.read_bytes();
+			mod.bitcode = reader.read_bytes();
+
+			auto num_objs = reader.read_u64();
+			for(std::uint64_t j = 0; j < num_objs; j++)
+				mod.objs.push_back(reader.read_aligned_bytes());
+		}
+
+		return ret;
+	}
+}
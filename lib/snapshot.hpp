@@ -0,0 +1,43 @@
+#ifndef PURSON_LIB_SNAPSHOT_HPP
+#define PURSON_LIB_SNAPSHOT_HPP 1
+
+#include <string_view>
+#include <vector>
+
+#include "purson/module.hpp"
+
+namespace purson{
+	/**
+	 * Compiled state of a jit session, saved to disk and mapped back in.
+	 *
+	 * A snapshot holds the target salt it was compiled with, data the
+	 * embedder wants back with it and, for each module, its name, optimized
+	 * ir and relocatable objects. Objects are padded to llvm_snapshot_align
+	 * so they can be handed to the linker straight out of the mapping.
+	 * Everything is in native byte order, a snapshot is only ever loaded by
+	 * a jit for the same target.
+	 **/
+	struct llvm_snapshot{
+		struct module{
+			std::string_view name;
+			std::string_view bitcode;
+			std::vector<std::string_view> objs;
+		};
+
+		std::string_view salt;
+		std::string_view user_data;
+		std::vector<module> mods;
+	};
+
+	constexpr std::size_t llvm_snapshot_align = 16;
+
+	//! write a snapshot, replacing whatever is at path only once it's complete
+	//! @throws module_error if it can't be written
+	void llvm_write_snapshot(std::string_view path, const llvm_snapshot &snapshot);
+
+	//! @param[in] data whole snapshot file, which everything returned points in to
+	//! @throws module_error if data isn't a snapshot
+	llvm_snapshot llvm_read_snapshot(std::string_view data);
+}
+
+#endif // !PURSON_LIB_SNAPSHOT_HPP
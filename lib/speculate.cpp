@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <thread>
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "speculate.hpp"
+
+namespace purson{
+	namespace{
+		std::size_t default_spec_threads(){
+			// leave a hardware thread for the jit itself
+			auto hw = std::thread::hardware_concurrency();
+			return (hw > 1) ? (hw - 1) : 1;
+		}
+	}
+
+	llvm_speculator::llvm_speculator(
+		llvm_target_desc desc, opt_level opt, llvm::ObjectCache *cache, std::size_t num_threads,
+		const llvm_inline_cache *inlines
+	)
+		: m_desc(std::move(desc)), m_opt(opt), m_cache(cache), m_inlines(inlines), m_cancelled(std::make_shared<std::atomic<bool>>(false)),
+		  m_num_threads(num_threads ? num_threads : default_spec_threads()){}
+
+	llvm_speculator::~llvm_speculator(){
+		*m_cancelled = true;
+	}
+
+	void llvm_speculator::add_module(const llvm::Module &mod){
+		auto bitcode = std::make_shared<std::string>();
+		{
+			llvm::raw_string_ostream os(*bitcode);
+			llvm::WriteBitcodeToFile(&mod, os);
+		}
+
+		for(auto &&fn : mod){
+			if(fn.isDeclaration()) continue;
+
+			// fn_call_exprs are lowered to direct calls, so this is their static call graph
+			std::vector<std::string> callees;
+			for(auto &&bb : fn){
+				for(auto &&inst : bb){
+					auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+					if(!call) continue;
+
+					auto callee = call->getCalledFunction();
+					if(!callee || callee->isDeclaration() || (callee == &fn))
+						continue;
+
+					auto callee_name = callee->getName().str();
+					if(std::find(begin(callees), end(callees), callee_name) == end(callees))
+						callees.push_back(std::move(callee_name));
+				}
+			}
+
+			auto &&entry = m_fns[fn.getName().str()];
+			entry = fn_entry{};
+			entry.bitcode = bitcode;
+			entry.callees = std::move(callees);
+		}
+	}
+
+	void llvm_speculator::speculate(llvm::StringRef name){
+		auto res = m_fns.find(name);
+		if((res == end(m_fns)) || res->second.materialized || res->second.pending)
+			return;
+
+		auto pending = std::make_shared<job>();
+		auto bitcode = res->second.bitcode;
+		auto cancelled = m_cancelled;
+
+		if(!m_pool)
+			m_pool = std::make_unique<thread_pool>(m_num_threads);
+
+		pending->obj = m_pool->submit([this, pending, bitcode, cancelled, fn_name = res->first]() -> llvm_object_ptr{
+			int expected = queued;
+			if(*cancelled || !pending->state.compare_exchange_strong(expected, running))
+				return nullptr;
+
+			try{
+				return compile(fn_name, *bitcode);
+			}
+			catch(...){
+				// the lazy compile will report anything that's actually wrong
+				return nullptr;
+			}
+		}).share();
+
+		res->second.pending = std::move(pending);
+		m_in_flight.push_back(res->first);
+	}
+
+	void llvm_speculator::materialized(llvm::StringRef name){
+		auto res = m_fns.find(name);
+		if(res == end(m_fns)) return;
+
+		res->second.materialized = true;
+		for(auto &&callee : res->second.callees)
+			speculate(callee);
+
+		// never compiled again, so the module bitcode goes once all of its functions are done
+		res->second.bitcode.reset();
+		res->second.callees.clear();
+	}
+
+	void llvm_speculator::replaced(llvm::StringRef name){
+		auto res = m_fns.find(name);
+		if(res == end(m_fns)) return;
+
+		// a compile that's already running is left to finish, take_finished won't see it
+		if(auto pending = std::move(res->second.pending)){
+			int expected = queued;
+			pending->state.compare_exchange_strong(expected, claimed);
+		}
+
+		res->second.materialized = true;
+		res->second.bitcode.reset();
+		res->second.callees.clear();
+	}
+
+	llvm_object_ptr llvm_speculator::claim(llvm::StringRef name){
+		auto res = m_fns.find(name);
+		if((res == end(m_fns)) || !res->second.pending)
+			return nullptr;
+
+		auto pending = std::move(res->second.pending);
+
+		// not started yet, compiling it here is quicker than waiting behind the queue
+		int expected = queued;
+		if(pending->state.compare_exchange_strong(expected, claimed))
+			return nullptr;
+
+		return pending->obj.get();
+	}
+
+	std::vector<llvm_speculator::result> llvm_speculator::take_finished(){
+		std::vector<result> ret;
+
+		auto it = begin(m_in_flight);
+		while(it != end(m_in_flight)){
+			auto res = m_fns.find(*it);
+			if((res == end(m_fns)) || !res->second.pending){
+				it = m_in_flight.erase(it);
+				continue;
+			}
+
+			auto &&pending = res->second.pending;
+			if(pending->obj.wait_for(std::chrono::seconds(0)) != std::future_status::ready){
+				++it;
+				continue;
+			}
+
+			if(auto obj = pending->obj.get())
+				ret.push_back({res->first, std::move(obj)});
+
+			pending.reset();
+			it = m_in_flight.erase(it);
+		}
+
+		return ret;
+	}
+
+	void llvm_speculator::invalidate(){
+		*m_cancelled = true;
+		m_cancelled = std::make_shared<std::atomic<bool>>(false);
+
+		m_fns.clear();
+		m_in_flight.clear();
+	}
+
+	llvm_object_ptr llvm_speculator::compile(const std::string &name, const std::string &bitcode) const{
+		// compile threads belong to a single speculator, so the target machine can live as long as the thread
+		thread_local std::unique_ptr<llvm::TargetMachine> tm;
+		if(!tm)
+			tm = llvm_make_target_machine(m_desc, llvm_codegen_opt_level(m_opt));
+
+		auto buffer = llvm::MemoryBuffer::getMemBuffer(bitcode, name, false);
+		auto mod = llvm::parseBitcodeFile(buffer->getMemBufferRef(), llvm_ctx);
+		if(!mod){
+			llvm::consumeError(mod.takeError());
+			return nullptr;
+		}
+
+		auto fn = (*mod)->getFunction(name);
+		if(!fn || fn->isDeclaration())
+			return nullptr;
+
+		// everything else is already made external by the compile on demand layer and resolves to its definitions
+		for(auto &&other : **mod){
+			if((&other != fn) && !other.isDeclaration())
+				other.deleteBody();
+		}
+
+		for(auto &&global : (*mod)->globals()){
+			if(!global.isDeclaration()){
+				global.setInitializer(nullptr);
+				global.setLinkage(llvm::GlobalValue::ExternalLinkage);
+			}
+		}
+
+		fn->setName(spec_name(name));
+		fn->setLinkage(llvm::GlobalValue::ExternalLinkage);
+
+		if(m_inlines)
+			m_inlines->import_into(**mod);
+
+		llvm_optimize_module(**mod, *tm, m_opt);
+
+		llvm::orc::SimpleCompiler compiler(*tm, m_cache);
+		return std::make_shared<llvm::object::OwningBinary<llvm::object::ObjectFile>>(compiler(**mod));
+	}
+}
@@ -0,0 +1,105 @@
+#ifndef PURSON_LIB_SPECULATE_HPP
+#define PURSON_LIB_SPECULATE_HPP 1
+
+#include <atomic>
+#include <future>
+#include <map>
+
+#include "parallel.hpp"
+#include "inline_cache.hpp"
+#include "thread_pool.hpp"
+
+namespace purson{
+	/**
+	 * Speculative background compilation for the lazy jit.
+	 *
+	 * Modules register their bitcode and static call graph once added to the
+	 * compile on demand layer. Whenever a function is materialized its direct
+	 * callees are queued on a pool of compile threads, each with its own
+	 * context and target machine, so most first calls find their code
+	 * already compiled. Finished objects are linked by the jit, which points
+	 * the function stubs at them before the lazy compile is ever triggered.
+	 *
+	 * Everything but the compiles themselves runs on the jit thread.
+	 **/
+	class llvm_speculator{
+		public:
+			struct result{
+				std::string name;
+				llvm_object_ptr obj;
+			};
+
+			//! @param[in] desc target the compile threads compile for
+			//! @param[in] cache object cache used by the compile threads, may be null
+			//! @param[in] num_threads number of compile threads, 0 for all but one hardware thread
+			//! @param[in] inlines bodies of other modules' functions to inline, may be null
+			llvm_speculator(
+				llvm_target_desc desc, opt_level opt, llvm::ObjectCache *cache = nullptr, std::size_t num_threads = 0,
+				const llvm_inline_cache *inlines = nullptr
+			);
+			~llvm_speculator();
+
+			//! @returns the name the speculatively compiled body of a function is emitted under
+			static std::string spec_name(llvm::StringRef name){ return (name + ".spec").str(); }
+
+			//! register the functions of a module that has been added to the compile on demand layer
+			void add_module(const llvm::Module &mod);
+
+			//! queue a function for compilation, does nothing if it's unknown, queued or materialized
+			void speculate(llvm::StringRef name);
+
+			//! mark a function as materialized and queue its static callees
+			void materialized(llvm::StringRef name);
+
+			/**
+			 * Take the background compile of a function that is about to be materialized
+			 *
+			 * @param[in] name function being materialized
+			 * @returns the compiled object, waiting for it if it's already being compiled, or null if it still has to be compiled
+			 **/
+			llvm_object_ptr claim(llvm::StringRef name);
+
+			//! drop the pending compile of a function and never compile it again, e.g. once its code was replaced
+			void replaced(llvm::StringRef name);
+
+			//! @returns speculatively compiled functions that are ready to be linked
+			std::vector<result> take_finished();
+
+			//! drop everything registered so far, e.g. after a module is removed
+			void invalidate();
+
+		private:
+			enum job_state{ queued, running, claimed };
+
+			struct job{
+				std::atomic<int> state{queued};
+				std::shared_future<llvm_object_ptr> obj;
+			};
+
+			struct fn_entry{
+				std::shared_ptr<const std::string> bitcode;
+				std::vector<std::string> callees;
+				std::shared_ptr<job> pending;
+				bool materialized = false;
+			};
+
+			llvm_target_desc m_desc;
+			opt_level m_opt;
+			llvm::ObjectCache *m_cache;
+			const llvm_inline_cache *m_inlines;
+
+			std::map<std::string, fn_entry, std::less<>> m_fns;
+			std::vector<std::string> m_in_flight;
+
+			// set to stop queued compiles of an older generation of modules
+			std::shared_ptr<std::atomic<bool>> m_cancelled;
+
+			// started on the first speculation, so a jit that never compiles anything never starts them
+			std::size_t m_num_threads;
+			std::unique_ptr<thread_pool> m_pool;
+
+			llvm_object_ptr compile(const std::string &name, const std::string &bitcode) const;
+	};
+}
+
+#endif // !PURSON_LIB_SPECULATE_HPP
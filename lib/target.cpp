@@ -0,0 +1,137 @@
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include "llvm.hpp"
+
+namespace purson{
+	namespace{
+		llvm::Triple::ArchType target_arch(target t){
+			switch(t){
+				case target::arm: return llvm::Triple::arm;
+				case target::arm64: return llvm::Triple::aarch64;
+				case target::x86: return llvm::Triple::x86;
+				case target::x86_64: return llvm::Triple::x86_64;
+				default: return llvm::Triple(llvm::sys::getProcessTriple()).getArch();
+			}
+		}
+
+		void add_features(std::vector<std::string> &attrs, llvm::StringRef features){
+			llvm::SmallVector<llvm::StringRef, 16> split;
+			features.split(split, ',', -1, false);
+			for(auto &&feature : split)
+				attrs.push_back(feature.trim().str());
+		}
+
+		template<typename Fn>
+		void init_once(std::once_flag &flag, std::string_view what, Fn &&fn){
+			std::call_once(flag, [&]{
+				auto start = std::chrono::steady_clock::now();
+				fn();
+
+				if(std::getenv("PURSON_TIME_INIT")){
+					auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+					fmt::print(stderr, "{} initialized in {}us\n", what, elapsed.count());
+				}
+			});
+		}
+
+		std::once_flag codegen_init, cross_codegen_init, jit_init;
+	}
+
+	void llvm_init_codegen(){
+		// only what emitting objects needs, purson never parses or disassembles machine code
+		init_once(codegen_init, "llvm codegen", []{
+			llvm::InitializeNativeTarget();
+			llvm::InitializeNativeTargetAsmPrinter();
+		});
+	}
+
+	void llvm_init_cross_codegen(){
+		// the native target is only one of them, so a -march for another one fails on the spot instead of at emission
+		init_once(cross_codegen_init, "llvm cross codegen", []{
+			llvm::InitializeAllTargetInfos();
+			llvm::InitializeAllTargets();
+			llvm::InitializeAllTargetMCs();
+			llvm::InitializeAllAsmPrinters();
+		});
+	}
+
+	void llvm_init_jit(){
+		llvm_init_codegen();
+
+		init_once(jit_init, "llvm jit", []{
+			llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+		});
+	}
+
+	llvm_target_desc llvm_describe_target(target t, const target_cpu &cpu, bool host_by_default){
+		llvm::Triple triple(llvm::sys::getProcessTriple());
+		triple.setArch(target_arch(t));
+
+		llvm_target_desc ret;
+		ret.triple = triple.str();
+
+		auto host_arch = llvm::Triple(llvm::sys::getProcessTriple()).getArch();
+		if(cpu.name.empty() && !host_by_default){
+			// what every cpu of the architecture can run
+			ret.cpu = (triple.getArch() == llvm::Triple::x86_64) ? "x86-64" : "generic";
+		}
+		else if(cpu.name.empty() || (cpu.name == "native")){
+			if(triple.getArch() == host_arch){
+				ret.cpu = llvm::sys::getHostCPUName().str();
+
+				// the cpu name alone misses features disabled by the os or virtualization, like avx-512 state
+				llvm::StringMap<bool> host_features;
+				if(llvm::sys::getHostCPUFeatures(host_features)){
+					for(auto &&feature : host_features)
+						ret.attrs.push_back((feature.second ? "+" : "-") + feature.first().str());
+				}
+			}
+			else
+				ret.cpu = "generic";
+		}
+		else
+			ret.cpu = cpu.name;
+
+		add_features(ret.attrs, cpu.features);
+		return ret;
+	}
+
+	bool llvm_target_is_host(const llvm_target_desc &desc){
+		return llvm::Triple(desc.triple).getArch() == llvm::Triple(llvm::sys::getProcessTriple()).getArch();
+	}
+
+	std::unique_ptr<llvm::TargetMachine> llvm_make_target_machine(
+		const llvm_target_desc &desc, llvm::CodeGenOpt::Level cg_opt,
+		std::optional<llvm::Reloc::Model> aot_reloc
+	){
+		if(llvm_target_is_host(desc))
+			llvm_init_codegen();
+		else
+			llvm_init_cross_codegen();
+
+		std::string err;
+		llvm::SmallVector<std::string, 16> attrs(desc.attrs.begin(), desc.attrs.end());
+
+		llvm::EngineBuilder builder;
+		builder.setErrorStr(&err).setOptLevel(cg_opt);
+
+		// the jit code model would make every call and global access absolute
+		if(aot_reloc)
+			builder.setRelocationModel(*aot_reloc).setCodeModel(llvm::CodeModel::Small);
+
+		auto tm = builder.selectTarget(llvm::Triple(desc.triple), "", desc.cpu, attrs);
+		if(!tm)
+			throw module_error{fmt::format("could not create target machine for '{}' ({}): {}", desc.triple, desc.cpu, err)};
+
+		return std::unique_ptr<llvm::TargetMachine>(tm);
+	}
+}
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <set>
+#include <thread>
+
+#include <llvm/Analysis/ModuleSummaryAnalysis.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/LTO/LTO.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "thin_lto.hpp"
+
+namespace purson{
+	std::vector<std::string> llvm_thin_link(
+		std::vector<std::unique_ptr<llvm::Module>> mods, const llvm_target_desc &desc, opt_level opt,
+		std::string_view path, bool keep_exports
+	){
+		llvm::lto::Config conf;
+		conf.CPU = desc.cpu;
+		conf.MAttrs = desc.attrs;
+		conf.RelocModel = llvm::Reloc::PIC_;
+		conf.CodeModel = llvm::CodeModel::Small;
+		conf.CGOptLevel = llvm_codegen_opt_level(opt);
+		conf.DefaultTriple = desc.triple;
+
+		switch(opt){
+			case opt_level::O0: conf.OptLevel = 0; break;
+			case opt_level::O1: conf.OptLevel = 1; break;
+			case opt_level::O3: conf.OptLevel = 3; break;
+			default: conf.OptLevel = 2; break;
+		}
+
+		auto threads = std::max(1u, std::thread::hardware_concurrency());
+		llvm::lto::LTO lto(std::move(conf), llvm::lto::createInProcessThinBackend(threads));
+
+		// the inputs refer to their bitcode until the link is done
+		std::vector<std::string> bitcodes(mods.size());
+		std::set<std::string> defined;
+
+		for(std::size_t i = 0; i < mods.size(); i++){
+			// imported functions are declared available_externally without a body, which doesn't verify
+			for(auto &&fn : *mods[i]){
+				if(fn.isDeclaration() && fn.hasAvailableExternallyLinkage())
+					fn.setLinkage(llvm::GlobalValue::ExternalLinkage);
+			}
+
+			auto index = llvm::buildModuleSummaryIndex(*mods[i], nullptr, nullptr);
+			{
+				llvm::raw_string_ostream os(bitcodes[i]);
+				llvm::WriteBitcodeToFile(mods[i].get(), os, false, &index);
+			}
+
+			// identifiers have to be unique, source names alone might not be
+			auto id = fmt::format("{}#{}", mods[i]->getModuleIdentifier(), i);
+			auto input = llvm::lto::InputFile::create(llvm::MemoryBufferRef(bitcodes[i], id));
+			if(!input)
+				throw module_error{fmt::format("could not read back summary of '{}': {}", mods[i]->getModuleIdentifier(), llvm::toString(input.takeError()))};
+
+			std::vector<llvm::lto::SymbolResolution> resolutions;
+			for(auto &&sym : (*input)->symbols()){
+				llvm::lto::SymbolResolution res;
+				if(!sym.isUndefined()){
+					auto name = sym.getName().str();
+					res.Prevailing = defined.insert(name).second;
+
+					// anything not visible can be internalized and, if unreachable, dropped
+					res.VisibleToRegularObj = keep_exports || (name == "main");
+				}
+
+				resolutions.push_back(res);
+			}
+
+			if(auto err = lto.add(std::move(*input), resolutions))
+				throw module_error{fmt::format("could not add '{}' to the link: {}", mods[i]->getModuleIdentifier(), llvm::toString(std::move(err)))};
+		}
+
+		// the modules are only needed as bitcode from here on
+		mods.clear();
+
+		// streams are asked for from the backend threads, each task only touches its own slot
+		std::vector<std::string> objs(lto.getMaxTasks());
+		std::vector<std::error_code> errs(objs.size());
+
+		auto err = lto.run([&](unsigned task) -> std::unique_ptr<llvm::lto::NativeObjectStream>{
+			objs[task] = fmt::format("{}.{}.o", path, task);
+			auto os = std::make_unique<llvm::raw_fd_ostream>(objs[task], errs[task], llvm::sys::fs::F_None);
+			return std::make_unique<llvm::lto::NativeObjectStream>(std::move(os));
+		});
+
+		if(err)
+			throw module_error{fmt::format("thin link of '{}' failed: {}", path, llvm::toString(std::move(err)))};
+
+		std::vector<std::string> ret;
+		for(std::size_t i = 0; i < objs.size(); i++){
+			if(errs[i])
+				throw module_error{fmt::format("could not write '{}': {}", objs[i], errs[i].message())};
+
+			if(!objs[i].empty())
+				ret.push_back(std::move(objs[i]));
+		}
+
+		return ret;
+	}
+}
@@ -0,0 +1,28 @@
+#ifndef PURSON_LIB_THIN_LTO_HPP
+#define PURSON_LIB_THIN_LTO_HPP 1
+
+#include "llvm.hpp"
+
+namespace purson{
+	/**
+	 * Optimize modules together ThinLTO style and write a native object for each
+	 *
+	 * Every module gets a summary, the thin link imports callees across
+	 * module boundaries, internalizes whatever isn't visible outside the
+	 * program and drops what's unreachable, then the modules are optimized
+	 * and compiled in parallel.
+	 *
+	 * @param[in] mods modules to link, all in the calling thread's context
+	 * @param[in] desc target to compile for
+	 * @param[in] opt optimization level
+	 * @param[in] path prefix of the object files written
+	 * @param[in] keep_exports keep every exported function visible, otherwise only main is
+	 * @returns paths of the object files written
+	 **/
+	std::vector<std::string> llvm_thin_link(
+		std::vector<std::unique_ptr<llvm::Module>> mods, const llvm_target_desc &desc, opt_level opt,
+		std::string_view path, bool keep_exports
+	);
+}
+
+#endif // !PURSON_LIB_THIN_LTO_HPP
@@ -0,0 +1,94 @@
+#ifndef PURSON_LIB_THREAD_POOL_HPP
+#define PURSON_LIB_THREAD_POOL_HPP 1
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace purson{
+	/**
+	 * Fixed set of worker threads running submitted tasks in order.
+	 *
+	 * Workers live as long as the pool, so thread local state like llvm_ctx
+	 * is kept between tasks run on the same worker.
+	 **/
+	class thread_pool{
+		public:
+			//! @param[in] num_threads number of workers, 0 for one per hardware thread
+			explicit thread_pool(std::size_t num_threads = 0){
+				if(!num_threads)
+					num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+				m_workers.reserve(num_threads);
+				for(std::size_t i = 0; i < num_threads; i++)
+					m_workers.emplace_back([this]{ run(); });
+			}
+
+			~thread_pool(){
+				{
+					std::lock_guard lock(m_mut);
+					m_stop = true;
+				}
+
+				m_cv.notify_all();
+				for(auto &&worker : m_workers)
+					worker.join();
+			}
+
+			std::size_t num_threads() const noexcept{ return m_workers.size(); }
+
+			//! @returns whether the calling thread is one of the workers
+			bool is_worker() const noexcept{
+				auto id = std::this_thread::get_id();
+				return std::any_of(begin(m_workers), end(m_workers), [id](auto &&worker){ return worker.get_id() == id; });
+			}
+
+			//! @returns future for the result of fn, exceptions thrown by fn are rethrown from it
+			template<typename Fn>
+			auto submit(Fn &&fn) -> std::future<std::invoke_result_t<Fn>>{
+				auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Fn>()>>(std::forward<Fn>(fn));
+				auto ret = task->get_future();
+
+				{
+					std::lock_guard lock(m_mut);
+					m_tasks.emplace_back([task]{ (*task)(); });
+				}
+
+				m_cv.notify_one();
+				return ret;
+			}
+
+		private:
+			std::mutex m_mut;
+			std::condition_variable m_cv;
+			bool m_stop = false;
+
+			std::deque<std::function<void()>> m_tasks;
+			std::vector<std::thread> m_workers;
+
+			void run(){
+				while(1){
+					std::function<void()> task;
+
+					{
+						std::unique_lock lock(m_mut);
+						m_cv.wait(lock, [this]{ return m_stop || !m_tasks.empty(); });
+						if(m_tasks.empty()) return;
+
+						task = std::move(m_tasks.front());
+						m_tasks.pop_front();
+					}
+
+					task();
+				}
+			}
+	};
+}
+
+#endif // !PURSON_LIB_THREAD_POOL_HPP
@@ -0,0 +1,197 @@
+#include <algorithm>
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "tier.hpp"
+
+namespace purson{
+	llvm_tier_compiler::llvm_tier_compiler(llvm_target_desc desc, opt_level peak_opt, llvm::ObjectCache *cache, const llvm_inline_cache *inlines)
+		: m_desc(std::move(desc)), m_opt(peak_opt), m_cache(cache), m_inlines(inlines), m_worker([this]{ run(); }){}
+
+	llvm_tier_compiler::~llvm_tier_compiler(){
+		{
+			std::lock_guard lock(m_mut);
+			m_stop = true;
+		}
+
+		m_cv.notify_all();
+		m_worker.join();
+	}
+
+	void llvm_tier_compiler::instrument(llvm::Module &mod, const void *owner){
+		std::vector<llvm::Function*> fns;
+		for(auto &&fn : mod){
+			if(!fn.isDeclaration())
+				fns.push_back(&fn);
+		}
+
+		if(fns.empty()) return;
+
+		// the un-instrumented partition is what gets recompiled, one copy for all of its functions
+		auto bitcode = std::make_shared<std::string>();
+		{
+			llvm::raw_string_ostream os(*bitcode);
+			llvm::WriteBitcodeToFile(&mod, os);
+		}
+
+		std::uint64_t first_id;
+		{
+			std::lock_guard lock(m_mut);
+			first_id = m_next_id;
+			m_next_id += fns.size();
+
+			for(std::size_t i = 0; i < fns.size(); i++)
+				m_entries.emplace(first_id + i, entry{fns[i]->getName().str(), bitcode, owner, false});
+		}
+
+		auto &ctx = mod.getContext();
+		auto word_ty = llvm::Type::getInt64Ty(ctx);
+		auto ptr_ty = llvm::Type::getInt8PtrTy(ctx);
+
+		auto hook = llvm_runtime_fn(&mod, hook_name, llvm::Type::getVoidTy(ctx), {ptr_ty, word_ty, word_ty->getPointerTo()});
+
+		// filled in by the resolver, so the code doesn't depend on where the jit is
+		auto jit = mod.getNamedGlobal(jit_name);
+		if(!jit)
+			jit = new llvm::GlobalVariable(mod, ptr_ty, true, llvm::GlobalValue::ExternalLinkage, nullptr, jit_name);
+
+		for(std::size_t i = 0; i < fns.size(); i++){
+			auto &&fn = *fns[i];
+
+			auto counter = new llvm::GlobalVariable(
+				mod, word_ty, false, llvm::GlobalValue::InternalLinkage,
+				llvm::ConstantInt::get(word_ty, 0), fn.getName() + ".calls"
+			);
+
+			auto body = &fn.getEntryBlock();
+			auto entry_bb = llvm::BasicBlock::Create(ctx, "tier.entry", &fn, body);
+			auto hot_bb = llvm::BasicBlock::Create(ctx, "tier.hot", &fn, body);
+
+			llvm::IRBuilder<> builder(entry_bb);
+			auto count = builder.CreateAdd(builder.CreateLoad(counter), builder.getInt64(1));
+			builder.CreateStore(count, counter);
+
+			auto is_hot = builder.CreateICmpEQ(count, builder.getInt64(threshold));
+			builder.CreateCondBr(is_hot, hot_bb, body, llvm::MDBuilder(ctx).createBranchWeights(1, 1 << 20));
+
+			builder.SetInsertPoint(hot_bb);
+			builder.CreateCall(hook, {builder.CreateLoad(jit), builder.getInt64(first_id + i), counter});
+			builder.CreateBr(body);
+		}
+	}
+
+	void llvm_tier_compiler::request(std::uint64_t id){
+		{
+			std::lock_guard lock(m_mut);
+			auto res = m_entries.find(id);
+			if((res == end(m_entries)) || res->second.requested)
+				return;
+
+			res->second.requested = true;
+			m_queue.push_back(id);
+		}
+
+		m_cv.notify_one();
+	}
+
+	std::vector<llvm_tier_compiler::result> llvm_tier_compiler::take_finished(){
+		std::vector<result> ret;
+
+		std::lock_guard lock(m_mut);
+		ret.swap(m_finished);
+		return ret;
+	}
+
+	void llvm_tier_compiler::invalidate(const void *owner){
+		std::lock_guard lock(m_mut);
+
+		// a recompile already in progress is dropped when it finds its entry gone
+		for(auto it = begin(m_entries); it != end(m_entries);){
+			if(it->second.owner == owner)
+				it = m_entries.erase(it);
+			else
+				++it;
+		}
+
+		m_queue.erase(
+			std::remove_if(begin(m_queue), end(m_queue), [this](auto id){ return !m_entries.count(id); }),
+			end(m_queue)
+		);
+
+		m_finished.erase(
+			std::remove_if(begin(m_finished), end(m_finished), [owner](auto &&res){ return res.owner == owner; }),
+			end(m_finished)
+		);
+	}
+
+	void llvm_tier_compiler::run(){
+		// llvm_ctx is thread local, so everything here is independent of the jit thread
+		auto tm = llvm_make_target_machine(m_desc, llvm_codegen_opt_level(m_opt));
+		llvm::orc::SimpleCompiler compiler(*tm, m_cache);
+
+		while(1){
+			std::uint64_t id;
+			std::string name;
+			std::shared_ptr<const std::string> bitcode;
+			const void *owner;
+
+			{
+				std::unique_lock lock(m_mut);
+				m_cv.wait(lock, [this]{ return m_stop || !m_queue.empty(); });
+				if(m_stop) return;
+
+				id = m_queue.front();
+				m_queue.pop_front();
+
+				auto &&job = m_entries.at(id);
+				name = job.name;
+				bitcode = job.bitcode;
+				owner = job.owner;
+			}
+
+			auto obj = compile(name, *bitcode, *tm, compiler);
+
+			std::lock_guard lock(m_mut);
+
+			// never needed again once compiled, and stale if its owner was invalidated meanwhile
+			if(!m_entries.erase(id) || !obj) continue;
+
+			m_finished.push_back({std::move(name), std::move(obj), owner});
+		}
+	}
+
+	llvm_tier_compiler::object_ptr llvm_tier_compiler::compile(
+		const std::string &name, const std::string &bitcode,
+		llvm::TargetMachine &tm, llvm::orc::SimpleCompiler &compiler
+	){
+		auto buffer = llvm::MemoryBuffer::getMemBuffer(bitcode, name, false);
+		auto mod = llvm::parseBitcodeFile(buffer->getMemBufferRef(), llvm_ctx);
+		if(!mod){
+			llvm::consumeError(mod.takeError());
+			return nullptr;
+		}
+
+		auto fn = (*mod)->getFunction(name);
+		if(!fn || fn->isDeclaration())
+			return nullptr;
+
+		// anything else in the partition is still reached through its own stub
+		for(auto &&other : **mod){
+			if((&other != fn) && !other.isDeclaration())
+				other.deleteBody();
+		}
+
+		fn->setName(peak_name(name));
+
+		// including the rest of the partition, which is a declaration now
+		if(m_inlines)
+			m_inlines->import_into(**mod);
+
+		llvm_optimize_module(**mod, tm, m_opt);
+
+		return std::make_shared<llvm::object::OwningBinary<llvm::object::ObjectFile>>(compiler(**mod));
+	}
+}
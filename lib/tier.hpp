@@ -0,0 +1,105 @@
+#ifndef PURSON_LIB_TIER_HPP
+#define PURSON_LIB_TIER_HPP 1
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+
+#include "llvm.hpp"
+#include "inline_cache.hpp"
+
+namespace purson{
+	/**
+	 * Background recompilation of hot functions for the tiered jit.
+	 *
+	 * Baseline partitions register their bitcode once, shared by every
+	 * function they define, and each function gets an entry counter that
+	 * calls back into the jit once it reaches the threshold. Requested functions are rebuilt at the peak optimization
+	 * level on a worker thread with its own context and target machine, and
+	 * the finished objects are handed back to the jit to link and repoint
+	 * the function stubs at.
+	 **/
+	class llvm_tier_compiler{
+		public:
+			using object_ptr = std::shared_ptr<llvm::object::OwningBinary<llvm::object::ObjectFile>>;
+
+			struct result{
+				std::string name;
+				object_ptr obj;
+				const void *owner;
+			};
+
+			//! entry count at which a function is queued for recompilation
+			static constexpr std::uint64_t threshold = 1000;
+
+			//! entries between polls for the recompiled code after the threshold
+			static constexpr std::uint64_t recheck_interval = 256;
+
+			//! name of the hook called by instrumented functions
+			static constexpr const char *hook_name = "__purson_tier_up";
+
+			//! name of the global holding the value passed back to the hook, the jit's resolver provides it
+			static constexpr const char *jit_name = "__purson_tier_jit";
+
+			//! @param[in] desc target the worker compiles for
+			//! @param[in] cache object cache consulted by the worker, may be null
+			//! @param[in] inlines bodies of other modules' functions to inline, may be null
+			llvm_tier_compiler(llvm_target_desc desc, opt_level peak_opt, llvm::ObjectCache *cache = nullptr, const llvm_inline_cache *inlines = nullptr);
+			~llvm_tier_compiler();
+
+			//! @returns the name the recompiled body of a function is emitted under
+			static std::string peak_name(llvm::StringRef name){ return (name + ".peak").str(); }
+
+			/**
+			 * Register the baseline of a partition and add entry counters to its functions
+			 *
+			 * @param[in] mod baseline partition
+			 * @param[in] owner what the functions are invalidated by
+			 **/
+			void instrument(llvm::Module &mod, const void *owner);
+
+			//! queue a function for recompilation, does nothing if it already was
+			void request(std::uint64_t id);
+
+			//! @returns recompiled functions that are ready to be linked
+			std::vector<result> take_finished();
+
+			//! drop everything registered for owner, e.g. after a module is removed
+			void invalidate(const void *owner);
+
+		private:
+			struct entry{
+				std::string name;
+				std::shared_ptr<const std::string> bitcode;
+				const void *owner;
+				bool requested;
+			};
+
+			llvm_target_desc m_desc;
+			opt_level m_opt;
+			llvm::ObjectCache *m_cache;
+			const llvm_inline_cache *m_inlines;
+
+			std::mutex m_mut;
+			std::condition_variable m_cv;
+			bool m_stop = false;
+
+			// removed once recompiled or invalidated, the partition bitcode goes with the last of its functions
+			std::uint64_t m_next_id = 0;
+			std::unordered_map<std::uint64_t, entry> m_entries;
+			std::deque<std::uint64_t> m_queue;
+			std::vector<result> m_finished;
+
+			std::thread m_worker;
+
+			void run();
+			object_ptr compile(const std::string &name, const std::string &bitcode, llvm::TargetMachine &tm, llvm::orc::SimpleCompiler &compiler);
+	};
+}
+
+#endif // !PURSON_LIB_TIER_HPP
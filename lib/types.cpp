@@ -1,4 +1,5 @@
 #include <cmath>
+#include <charconv>
 #include <map>
 #include <list>
 
@@ -9,51 +10,27 @@
 
 namespace purson{
 	const type *promote_type(const type *a, const type *b){
-		using real_typep_t = const real_type*;
-		using rational_typep_t = const rational_type*;
-		using integer_typep_t = const integer_type*;
-		using natural_typep_t = const natural_type*;
-		
-		auto greater_of = [](auto lhs, auto rhs){
-			return lhs->bits() > rhs->bits() ? lhs : rhs;
-		};
-		
 		if(!a && !b) return nullptr;
 		else if(!a) return b;
 		else if(!b) return a;
 		else if(a == b) return a;
 		else if(dynamic_cast<const arithmetic_type*>(a) && dynamic_cast<const arithmetic_type*>(b)){
-			real_typep_t ar = dynamic_cast<real_typep_t>(a), br = dynamic_cast<real_typep_t>(b);
-			rational_typep_t aq = dynamic_cast<rational_typep_t>(a), bq = dynamic_cast<rational_typep_t>(b);
-			integer_typep_t ai = dynamic_cast<integer_typep_t>(a), bi = dynamic_cast<integer_typep_t>(b);
-			natural_typep_t an = dynamic_cast<natural_typep_t>(a), bn = dynamic_cast<natural_typep_t>(b);
+			// the numeric hierarchy derives every category from natural_type,
+			// so promotion has to go by the most derived category of each side
+			auto a_cat = numeric_category_of(a);
+			auto b_cat = numeric_category_of(b);
 			
-			if(an || bn){
-				if(an && bn)
-					return greater_of(an, bn);
-				else
-					return an ? b : an;
-			}
-			else if(ai || bi){
-				if(ai && bi)
-					return greater_of(ai, bi);
-				else
-					return ai ? b : ai;
-			}
-			else if(aq || bq){
-				if(aq && bq)
-					return greater_of(aq, bq);
-				else
-					return aq ? b : aq;
-			}
-			else if(ar || br){
-				if(ar && br)
-					return greater_of(ar, br);
-				else
-					return ar ? b : ar;
+			if((a_cat == numeric_category::none) || (b_cat == numeric_category::none))
+				throw type_error{"unknown arithmetic_type, can't promote either side :^("};
+			else if(a_cat == b_cat){
+				bool a_arbitrary = is_arbitrary_precision(a);
+				if(a_arbitrary != is_arbitrary_precision(b))
+					return a_arbitrary ? a : b;
+				
+				return a->bits() >= b->bits() ? a : b;
 			}
 			else
-				throw type_error{"unknown arithmetic_type, can't promote either side :^("};
+				return a_cat > b_cat ? a : b;
 		}
 		else
 			throw type_error{"only arithmetic types can be promoted currently"};
@@ -108,6 +85,16 @@ namespace purson{
 			: basic_type(bits_, "i"){}
 	};
 	
+	struct basic_big_natural: basic_type, natural_type, arbitrary_precision_type{
+		basic_big_natural()
+			: basic_type(0, "N"){ set_str("N"); }
+	};
+	
+	struct basic_big_integer: basic_type, integer_type, arbitrary_precision_type{
+		basic_big_integer()
+			: basic_type(0, "I"){ set_str("I"); }
+	};
+	
 	struct basic_rational: basic_type, rational_type{
 		basic_rational(std::size_t bits_)
 			: basic_type(bits_, "q"){}
@@ -120,6 +107,20 @@ namespace purson{
 		const bool is_ieee754;
 	};
 	
+	struct basic_big_real: basic_real, arbitrary_precision_type{
+		explicit basic_big_real(std::size_t precision)
+			: basic_real(precision, false){ set_str(fmt::format("R{}", precision)); }
+	};
+	
+	struct basic_complex: basic_type, complex_type{
+		basic_complex(const real_type *component_type_)
+			: basic_type(component_type_->bits(), "c"), m_component_type(component_type_){}
+		
+		const real_type *component_type() const noexcept override{ return m_component_type; }
+		
+		const real_type *m_component_type;
+	};
+	
 	struct basic_function: basic_type, function_type{
 		basic_function(std::size_t bits_, const type *return_type_, const std::vector<const type*> &param_types_)
 			: basic_type(bits_, ""), m_return_type{return_type_}, m_param_types{param_types_}{
@@ -147,9 +148,24 @@ namespace purson{
 		public:
 			const type *get(std::string_view name) const override{
 				switch(name[0]){
+					case 'B':{
+						if(name == "Boolean") return boolean();
+						break;
+					}
+					
+					case 'C':{
+						if(name.substr(0, 7) == "Complex"){
+							if((name == "Complex") || (name == "Complex32")) return &m_complex_types[0];
+							else if(name == "Complex64") return &m_complex_types[1];
+						}
+						
+						break;
+					}
+					
 					case 'I':{
 						if(name.substr(0, 7) == "Integer"){
-							if((name == "Integer") || (name == "Integer32")) return &m_integer_types[2];
+							if(name == "Integer") return &m_big_integer_type;
+							else if(name == "Integer32") return &m_integer_types[2];
 							else if(name == "Integer64") return &m_integer_types[3];
 							else if(name == "Integer16") return &m_integer_types[1];
 							else if(name == "Integer8") return &m_integer_types[0];
@@ -158,10 +174,37 @@ namespace purson{
 						break;
 					}
 					
+					case 'N':{
+						if(name.substr(0, 7) == "Natural"){
+							if(name == "Natural") return &m_big_natural_type;
+							else if(name == "Natural64") return &m_natural_types[3];
+							else if(name == "Natural32") return &m_natural_types[2];
+							else if(name == "Natural16") return &m_natural_types[1];
+							else if(name == "Natural8") return &m_natural_types[0];
+						}
+						
+						break;
+					}
+					
 					case 'R':{
-						if(name.substr(0, 4) == "Real"){
-							if((name == "Real") || (name == "Real32")) return &m_real_types[0];
-							else if(name == "Real64") return &m_real_types[1];
+						if(name.substr(0, 8) == "Rational"){
+							if((name == "Rational") || (name == "Rational64")) return &m_rational_types[2];
+							else if(name == "Rational128") return &m_rational_types[3];
+							else if(name == "Rational32") return &m_rational_types[1];
+							else if(name == "Rational16") return &m_rational_types[0];
+						}
+						else if(name.substr(0, 4) == "Real"){
+							if((name == "Real") || (name == "Real32")) return &m_real_types[1];
+							else if(name == "Real64") return &m_real_types[2];
+							else if(name == "Real16") return &m_real_types[0];
+							else{
+								// any other width is an arbitrary precision real
+								auto digits = name.substr(4);
+								std::uint32_t precision = 0;
+								auto res = std::from_chars(digits.data(), digits.data() + digits.size(), precision);
+								if((res.ec == std::errc{}) && (res.ptr == digits.data() + digits.size()))
+									return real(precision, false);
+							}
 						}
 						
 						break;
@@ -191,6 +234,10 @@ namespace purson{
 				return &m_type_type;
 			}
 
+			const boolean_type *boolean() const noexcept override{
+				return &m_boolean_type;
+			}
+
 			const string_type *string(char_encoding encoding) const noexcept override{
 				switch(encoding){
 					case char_encoding::ascii: return &m_string_types[0];
@@ -203,6 +250,8 @@ namespace purson{
 			
 			const natural_type *natural(std::uint32_t bits) const override{
 				switch(bits){
+					case 0: return &m_big_natural_type;
+					
 					case 8:
 					case 16:
 					case 32:
@@ -215,6 +264,8 @@ namespace purson{
 			
 			const integer_type *integer(std::uint32_t bits) const override{
 				switch(bits){
+					case 0: return &m_big_integer_type;
+					
 					case 8:
 					case 16:
 					case 32:
@@ -238,19 +289,30 @@ namespace purson{
 			}
 			
 			const real_type *real(std::uint32_t bits, bool ieee754) const override{
-				if(!ieee754) return nullptr;
+				if(!ieee754){
+					if(bits < 2) return nullptr;
+					
+					auto res = m_big_real_types.find(bits);
+					if(res == end(m_big_real_types))
+						res = m_big_real_types.emplace(std::piecewise_construct, std::forward_as_tuple(bits), std::forward_as_tuple(bits)).first;
+					
+					return &res->second;
+				}
 				
 				switch(bits){
-					case 8:
-					case 16:
-					case 32:
-					case 64:
-						return &m_real_types[(int)std::log2(bits) - 3];
-					
+					case 16: return &m_real_types[0];
+					case 32: return &m_real_types[1];
+					case 64: return &m_real_types[2];
 					default: return nullptr;
 				}
 			}
 			
+			const complex_type *complex(const real_type *real_type_) const override{
+				if(real_type_ == &m_real_types[1]) return &m_complex_types[0];
+				else if(real_type_ == &m_real_types[2]) return &m_complex_types[1];
+				else return nullptr;
+			}
+			
 			const function_type *function(const type *return_type, const std::vector<const type*> &param_types) const override{
 				auto ret_ty_res = m_fn_types.find(return_type);
 				if(ret_ty_res == end(m_fn_types)){
@@ -288,6 +350,7 @@ namespace purson{
 		private:
 			basic_unit m_unit_type;
 			basic_type_type m_type_type;
+			basic_boolean m_boolean_type{1};
 
 			basic_string m_string_types[4]{
 				{char_encoding::ascii}, {char_encoding::utf8}, {char_encoding::utf16}, {char_encoding::utf32}
@@ -301,12 +364,21 @@ namespace purson{
 				{8}, {16}, {32}, {64}
 			};
 			
+			basic_big_natural m_big_natural_type;
+			basic_big_integer m_big_integer_type;
+			
 			basic_rational m_rational_types[4]{
 				{16}, {32}, {64}, {128}
 			};
 			
-			basic_real m_real_types[2]{
-				{32, true}, {64, true}
+			basic_real m_real_types[3]{
+				{16, true}, {32, true}, {64, true}
+			};
+			
+			mutable std::map<std::uint32_t, basic_big_real> m_big_real_types;
+			
+			basic_complex m_complex_types[2]{
+				{&m_real_types[1]}, {&m_real_types[2]}
 			};
 			
 			mutable std::map<const type*, std::map<std::size_t, std::list<basic_function>>> m_fn_types;
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <clocale>
+#include <cstdlib>
 
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -33,7 +34,10 @@ int main(int argc, char *argv[]){
 	
 	std::string_view ver = "dev";
 	auto types = purson::types(ver);
-	auto modules = purson::make_jit_moduleset();
+	// the whole repl function is recompiled every line, so keep optimization cheap
+	auto modules = purson::make_jit_moduleset(purson::target::auto_, purson::opt_level::O1);
+	if(auto cache_dir = std::getenv("PURSON_CACHE_DIR"))
+		modules->set_cache_dir(cache_dir);
 
 	using repl_fn_t = void(*)();
 